@@ -0,0 +1,65 @@
+// ConfigKey.hh --- Interned configuration key
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef CONFIGKEY_HH
+#define CONFIGKEY_HH
+
+#include <string>
+
+namespace workrave
+{
+  //! Interned configuration key.
+  /*!
+   *  A ConfigKey is created once per setting, for example when a break is
+   *  initialized, and passed to IConfigurator::get_value instead of a
+   *  string. The key is normalized and interned when it is created, so a
+   *  lookup uses its number and does not build or compare strings.
+   *
+   *  Keys are never released; all keys with the same name share a number.
+   *  The hash of the name is computed once as well. It does not depend on
+   *  the order in which keys are created, so it can be stored in a file.
+   */
+  class ConfigKey
+  {
+  public:
+    ConfigKey();
+    explicit ConfigKey(const std::string &key);
+
+    const std::string &str() const;
+    int get_id() const;
+    unsigned int get_hash() const;
+    bool is_valid() const;
+
+    static ConfigKey find(const std::string &key);
+    static int get_count();
+    static unsigned int hash(const std::string &key);
+
+  private:
+    //! Name of the key, owned by the registry.
+    const std::string *name;
+
+    //! Number of the key, or -1 if it is not valid.
+    int id;
+
+    //! Hash of the name.
+    unsigned int hash_value;
+  };
+}
+
+#endif // CONFIGKEY_HH
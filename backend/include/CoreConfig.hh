@@ -59,6 +59,7 @@ public:
   static const std::string CFG_KEY_DISTRIBUTION_TCP_PASSWORD;
   static const std::string CFG_KEY_DISTRIBUTION_TCP_ATTEMPTS;
   static const std::string CFG_KEY_DISTRIBUTION_TCP_INTERVAL;
+  static const std::string CFG_KEY_DISTRIBUTION_STATE_INTERVAL;
 
   static bool match(const std::string &str, const std::string &key, workrave::BreakId &id);
 };
@@ -24,6 +24,8 @@
 #include <list>
 #include <map>
 
+#include "ConfigKey.hh"
+
 namespace workrave {
 
   // Forward declaratons
@@ -55,6 +57,10 @@ namespace workrave {
     virtual bool save(std::string filename) = 0;
     virtual bool save() = 0;
 
+    virtual void begin_transaction() = 0;
+    virtual bool commit_transaction() = 0;
+    virtual void abort_transaction() = 0;
+
     virtual bool remove_key(const std::string &key) const = 0;
     virtual bool rename_key(const std::string &key, const std::string &new_key) = 0;
 
@@ -68,6 +74,16 @@ namespace workrave {
     virtual void get_value_with_default(const std::string &key, int &out, const int def) const = 0;
     virtual void get_value_with_default(const std::string &key, double &out, const double def) const = 0;
 
+    virtual bool get_value(const ConfigKey &key, std::string &out) const = 0;
+    virtual bool get_value(const ConfigKey &key, bool &out) const = 0;
+    virtual bool get_value(const ConfigKey &key, int &out) const = 0;
+    virtual bool get_value(const ConfigKey &key, double &out) const = 0;
+
+    virtual void get_value_with_default(const ConfigKey &key, std::string &out, std::string s) const = 0;
+    virtual void get_value_with_default(const ConfigKey &key, bool &out, const bool def) const = 0;
+    virtual void get_value_with_default(const ConfigKey &key, int &out, const int def) const = 0;
+    virtual void get_value_with_default(const ConfigKey &key, double &out, const double def) const = 0;
+
     virtual bool set_value(const std::string &key, const std::string &v, ConfigFlags flags = CONFIG_FLAG_NONE) = 0;
     virtual bool set_value(const std::string &key, const char *v, ConfigFlags flags = CONFIG_FLAG_NONE) = 0;
     virtual bool set_value(const std::string &key, int v, ConfigFlags flags = CONFIG_FLAG_NONE) = 0;
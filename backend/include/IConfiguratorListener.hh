@@ -18,6 +18,7 @@
 #define ICONFIGURATORLISTENER_HH
 
 #include <string>
+#include <list>
 
 namespace workrave
 {
@@ -29,6 +30,19 @@ namespace workrave
 
     //! The configuration item with specified key has changed.
     virtual void config_changed_notify(const std::string &key) = 0;
+
+    //! The configuration items with the specified keys have changed together.
+    /*!
+     *  Called once for all changed keys the listener listens to. By
+     *  default, config_changed_notify is called for each key.
+     */
+    virtual void config_batch_changed_notify(const std::list<std::string> &keys)
+    {
+      for (std::list<std::string>::const_iterator it = keys.begin(); it != keys.end(); it++)
+        {
+          config_changed_notify(*it);
+        }
+    }
   };
 }
 
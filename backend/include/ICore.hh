@@ -85,9 +85,14 @@ namespace workrave {
     //! Initialize the Core. Must be called first.
     virtual void init(int argc, char **argv, IApp *app, const std::string &display) = 0;
 
-    //! Periodic heartbeat. The GUI *MUST* call this method every second.
+    //! Periodic heartbeat. The GUI *MUST* call this method every
+    //! get_heartbeat_interval() seconds, and immediately when the Core
+    //! requests a wakeup.
     virtual void heartbeat() = 0;
 
+    //! Returns the number of seconds until the next heartbeat is needed.
+    virtual int get_heartbeat_interval() = 0;
+
     //! Force a break of the specified type.
     virtual void force_break(BreakId id, BreakHint break_hint) = 0;
 
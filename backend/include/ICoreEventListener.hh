@@ -54,6 +54,9 @@ namespace workrave
 
     // Notification that the usage mode has changed..
     virtual void core_event_usage_mode_changed(const UsageMode m) = 0;
+
+    // Notification that the heartbeat must be called now.
+    virtual void core_event_heartbeat_wakeup() = 0;
   };
 }
 
@@ -55,7 +55,8 @@ ActivityMonitor::ActivityMonitor() :
   prev_y(-10),
   button_is_pressed(false),
   sensitivity(3),
-  listener(NULL)
+  listener(NULL),
+  wakeup_listener(NULL)
 {
   TRACE_ENTER("ActivityMonitor::ActivityMonitor");
 
@@ -245,15 +246,67 @@ ActivityMonitor::set_listener(ActivityMonitorListener *l)
 }
 
 
-//! Activity is reported by the input monitor.
+//! Sets the listener that is called once on the next user activity.
+/*!
+ *  Unlike set_listener, this does not replace the activity listener, which
+ *  is used by the break in progress.
+ */
+void
+ActivityMonitor::set_wakeup_listener(ActivityMonitorListener *l)
+{
+  lock.lock();
+  wakeup_listener = l;
+  lock.unlock();
+}
+
+
+//! A batch of input events is reported by the input monitor.
 void
-ActivityMonitor::action_notify()
+ActivityMonitor::input_events_notify(const InputEvent *events, int count)
 {
+  bool action = false;
+
   lock.lock();
 
-  GTimeVal now;
-  g_get_current_time(&now);
+  for (int i = 0; i < count; i++)
+    {
+      const InputEvent &event = events[i];
+
+      GTimeVal now;
+      now.tv_sec = event.time / G_USEC_PER_SEC;
+      now.tv_usec = event.time % G_USEC_PER_SEC;
+
+      switch (event.type)
+        {
+        case InputEvent::INPUT_EVENT_ACTION:
+        case InputEvent::INPUT_EVENT_KEYBOARD:
+          action_notify(now);
+          action = true;
+          break;
+
+        case InputEvent::INPUT_EVENT_MOUSE:
+          action = mouse_notify(event.x, event.y, event.wheel, event.distance, now) || action;
+          break;
+
+        case InputEvent::INPUT_EVENT_BUTTON:
+          action = button_notify(event.flag != 0, now) || action;
+          break;
+        }
+    }
+
+  lock.unlock();
 
+  if (action)
+    {
+      call_listener();
+    }
+}
+
+
+//! Activity is reported by the input monitor.
+void
+ActivityMonitor::action_notify(const GTimeVal &now)
+{
   switch (activity_state)
     {
     case ACTIVITY_IDLE:
@@ -297,67 +350,60 @@ ActivityMonitor::action_notify()
     }
 
   last_action_time = now;
-  lock.unlock();
-  call_listener();
 }
 
 
 //! Mouse activity is reported by the input monitor.
-void
-ActivityMonitor::mouse_notify(int x, int y, int wheel_delta)
+bool
+ActivityMonitor::mouse_notify(int x, int y, int wheel_delta, int distance, const GTimeVal &now)
 {
-  lock.lock();
   const int delta_x = x - prev_x;
   const int delta_y = y - prev_y;
   prev_x = x;
   prev_y = y;
 
   if (abs(delta_x) >= sensitivity || abs(delta_y) >= sensitivity
-      || wheel_delta != 0 || button_is_pressed)
+      || distance >= sensitivity || wheel_delta != 0 || button_is_pressed)
     {
-      action_notify();
+      action_notify(now);
+      return true;
     }
-  lock.unlock();
+  return false;
 }
 
 
 //! Mouse button activity is reported by the input monitor.
-void
-ActivityMonitor::button_notify(bool is_press)
+bool
+ActivityMonitor::button_notify(bool is_press, const GTimeVal &now)
 {
-  lock.lock();
-
   button_is_pressed = is_press;
 
   if (is_press)
     {
-      action_notify();
+      action_notify(now);
+      return true;
     }
-
-  lock.unlock();
+  return false;
 }
 
 
-//! Keyboard activity is reported by the input monitor.
+//! Calls the callback listeners.
 void
-ActivityMonitor::keyboard_notify(bool repeat)
+ActivityMonitor::call_listener()
 {
-  (void)repeat;
-
-  lock.lock();
-  action_notify();
-  lock.unlock();
+  call_listener(listener);
+  call_listener(wakeup_listener);
 }
 
 
-//! Calls the callback listener.
+//! Calls the callback listener in the specified slot.
 void
-ActivityMonitor::call_listener()
+ActivityMonitor::call_listener(ActivityMonitorListener *&slot)
 {
   ActivityMonitorListener *l = NULL;
 
   lock.lock();
-  l = listener;
+  l = slot;
   lock.unlock();
 
   if (l != NULL)
@@ -367,7 +413,10 @@ ActivityMonitor::call_listener()
         {
           // Remove listener.
           lock.lock();
-          listener = NULL;
+          if (slot == l)
+            {
+              slot = NULL;
+            }
           lock.unlock();
         }
     }
@@ -58,14 +58,16 @@ public:
   void get_parameters(int &noise, int &activity, int &idle, int &sensitivity);
 
   void set_listener(ActivityMonitorListener *l);
+  void set_wakeup_listener(ActivityMonitorListener *l);
 
-  void action_notify();
-  void mouse_notify(int x, int y, int wheel = 0);
-  void button_notify(bool is_press);
-  void keyboard_notify(bool repeat);
+  void input_events_notify(const InputEvent *events, int count);
 
 private:
+  void action_notify(const GTimeVal &now);
+  bool mouse_notify(int x, int y, int wheel, int distance, const GTimeVal &now);
+  bool button_notify(bool is_press, const GTimeVal &now);
   void call_listener();
+  void call_listener(ActivityMonitorListener *&slot);
 
 private:
   //! The actual monitoring driver.
@@ -106,6 +108,9 @@ private:
 
   //! Activity listener.
   ActivityMonitorListener *listener;
+
+  //! Listener that wakes up the core when its heartbeat is slowed down.
+  ActivityMonitorListener *wakeup_listener;
 };
 
 #endif // ACTIVITYMONITOR_HH
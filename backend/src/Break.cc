@@ -107,6 +107,14 @@ Break::init(BreakId id, IApp *app)
   timer->set_id(break_name);
   break_control = new BreakControl(break_id, app, timer);
 
+  limit_key = ConfigKey(CoreConfig::CFG_KEY_TIMER_LIMIT % break_id);
+  auto_reset_key = ConfigKey(CoreConfig::CFG_KEY_TIMER_AUTO_RESET % break_id);
+  reset_pred_key = ConfigKey(CoreConfig::CFG_KEY_TIMER_RESET_PRED % break_id);
+  snooze_key = ConfigKey(CoreConfig::CFG_KEY_TIMER_SNOOZE % break_id);
+  monitor_key = ConfigKey(CoreConfig::CFG_KEY_TIMER_MONITOR % break_id);
+  max_preludes_key = ConfigKey(CoreConfig::CFG_KEY_BREAK_MAX_PRELUDES % break_id);
+  enabled_key = ConfigKey(CoreConfig::CFG_KEY_BREAK_ENABLED % break_id);
+
   init_timer();
   init_break_control();
   init_defaults();
@@ -272,19 +280,19 @@ Break::load_timer_config()
   TRACE_ENTER("Break::load_timer_config");
   // Read break limit.
   int limit;
-  config->get_value(CoreConfig::CFG_KEY_TIMER_LIMIT % break_id, limit);
+  config->get_value(limit_key, limit);
   timer->set_limit(limit);
   timer->set_limit_enabled(limit > 0);
 
   // Read autoreset interval
   int autoreset;
-  config->get_value(CoreConfig::CFG_KEY_TIMER_AUTO_RESET % break_id, autoreset);
+  config->get_value(auto_reset_key, autoreset);
   timer->set_auto_reset(autoreset);
   timer->set_auto_reset_enabled(autoreset > 0);
 
   // Read reset predicate
   string reset_pred;
-  config->get_value(CoreConfig::CFG_KEY_TIMER_RESET_PRED % break_id, reset_pred);
+  config->get_value(reset_pred_key, reset_pred);
   if (reset_pred != "")
     {
       timer->set_auto_reset(reset_pred);
@@ -292,13 +300,13 @@ Break::load_timer_config()
 
   // Read the snooze time.
   int snooze;
-  config->get_value(CoreConfig::CFG_KEY_TIMER_SNOOZE % break_id, snooze);
+  config->get_value(snooze_key, snooze);
   timer->set_snooze_interval(snooze);
 
   // Load the monitor setting for the timer.
   string monitor_name;
 
-  bool ret = config->get_value(CoreConfig::CFG_KEY_TIMER_MONITOR % break_id, monitor_name);
+  bool ret = config->get_value(monitor_key, monitor_name);
 
   TRACE_MSG(ret << " " << monitor_name);
   if (ret && monitor_name != "")
@@ -334,12 +342,12 @@ Break::load_break_control_config()
 {
   // Maximum number of prelude windows.
   int max_preludes;
-  config->get_value(CoreConfig::CFG_KEY_BREAK_MAX_PRELUDES % break_id, max_preludes);
+  config->get_value(max_preludes_key, max_preludes);
   break_control->set_max_preludes(max_preludes);
 
   // Break enabled?
   enabled = true;
-  config->get_value(CoreConfig::CFG_KEY_BREAK_ENABLED % break_id, enabled);
+  config->get_value(enabled_key, enabled);
 }
 
 
@@ -347,12 +355,14 @@ void
 Break::override(BreakId id)
 {
   int max_preludes;
-  config->get_value(CoreConfig::CFG_KEY_BREAK_MAX_PRELUDES % break_id, max_preludes);
+  config->get_value(max_preludes_key, max_preludes);
 
   if (break_id != id)
     {
+      Break *other = Core::get_instance()->get_break(id);
+
       int override_max_preludes;
-      config->get_value(CoreConfig::CFG_KEY_BREAK_MAX_PRELUDES % id, override_max_preludes);
+      config->get_value(other->max_preludes_key, override_max_preludes);
       if (override_max_preludes != -1 && override_max_preludes < max_preludes)
         {
           max_preludes = override_max_preludes;
@@ -478,17 +488,45 @@ Break::starts_with(const string &key, string prefix, string &name)
 void
 Break::config_changed_notify(const string &key)
 {
-  TRACE_ENTER_MSG("Break::config_changed_notify", key);
-  string name;
+  config_batch_changed_notify(list<string>(1, key));
+}
+
 
-  if (starts_with(key, CoreConfig::CFG_KEY_BREAKS, name))
+//! Notification that several configuration items changed together.
+/*!
+ *  The configuration of the timer and of the break control is reloaded at
+ *  most once, however many of their keys changed.
+ */
+void
+Break::config_batch_changed_notify(const list<string> &keys)
+{
+  TRACE_ENTER_MSG("Break::config_batch_changed_notify", keys.size());
+  bool break_changed = false;
+  bool timer_changed = false;
+
+  for (list<string>::const_iterator it = keys.begin(); it != keys.end(); it++)
+    {
+      string name;
+
+      if (starts_with(*it, CoreConfig::CFG_KEY_BREAKS, name))
+        {
+          TRACE_MSG("break: " << name);
+          break_changed = true;
+        }
+      else if (starts_with(*it, CoreConfig::CFG_KEY_TIMERS, name))
+        {
+          TRACE_MSG("timer: " << name);
+          timer_changed = true;
+        }
+    }
+
+  if (break_changed)
     {
-      TRACE_MSG("break: " << name);
       load_break_control_config();
     }
-  else if (starts_with(key, CoreConfig::CFG_KEY_TIMERS, name))
+
+  if (timer_changed)
     {
-      TRACE_MSG("timer: " << name);
       load_timer_config();
     }
   TRACE_EXIT();
@@ -22,6 +22,7 @@
 
 #include "ICore.hh"
 #include "IConfiguratorListener.hh"
+#include "ConfigKey.hh"
 #include "IBreak.hh"
 #include "Timer.hh"
 
@@ -68,6 +69,17 @@ private:
   //!
   UsageMode usage_mode;
 
+  //! Configuration keys of the timer.
+  ConfigKey limit_key;
+  ConfigKey auto_reset_key;
+  ConfigKey reset_pred_key;
+  ConfigKey snooze_key;
+  ConfigKey monitor_key;
+
+  //! Configuration keys of the break.
+  ConfigKey max_preludes_key;
+  ConfigKey enabled_key;
+
 public:
   Break();
   virtual ~Break();
@@ -103,6 +115,7 @@ public:
 
 private:
   void config_changed_notify(const std::string &key);
+  void config_batch_changed_notify(const std::list<std::string> &keys);
 
 private:
   void init_defaults();
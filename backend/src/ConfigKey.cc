@@ -0,0 +1,199 @@
+// ConfigKey.cc --- Interned configuration key
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <map>
+
+#include <glib.h>
+
+#include "ConfigKey.hh"
+
+using namespace std;
+using namespace workrave;
+
+namespace
+{
+  //! Number and hash of an interned key.
+  struct KeyInfo
+  {
+    int id;
+    unsigned int hash;
+  };
+
+  //! Number and hash of each interned key.
+  typedef map<string, KeyInfo> Registry;
+
+  //! Returns the registry.
+  /*!
+   *  The registry is created on first use, so keys may be created by static
+   *  initializers in other translation units. Its keys never move, so a
+   *  ConfigKey can refer to its name.
+   */
+  Registry &
+  get_registry()
+  {
+    static Registry registry;
+    return registry;
+  }
+
+  //! Returns the key without leading and trailing '/', as the Configurator stores it.
+  string
+  normalize(const string &key)
+  {
+    string ret = key;
+    int len = ret.length();
+
+    if (len > 1 && ret[0] == '/')
+      {
+        ret = ret.substr(1, len - 1);
+        len--;
+      }
+
+    if (len > 0 && ret[len - 1] == '/')
+      {
+        ret = ret.substr(0, len - 1);
+      }
+
+    return ret;
+  }
+
+  //! Returns the empty name of an invalid key.
+  const string &
+  get_empty_name()
+  {
+    static const string empty;
+    return empty;
+  }
+}
+
+
+//! Creates an invalid key.
+ConfigKey::ConfigKey() :
+  name(&get_empty_name()),
+  id(-1),
+  hash_value(0)
+{
+}
+
+
+//! Creates a key, interning its name.
+ConfigKey::ConfigKey(const string &key)
+{
+  Registry &registry = get_registry();
+  string normalized = normalize(key);
+
+  Registry::iterator it = registry.find(normalized);
+  if (it == registry.end())
+    {
+      KeyInfo info;
+      info.id = (int) registry.size();
+      info.hash = hash(normalized);
+
+      it = registry.insert(make_pair(normalized, info)).first;
+    }
+
+  name = &it->first;
+  id = it->second.id;
+  hash_value = it->second.hash;
+}
+
+
+//! Returns the normalized name of the key.
+const string &
+ConfigKey::str() const
+{
+  return *name;
+}
+
+
+//! Returns the number of the key.
+int
+ConfigKey::get_id() const
+{
+  return id;
+}
+
+
+//! Returns the hash of the normalized name.
+unsigned int
+ConfigKey::get_hash() const
+{
+  return hash_value;
+}
+
+
+//! Is this a valid key?
+bool
+ConfigKey::is_valid() const
+{
+  return id >= 0;
+}
+
+
+//! Returns an interned key, without interning its name.
+/*!
+ *  \retval an invalid key if no key with the specified name was created.
+ */
+ConfigKey
+ConfigKey::find(const string &key)
+{
+  Registry &registry = get_registry();
+  ConfigKey ret;
+
+  Registry::const_iterator it = registry.find(normalize(key));
+  if (it != registry.end())
+    {
+      ret.name = &it->first;
+      ret.id = it->second.id;
+      ret.hash_value = it->second.hash;
+    }
+
+  return ret;
+}
+
+
+//! Returns the number of interned keys.
+int
+ConfigKey::get_count()
+{
+  return (int) get_registry().size();
+}
+
+
+//! Returns the hash of a normalized key name.
+/*!
+ *  This is the 32 bit FNV-1a hash. It is stored in configuration
+ *  snapshots, so it must not change.
+ */
+unsigned int
+ConfigKey::hash(const string &key)
+{
+  guint32 ret = 2166136261U;
+
+  for (string::size_type i = 0; i < key.length(); i++)
+    {
+      ret ^= (guint8) key[i];
+      ret *= 16777619U;
+    }
+
+  return ret;
+}
@@ -0,0 +1,446 @@
+// ConfigSnapshot.cc --- Memory mapped snapshot of configuration values
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+
+#include "debug.hh"
+
+#include "ConfigSnapshot.hh"
+
+using namespace std;
+
+//! Magic number of the snapshot file ("WRCS").
+static const guint32 SNAPSHOT_MAGIC = 0x53435257;
+
+//! Version of the snapshot format.
+static const int SNAPSHOT_VERSION = 1;
+
+
+//! Are the stamps equal?
+bool
+ConfigSnapshot::Stamp::operator==(const Stamp &other) const
+{
+  return size == other.size && mtime == other.mtime && inode == other.inode;
+}
+
+
+//! Are the stamps different?
+bool
+ConfigSnapshot::Stamp::operator!=(const Stamp &other) const
+{
+  return !operator==(other);
+}
+
+
+//! Constructor
+ConfigSnapshot::ConfigSnapshot(const string &filename) :
+  filename(filename),
+  mapped(NULL),
+  entries(NULL),
+  slot_count(0),
+  strings(NULL),
+  strings_size(0)
+{
+}
+
+
+//! Destructor
+ConfigSnapshot::~ConfigSnapshot()
+{
+  close();
+}
+
+
+//! Returns the name of the snapshot file.
+const string &
+ConfigSnapshot::get_filename() const
+{
+  return filename;
+}
+
+
+//! Returns the stamp of a file.
+/*!
+ *  \retval false if the file does not exist.
+ */
+bool
+ConfigSnapshot::get_stamp(const string &filename, Stamp &stamp)
+{
+  struct stat st;
+  bool ret = g_stat(filename.c_str(), &st) == 0;
+
+  if (ret)
+    {
+      stamp.size = st.st_size;
+      stamp.mtime = st.st_mtime;
+      stamp.inode = st.st_ino;
+    }
+
+  return ret;
+}
+
+
+//! Maps the snapshot file into memory.
+/*!
+ *  \retval false if the file does not exist, is not a valid snapshot, or
+ *  is a snapshot of another version of the configuration file.
+ */
+bool
+ConfigSnapshot::open(const Stamp &stamp)
+{
+  TRACE_ENTER_MSG("ConfigSnapshot::open", filename);
+
+  close();
+
+  GError *error = NULL;
+  mapped = g_mapped_file_new(filename.c_str(), FALSE, &error);
+  if (mapped == NULL)
+    {
+      if (error != NULL)
+        {
+          g_error_free(error);
+        }
+      TRACE_RETURN(false);
+      return false;
+    }
+
+  const gchar *contents = g_mapped_file_get_contents(mapped);
+  gsize length = g_mapped_file_get_length(mapped);
+  const Header *header = (const Header *) contents;
+
+  bool ok = (contents != NULL &&
+             length >= sizeof(Header) &&
+             header->magic == SNAPSHOT_MAGIC &&
+             header->version == SNAPSHOT_VERSION &&
+             header->entry_size == sizeof(Entry) &&
+             header->slot_count >= (guint32) MIN_SLOTS &&
+             (header->slot_count & (header->slot_count - 1)) == 0 &&
+             header->slot_count <= (length - sizeof(Header)) / sizeof(Entry) &&
+             header->strings_size <= length - sizeof(Header) - header->slot_count * sizeof(Entry));
+
+  if (ok)
+    {
+      Stamp file_stamp;
+      file_stamp.size = header->stamp_size;
+      file_stamp.mtime = header->stamp_mtime;
+      file_stamp.inode = header->stamp_inode;
+
+      ok = (file_stamp == stamp);
+    }
+
+  if (ok)
+    {
+      entries = (const Entry *) (contents + sizeof(Header));
+      slot_count = header->slot_count;
+      strings = (const gchar *) (entries + slot_count);
+      strings_size = header->strings_size;
+    }
+  else
+    {
+      TRACE_MSG("invalid or outdated snapshot");
+      close();
+    }
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Unmaps the snapshot file.
+void
+ConfigSnapshot::close()
+{
+  if (mapped != NULL)
+    {
+#if GLIB_CHECK_VERSION(2, 22, 0)
+      g_mapped_file_unref(mapped);
+#else
+      g_mapped_file_free(mapped);
+#endif
+      mapped = NULL;
+    }
+
+  entries = NULL;
+  slot_count = 0;
+  strings = NULL;
+  strings_size = 0;
+}
+
+
+//! Is the snapshot mapped?
+bool
+ConfigSnapshot::is_open() const
+{
+  return mapped != NULL;
+}
+
+
+//! Looks up a key of a type.
+/*!
+ *  \a found is set if the key had a value of the requested type when the
+ *  snapshot was written. In that case, \a value is set to the value.
+ *
+ *  \retval false if the snapshot does not contain the key and type.
+ */
+bool
+ConfigSnapshot::find(const string &key, unsigned int hash, VariantType type, bool &found, Variant &value) const
+{
+  const Entry *match = NULL;
+  bool done = (mapped == NULL);
+  guint32 slot = get_slot(hash, type, slot_count);
+
+  for (guint32 i = 0; !done && i < slot_count; i++)
+    {
+      const Entry &entry = entries[(slot + i) & (slot_count - 1)];
+
+      if (!entry.used)
+        {
+          done = true;
+        }
+      else if (entry.hash == hash && entry.type == type && entry.key_length == key.length())
+        {
+          const gchar *entry_name = get_string(entry.key_offset, entry.key_length);
+          if (entry_name != NULL && memcmp(entry_name, key.data(), key.length()) == 0)
+            {
+              match = &entry;
+              done = true;
+            }
+        }
+    }
+
+  bool ret = (match != NULL);
+  bool match_found = (ret && match->found != 0);
+
+  if (match_found)
+    {
+      value.type = (VariantType) match->value_type;
+      switch (value.type)
+        {
+        case VARIANT_TYPE_INT:
+          value.int_value = (int) match->int_value;
+          break;
+
+        case VARIANT_TYPE_LONG:
+          value.long_value = (long) match->int_value;
+          break;
+
+        case VARIANT_TYPE_BOOL:
+          value.bool_value = match->int_value != 0;
+          break;
+
+        case VARIANT_TYPE_DOUBLE:
+          value.double_value = match->double_value;
+          break;
+
+        case VARIANT_TYPE_NONE:
+        case VARIANT_TYPE_STRING:
+          {
+            // Some backends return the string of an untyped value.
+            const gchar *s = get_string(match->string_offset, match->string_length);
+            if (s != NULL)
+              {
+                value.string_value.assign(s, match->string_length);
+              }
+            else
+              {
+                ret = false;
+              }
+          }
+          break;
+
+        default:
+          ret = false;
+          break;
+        }
+    }
+
+  if (ret)
+    {
+      found = match_found;
+    }
+
+  return ret;
+}
+
+
+//! Replaces the snapshot by the specified values.
+/*!
+ *  The snapshot is written into a temporary file that replaces the snapshot
+ *  atomically. The snapshot is closed.
+ */
+bool
+ConfigSnapshot::write(const vector<Value> &values, const Stamp &stamp)
+{
+  TRACE_ENTER_MSG("ConfigSnapshot::write", values.size());
+
+  guint32 new_slot_count = MIN_SLOTS;
+  while (new_slot_count < 2 * values.size())
+    {
+      new_slot_count *= 2;
+    }
+
+  vector<Entry> table(new_slot_count);
+  memset(&table[0], 0, new_slot_count * sizeof(Entry));
+
+  string new_strings;
+
+  for (vector<Value>::const_iterator it = values.begin(); it != values.end(); it++)
+    {
+      const Value &v = *it;
+      guint32 slot = get_slot(v.hash, v.type, new_slot_count);
+
+      while (table[slot].used)
+        {
+          slot = (slot + 1) & (new_slot_count - 1);
+        }
+
+      Entry &entry = table[slot];
+      entry.hash = v.hash;
+      entry.used = 1;
+      entry.type = v.type;
+      entry.found = v.found ? 1 : 0;
+      entry.key_length = v.key.length();
+      entry.key_offset = add_string(new_strings, v.key);
+
+      if (v.found)
+        {
+          entry.value_type = v.value.type;
+          switch (v.value.type)
+            {
+            case VARIANT_TYPE_INT:
+              entry.int_value = v.value.int_value;
+              break;
+
+            case VARIANT_TYPE_LONG:
+              entry.int_value = v.value.long_value;
+              break;
+
+            case VARIANT_TYPE_BOOL:
+              entry.int_value = v.value.bool_value ? 1 : 0;
+              break;
+
+            case VARIANT_TYPE_DOUBLE:
+              entry.double_value = v.value.double_value;
+              break;
+
+            case VARIANT_TYPE_NONE:
+            case VARIANT_TYPE_STRING:
+              entry.string_length = v.value.string_value.length();
+              entry.string_offset = add_string(new_strings, v.value.string_value);
+              break;
+
+            default:
+              break;
+            }
+        }
+    }
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.entry_size = sizeof(Entry);
+  header.slot_count = new_slot_count;
+  header.strings_size = new_strings.size();
+  header.stamp_size = stamp.size;
+  header.stamp_mtime = stamp.mtime;
+  header.stamp_inode = stamp.inode;
+
+  // The file cannot be replaced while it is mapped.
+  close();
+
+  string tmp_filename = filename + ".tmp";
+  FILE *file = g_fopen(tmp_filename.c_str(), "wb");
+
+  bool ok = file != NULL;
+  if (ok)
+    {
+      ok = (fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(&table[0], sizeof(Entry), new_slot_count, file) == new_slot_count &&
+            (new_strings.empty() || fwrite(new_strings.data(), new_strings.size(), 1, file) == 1));
+      ok = (fclose(file) == 0) && ok;
+    }
+
+  if (ok)
+    {
+      ok = g_rename(tmp_filename.c_str(), filename.c_str()) == 0;
+    }
+  if (!ok)
+    {
+      TRACE_MSG("write failed");
+      g_unlink(tmp_filename.c_str());
+    }
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Removes the snapshot file.
+bool
+ConfigSnapshot::remove()
+{
+  close();
+  return g_unlink(filename.c_str()) == 0 || !g_file_test(filename.c_str(), G_FILE_TEST_EXISTS);
+}
+
+
+//! Returns a string in the mapping.
+/*!
+ *  \retval NULL if the string is not within the mapping.
+ */
+const gchar *
+ConfigSnapshot::get_string(guint32 offset, guint32 length) const
+{
+  const gchar *ret = NULL;
+
+  if (offset <= strings_size && length <= strings_size - offset)
+    {
+      ret = strings + offset;
+    }
+
+  return ret;
+}
+
+
+//! Returns the first slot of a key of a type.
+guint32
+ConfigSnapshot::get_slot(guint32 hash, VariantType type, guint32 count)
+{
+  return (hash ^ ((guint32) type * 0x9e3779b9U)) & (count - 1);
+}
+
+
+//! Appends a string to the strings and returns its offset.
+guint32
+ConfigSnapshot::add_string(string &buffer, const string &s)
+{
+  guint32 ret = buffer.size();
+  buffer += s;
+  return ret;
+}
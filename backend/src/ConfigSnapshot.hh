@@ -0,0 +1,162 @@
+// ConfigSnapshot.hh --- Memory mapped snapshot of configuration values
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef CONFIGSNAPSHOT_HH
+#define CONFIGSNAPSHOT_HH
+
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "Variant.hh"
+
+//! Memory mapped snapshot of configuration values.
+/*!
+ *  The snapshot contains the values that were looked up in a configuration
+ *  file, including the keys that did not have a value, so the file does
+ *  not need to be parsed when the same values are looked up again.
+ *
+ *  The snapshot is a small header followed by a hash table of fixed size
+ *  entries and the strings. The file is mapped into memory as a whole and
+ *  a value is found by the precomputed hash of its key, so opening the
+ *  snapshot and looking up a value do not depend on the number of values.
+ *
+ *  The header contains the stamp of the configuration file from which the
+ *  values were read. A snapshot of another version of the configuration
+ *  file is not used. The snapshot is stored in native byte order.
+ */
+class ConfigSnapshot
+{
+public:
+  //! Identifies a version of a configuration file.
+  struct Stamp
+  {
+    Stamp() : size(0), mtime(0), inode(0) {}
+
+    bool operator==(const Stamp &other) const;
+    bool operator!=(const Stamp &other) const;
+
+    //! Size of the file.
+    guint64 size;
+
+    //! Modification time of the file.
+    gint64 mtime;
+
+    //! Inode of the file, which changes when the file is replaced.
+    guint64 inode;
+  };
+
+  //! Result of looking up a key of a type.
+  struct Value
+  {
+    //! The normalized key.
+    std::string key;
+
+    //! Hash of the key, see ConfigKey::hash().
+    unsigned int hash;
+
+    //! Requested type.
+    VariantType type;
+
+    //! Does the key have a value of the requested type?
+    bool found;
+
+    //! The value.
+    Variant value;
+  };
+
+  ConfigSnapshot(const std::string &filename);
+  virtual ~ConfigSnapshot();
+
+  bool open(const Stamp &stamp);
+  void close();
+  bool is_open() const;
+  bool write(const std::vector<Value> &values, const Stamp &stamp);
+  bool remove();
+
+  bool find(const std::string &key, unsigned int hash, VariantType type, bool &found, Variant &value) const;
+
+  const std::string &get_filename() const;
+
+  static bool get_stamp(const std::string &filename, Stamp &stamp);
+
+private:
+  struct Header
+  {
+    guint32 magic;
+    guint16 version;
+    guint16 entry_size;
+    guint32 slot_count;
+    guint32 strings_size;
+    guint64 stamp_size;
+    gint64 stamp_mtime;
+    guint64 stamp_inode;
+  };
+
+  struct Entry
+  {
+    guint32 hash;
+    guint8 used;
+    guint8 type;
+    guint8 found;
+    guint8 value_type;
+    guint32 key_offset;
+    guint32 key_length;
+    guint32 string_offset;
+    guint32 string_length;
+    gint64 int_value;
+    double double_value;
+  };
+
+  enum
+    {
+      //! Minimum number of slots in the hash table.
+      MIN_SLOTS = 16
+    };
+
+  ConfigSnapshot(const ConfigSnapshot &);
+  ConfigSnapshot &operator=(const ConfigSnapshot &);
+
+  const gchar *get_string(guint32 offset, guint32 length) const;
+
+  static guint32 get_slot(guint32 hash, VariantType type, guint32 count);
+  static guint32 add_string(std::string &buffer, const std::string &s);
+
+private:
+  //! Name of the snapshot file.
+  std::string filename;
+
+  //! Mapping of the snapshot file, or NULL.
+  GMappedFile *mapped;
+
+  //! First slot of the hash table in the mapping.
+  const Entry *entries;
+
+  //! Number of slots in the hash table.
+  guint32 slot_count;
+
+  //! Strings in the mapping.
+  const gchar *strings;
+
+  //! Size of the strings.
+  guint32 strings_size;
+};
+
+#endif // CONFIGSNAPSHOT_HH
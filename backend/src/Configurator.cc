@@ -35,16 +35,35 @@
 #include "ICore.hh"
 #include "CoreFactory.hh"
 #include "IConfiguratorListener.hh"
+#include "PersistenceWorker.hh"
 
 using namespace std;
 using namespace workrave;
 
+//! Delay before the snapshot is written, so that it has the values of the first lookups.
+static const int SNAPSHOT_DELAY = 10;
+
+//! Number of values in the snapshot above which only interned keys are added.
+static const size_t MAX_SNAPSHOT_VALUES = 1024;
+
+//! Time after which an unfinished transaction is aborted.
+static const int TRANSACTION_TIMEOUT = 60;
+
 
 // Constructs a new configurator.
 Configurator::Configurator(IConfigBackend *backend)
 {
   this->auto_save_time = 0;
+  this->notify_depth = 0;
+  this->transaction_depth = 0;
+  this->transaction_time = 0;
   this->backend = backend;
+  this->backend_loaded = true;
+  this->snapshot = NULL;
+  this->snapshot_dirty = false;
+  this->snapshot_time = 0;
+  this->file_stamp_valid = false;
+  this->save_pending = false;
   if (dynamic_cast<IConfigBackendMonitoring *>(backend) != NULL)
     {
       dynamic_cast<IConfigBackendMonitoring *>(backend)->set_listener(this);
@@ -55,14 +74,57 @@ Configurator::Configurator(IConfigBackend *backend)
 // Destructs the configurator.
 Configurator::~Configurator()
 {
+  delete snapshot;
   delete backend;
 }
 
 
+//! Loads the configuration file.
+/*!
+ *  If the snapshot of the file is up to date, the file is not loaded until
+ *  a value is needed that is not in the snapshot, or a value is changed.
+ */
 bool
 Configurator::load(std::string filename)
 {
-  return backend->load(filename);
+  TRACE_ENTER_MSG("Configurator::load", filename);
+  bool ret = true;
+
+  invalidate_values();
+
+  delete snapshot;
+  snapshot = NULL;
+  snapshot_dirty = false;
+  snapshot_time = 0;
+  save_pending = false;
+
+  this->filename = filename;
+  backend_loaded = false;
+
+  if (dynamic_cast<IConfigBackendMonitoring *>(backend) == NULL)
+    {
+      snapshot = new ConfigSnapshot(filename + ".snapshot");
+
+      // The stamp is taken before the file is read. If the file changes
+      // meanwhile, the snapshot gets an old stamp and is not used.
+      file_stamp_valid = ConfigSnapshot::get_stamp(filename, file_stamp);
+      if (!file_stamp_valid || !snapshot->open(file_stamp))
+        {
+          backend_loaded = true;
+        }
+    }
+  else
+    {
+      backend_loaded = true;
+    }
+
+  if (backend_loaded)
+    {
+      ret = backend->load(filename);
+    }
+
+  TRACE_RETURN(ret);
+  return ret;
 }
 
 
@@ -70,7 +132,13 @@ bool
 Configurator::save(std::string filename)
 {
   TRACE_ENTER_MSG("Configurator::save", filename);
+  load_backend();
+  discard_snapshot();
   bool ret = backend->save(filename);
+  if (filename == this->filename)
+    {
+      save_pending = true;
+    }
   TRACE_RETURN(ret);
   return ret;
 }
@@ -80,18 +148,134 @@ bool
 Configurator::save()
 {
   TRACE_ENTER("Configurator::save");
-  bool ret = backend->save();
+  bool ret = true;
+
+  // Nothing was changed if the configuration file was never loaded.
+  if (backend_loaded)
+    {
+      discard_snapshot();
+      ret = backend->save();
+      save_pending = true;
+    }
+
   TRACE_RETURN(ret);
   return ret;
 }
 
 
+//! Starts a transaction.
+/*!
+ *  Values set during the transaction are kept in memory, and are visible
+ *  to get_value, until the transaction is committed. Transactions may be
+ *  nested; only the outermost commit applies the values.
+ *
+ *  A transaction that is not committed within TRANSACTION_TIMEOUT seconds,
+ *  e.g. because the D-Bus client that started it quit, is aborted.
+ */
+void
+Configurator::begin_transaction()
+{
+  TRACE_ENTER_MSG("Configurator::begin_transaction", transaction_depth);
+
+  if (transaction_depth++ == 0)
+    {
+      ICore *core = CoreFactory::get_core();
+      transaction_time = core->get_time() + TRANSACTION_TIMEOUT;
+
+      hold_notifications();
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Commits a transaction.
+/*!
+ *  The values set during the transaction are written to the backend,
+ *  listeners are notified once with all changed keys and the
+ *  configuration is saved once.
+ *
+ *  \retval false if a value could not be written.
+ */
+bool
+Configurator::commit_transaction()
+{
+  TRACE_ENTER_MSG("Configurator::commit_transaction", transaction_depth);
+  bool ret = true;
+
+  if (transaction_depth > 0 && --transaction_depth == 0)
+    {
+      transaction_time = 0;
+
+      TransactionList values;
+      values.swap(transaction);
+
+      for (TransactionListIter it = values.begin(); it != values.end(); it++)
+        {
+          TransactionValue &t = it->second;
+          if (!set_value(it->first, t.value, t.flags))
+            {
+              ret = false;
+            }
+        }
+
+      if (auto_save_time != 0)
+        {
+          save();
+          auto_save_time = 0;
+        }
+
+      release_notifications();
+    }
+
+  TRACE_RETURN(ret);
+  return ret;
+}
+
+
+//! Aborts the transaction, including all nested transactions.
+/*!
+ *  The values set during the transaction are discarded.
+ */
+void
+Configurator::abort_transaction()
+{
+  TRACE_ENTER_MSG("Configurator::abort_transaction", transaction_depth);
+
+  if (transaction_depth > 0)
+    {
+      transaction_depth = 0;
+      transaction_time = 0;
+
+      TransactionList values;
+      values.swap(transaction);
+
+      for (TransactionListIter it = values.begin(); it != values.end(); it++)
+        {
+          invalidate_value(it->first);
+        }
+
+      release_notifications();
+    }
+
+  TRACE_EXIT();
+}
+
+
 void
 Configurator::heartbeat()
 {
   ICore *core = CoreFactory::get_core();
   time_t now = core->get_time();
 
+  if (transaction_depth > 0 && now >= transaction_time)
+    {
+      // The client that started the transaction is gone.
+      abort_transaction();
+    }
+
+  hold_notifications();
+
   DelayedListIter it = delayed_config.begin();
   while (it != delayed_config.end())
     {
@@ -101,10 +285,13 @@ Configurator::heartbeat()
 
       if (now >= delayed.until)
         {
+          load_backend();
+
           Variant old_value;
           bool old_value_valid = backend->get_value(delayed.key, delayed.value.type, old_value);
 
           bool b = backend->set_value(delayed.key, delayed.value);
+          invalidate_value(delayed.key);
 
           if (b && dynamic_cast<IConfigBackendMonitoring *>(backend) == NULL)
             {
@@ -126,11 +313,60 @@ Configurator::heartbeat()
       it = next;
     }
 
+  release_notifications();
+
   if (auto_save_time != 0 && now >= auto_save_time)
     {
       save();
       auto_save_time = 0;
     }
+
+  if (snapshot_dirty && snapshot_time == 0)
+    {
+      snapshot_time = now + SNAPSHOT_DELAY;
+    }
+
+  if (snapshot_time != 0 && now >= snapshot_time)
+    {
+      // Only a snapshot of the saved configuration is useful.
+      if (auto_save_time == 0 && delayed_config.empty() && transaction_depth == 0)
+        {
+          write_snapshot();
+        }
+      snapshot_time = 0;
+    }
+}
+
+
+//! Returns the earliest time at which heartbeat() has work to do.
+/*!
+ *  \retval 0 if no delayed setting or save is pending.
+ */
+time_t
+Configurator::get_next_heartbeat_time() const
+{
+  time_t ret = auto_save_time;
+
+  if (transaction_depth > 0 && (ret == 0 || transaction_time < ret))
+    {
+      ret = transaction_time;
+    }
+
+  if (snapshot_time != 0 && (ret == 0 || snapshot_time < ret))
+    {
+      ret = snapshot_time;
+    }
+
+  for (DelayedListCIter it = delayed_config.begin(); it != delayed_config.end(); it++)
+    {
+      const DelayedConfig &delayed = it->second;
+      if (ret == 0 || delayed.until < ret)
+        {
+          ret = delayed.until;
+        }
+    }
+
+  return ret;
 }
 
 
@@ -156,7 +392,25 @@ Configurator::set_delay(const std::string &key, int delay)
 bool
 Configurator::remove_key(const std::string &key) const
 {
-  return backend->remove_key(key);
+  bool ret = false;
+
+  // Looking up the key first lets the snapshot tell that it does not exist.
+  Variant value;
+  if (snapshot == NULL || get_value(key, VARIANT_TYPE_NONE, value))
+    {
+      load_backend();
+
+      ret = backend->remove_key(key);
+      invalidate_value(key);
+
+      if (ret && auto_save_time == 0 && dynamic_cast<IConfigBackendMonitoring *>(backend) == NULL)
+        {
+          ICore *core = CoreFactory::get_core();
+          auto_save_time = core->get_time() + 30;
+        }
+    }
+
+  return ret;
 }
 
 
@@ -209,6 +463,16 @@ Configurator::set_value(const std::string &key, Variant &value, ConfigFlags flag
       strip_leading_slash(newkey);
     }
 
+  if (!skip && transaction_depth > 0)
+    {
+      TransactionValue &t = transaction[newkey];
+      t.value = value;
+      t.flags = flags;
+      invalidate_value(newkey);
+
+      skip = true;
+    }
+
   if (!skip && flags == CONFIG_FLAG_NONE)
     {
       bool b = find_setting(newkey, setting);
@@ -218,10 +482,11 @@ Configurator::set_value(const std::string &key, Variant &value, ConfigFlags flag
             {
               ICore *core = CoreFactory::get_core();
 
-              DelayedConfig &d = delayed_config[key];
-              d.key = (string)key;
+              DelayedConfig &d = delayed_config[newkey];
+              d.key = newkey;
               d.value = value;
               d.until = core->get_time() + setting.delay;
+              invalidate_value(newkey);
 
               skip = true;
             }
@@ -230,10 +495,13 @@ Configurator::set_value(const std::string &key, Variant &value, ConfigFlags flag
 
   if (!skip)
     {
+      load_backend();
+
       Variant old_value;
       bool old_value_valid = backend->get_value(newkey, value.type, old_value);
 
       ret = backend->set_value(newkey, value);
+      invalidate_value(newkey);
 
       if (ret && dynamic_cast<IConfigBackendMonitoring *>(backend) == NULL)
         {
@@ -255,29 +523,117 @@ Configurator::set_value(const std::string &key, Variant &value, ConfigFlags flag
 }
 
 
+//! Returns the value of a key, using the cache if the key is interned.
+/*!
+ *  The key is not interned here, because keys are never released and
+ *  the key may not be used at a fixed call site, e.g. if it is requested
+ *  over D-Bus.
+ */
 bool
 Configurator::get_value(const std::string &key, VariantType type, Variant &out) const
 {
   bool ret = false;
-  Setting setting;
 
-  TRACE_ENTER_MSG("Configurator::get_value", key);
+  ConfigKey config_key = ConfigKey::find(key);
+  if (config_key.is_valid())
+    {
+      const Variant *value = find_value(config_key, type);
+      if (value != NULL)
+        {
+          out = *value;
+          ret = true;
+        }
+    }
+  else
+    {
+      string name = key;
+      strip_leading_slash(name);
+      strip_trailing_slash(name);
+
+      ret = lookup_value(name, ConfigKey::hash(name), type, out);
+    }
+
+  return ret;
+}
+
+
+//! Returns the cached value of a key.
+/*!
+ *  The value is looked up if the cache has no valid entry for the key and
+ *  type. The returned value remains valid until the next lookup or change.
+ *
+ *  \retval NULL if the key has no value of the requested type.
+ */
+const Variant *
+Configurator::find_value(const ConfigKey &key, VariantType type) const
+{
+  const Variant *ret = NULL;
+  int id = key.get_id();
+
+  if (id >= 0)
+    {
+      if (id >= (int) cache.size())
+        {
+          cache.resize(ConfigKey::get_count());
+        }
+
+      CachedValue &cached = cache[id];
+      if (!cached.valid || cached.type != type)
+        {
+          cached.found = lookup_value(key.str(), key.get_hash(), type, cached.value);
+          cached.type = type;
+          cached.valid = true;
+        }
+
+      if (cached.found)
+        {
+          ret = &cached.value;
+        }
+    }
+
+  return ret;
+}
+
+
+//! Returns the value of a normalized key from the delayed settings, the snapshot or the backend.
+bool
+Configurator::lookup_value(const std::string &key, unsigned int hash, VariantType type, Variant &out) const
+{
+  bool ret = false;
+  bool known = false;
 
-  string newkey = key;
-  strip_trailing_slash(newkey);
-  strip_leading_slash(newkey);
+  TRACE_ENTER_MSG("Configurator::lookup_value", key);
 
-  DelayedListCIter it = delayed_config.find(newkey);
-  if (it != delayed_config.end())
+  TransactionListCIter t = transaction.find(key);
+  if (t != transaction.end())
+    {
+      out = t->second.value;
+      ret = true;
+    }
+
+  DelayedListCIter it = delayed_config.find(key);
+  if (!ret && it != delayed_config.end())
     {
       const DelayedConfig &delayed = it->second;
       out = delayed.value;
       ret = true;
     }
 
-  if (!ret)
+  if (!ret && !backend_loaded)
+    {
+      known = snapshot->find(key, hash, type, ret, out);
+    }
+
+  if (!ret && !known)
     {
-      ret = backend->get_value(newkey, type, out);
+      load_backend();
+      ret = backend->get_value(key, type, out);
+      known = true;
+
+      if (snapshot != NULL)
+        {
+          snapshot_dirty = true;
+        }
     }
 
   if (ret && type != VARIANT_TYPE_NONE && out.type != type)
@@ -286,6 +642,11 @@ Configurator::get_value(const std::string &key, VariantType type, Variant &out)
       out.type = VARIANT_TYPE_NONE;
     }
 
+  if (known && snapshot != NULL)
+    {
+      add_snapshot_value(key, hash, type, ret, out);
+    }
+
   TRACE_EXIT();
   return ret;
 }
@@ -352,6 +713,62 @@ Configurator::get_value(const std::string &key, double &out) const
 }
 
 
+bool
+Configurator::get_value(const ConfigKey &key, std::string &out) const
+{
+  const Variant *value = find_value(key, VARIANT_TYPE_STRING);
+
+  if (value != NULL)
+    {
+      out = value->string_value;
+    }
+
+  return value != NULL;
+}
+
+
+bool
+Configurator::get_value(const ConfigKey &key, bool &out) const
+{
+  const Variant *value = find_value(key, VARIANT_TYPE_BOOL);
+
+  if (value != NULL)
+    {
+      out = value->bool_value;
+    }
+
+  return value != NULL;
+}
+
+
+bool
+Configurator::get_value(const ConfigKey &key, int &out) const
+{
+  const Variant *value = find_value(key, VARIANT_TYPE_INT);
+
+  if (value != NULL)
+    {
+      out = value->int_value;
+    }
+
+  return value != NULL;
+}
+
+
+bool
+Configurator::get_value(const ConfigKey &key, double &out) const
+{
+  const Variant *value = find_value(key, VARIANT_TYPE_DOUBLE);
+
+  if (value != NULL)
+    {
+      out = value->double_value;
+    }
+
+  return value != NULL;
+}
+
+
 bool
 Configurator::set_value(const std::string &key, const std::string &v, ConfigFlags flags)
 {
@@ -469,6 +886,52 @@ Configurator::get_value_with_default(const string &key, double &out,
 }
 
 
+void
+Configurator::get_value_with_default(const ConfigKey &key, int &out, const int def) const
+{
+  bool b = get_value(key, out);
+  if (! b)
+    {
+      out = def;
+    }
+}
+
+
+void
+Configurator::get_value_with_default(const ConfigKey &key, bool &out, const bool def) const
+{
+  bool b = get_value(key, out);
+  if (! b)
+    {
+      out = def;
+    }
+}
+
+
+void
+Configurator::get_value_with_default(const ConfigKey &key, string &out,
+                                     const string def) const
+{
+  bool b = get_value(key, out);
+  if (! b)
+    {
+      out = def;
+    }
+}
+
+
+void
+Configurator::get_value_with_default(const ConfigKey &key, double &out,
+                                     const double def) const
+{
+  bool b = get_value(key, out);
+  if (! b)
+    {
+      out = def;
+    }
+}
+
+
 bool
 Configurator::get_typed_value(const std::string &key, std::string &t) const
 {
@@ -588,23 +1051,7 @@ Configurator::add_listener(const std::string &key_prefix, IConfiguratorListener
 
   if (ret)
     {
-      ListenerIter i = listeners.begin();
-      while (ret && i != listeners.end())
-        {
-          if (key == i->first && listener == i->second)
-            {
-              // Already added. Skip
-              ret = false;
-            }
-
-          i++;
-        }
-    }
-
-  if (ret)
-    {
-      // not found -> add
-      listeners.push_back(make_pair(key, listener));
+      ret = listeners.add(key, listener);
     }
 
   return ret;
@@ -614,74 +1061,31 @@ Configurator::add_listener(const std::string &key_prefix, IConfiguratorListener
 bool
 Configurator::remove_listener(IConfiguratorListener *listener)
 {
-  bool ret = false;
-
-  ListenerIter i = listeners.begin();
-  while (i != listeners.end())
-    {
-      if (listener == i->second)
-        {
-          // Found. Remove
-          i = listeners.erase(i);
-          ret = true;
-        }
-      else
-        {
-          i++;
-        }
-    }
-
-  return ret;
+  return listeners.remove(listener);
 }
 
 
 bool
 Configurator::remove_listener(const std::string &key_prefix, IConfiguratorListener *listener)
 {
-  bool ret = false;
+  string key = key_prefix;
+
+  strip_leading_slash(key);
+  strip_trailing_slash(key);
 
   if (dynamic_cast<IConfigBackendMonitoring *>(backend) != NULL)
     {
       dynamic_cast<IConfigBackendMonitoring *>(backend)->remove_listener(key_prefix);
     }
 
-  ListenerIter i = listeners.begin();
-  while (i != listeners.end())
-    {
-      if (i->first == key_prefix && i->second == listener)
-        {
-          // Found. Remove
-          i = listeners.erase(i);
-          ret = true;
-        }
-      else
-        {
-          i++;
-        }
-    }
-
-  return ret;
+  return listeners.remove(key, listener);
 }
 
 
 bool
 Configurator::find_listener(IConfiguratorListener *listener, std::string &key) const
 {
-  bool ret = false;
-
-  ListenerCIter i = listeners.begin();
-  while (i != listeners.end())
-    {
-      if (listener == i->second)
-        {
-          key = i->first;
-          ret = true;
-          break;
-        }
-      i++;
-    }
-
-  return ret;
+  return listeners.find_prefix(listener, key);
 }
 
 //! Fire a configuration changed event.
@@ -694,20 +1098,78 @@ Configurator::fire_configurator_event(const string &key)
   strip_leading_slash(k);
   strip_trailing_slash(k);
 
-  ListenerIter i = listeners.begin();
-  while (i != listeners.end())
+  hold_notifications();
+
+  if (pending_key_set.insert(k).second)
     {
-      string prefix = i->first;
+      pending_keys.push_back(k);
+    }
 
-      if (k.substr(0, prefix.length()) == prefix)
+  release_notifications();
+
+  TRACE_EXIT();
+}
+
+
+//! Holds configuration changed events until release_notifications().
+void
+Configurator::hold_notifications()
+{
+  notify_depth++;
+}
+
+
+//! Sends the held configuration changed events.
+/*!
+ *  Each listener is notified once, with all changed keys it listens to.
+ */
+void
+Configurator::release_notifications()
+{
+  TRACE_ENTER("Configurator::release_notifications");
+
+  notify_depth--;
+
+  if (notify_depth == 0 && !pending_keys.empty())
+    {
+      list<string> keys;
+      keys.swap(pending_keys);
+      pending_key_set.clear();
+
+      typedef map<IConfiguratorListener *, list<string> > ListenerKeys;
+      ListenerKeys listener_keys;
+      ListenerTrie::Listeners order;
+
+      for (list<string>::iterator it = keys.begin(); it != keys.end(); it++)
         {
-          IConfiguratorListener *l = i->second;
-          if (l != NULL)
+          ListenerTrie::Listeners matches;
+          listeners.find_listeners(*it, matches);
+
+          for (ListenerTrie::Listeners::iterator l = matches.begin(); l != matches.end(); l++)
             {
-              l->config_changed_notify(k);
+              list<string> &listener_key_list = listener_keys[*l];
+              if (listener_key_list.empty())
+                {
+                  order.push_back(*l);
+                }
+
+              // A listener may listen to several prefixes of the same key.
+              if (listener_key_list.empty() || listener_key_list.back() != *it)
+                {
+                  listener_key_list.push_back(*it);
+                }
+            }
+        }
+
+      for (ListenerTrie::Listeners::iterator l = order.begin(); l != order.end(); l++)
+        {
+          // An earlier listener may have removed this one.
+          if (*l != NULL && listeners.contains(*l))
+            {
+              TRACE_MSG("notify " << listener_keys[*l].size() << " keys");
+              (*l)->config_batch_changed_notify(listener_keys[*l]);
             }
         }
-      i++;
     }
 
   TRACE_EXIT();
@@ -774,9 +1236,166 @@ Configurator::find_setting(const string &key, Setting &setting) const
   return ret;
 }
 
+//! Forgets the cached value of a key.
+void
+Configurator::invalidate_value(const std::string &key) const
+{
+  string name = key;
+  strip_leading_slash(name);
+  strip_trailing_slash(name);
+
+  int id = ConfigKey::find(name).get_id();
+  if (id >= 0 && id < (int) cache.size())
+    {
+      cache[id].valid = false;
+    }
+
+  SnapshotValues::iterator it = snapshot_values.lower_bound(make_pair(name, 0));
+  while (it != snapshot_values.end() && it->first.first == name)
+    {
+      snapshot_values.erase(it++);
+    }
+}
+
+
+//! Forgets all cached values.
+void
+Configurator::invalidate_values() const
+{
+  for (ValueCache::iterator it = cache.begin(); it != cache.end(); it++)
+    {
+      it->valid = false;
+    }
+
+  snapshot_values.clear();
+}
+
+
+//! Loads the configuration file, if that was deferred because of the snapshot.
+void
+Configurator::load_backend() const
+{
+  if (!backend_loaded)
+    {
+      TRACE_ENTER_MSG("Configurator::load_backend", filename);
+
+      backend_loaded = true;
+      snapshot->close();
+      file_stamp_valid = ConfigSnapshot::get_stamp(filename, file_stamp);
+      backend->load(filename);
+
+      TRACE_EXIT();
+    }
+}
+
+
+//! Remembers the value of a key in the configuration file, for the next snapshot.
+/*!
+ *  Keys that are not interned are only looked up by name, e.g. by a D-Bus
+ *  client, and can be anything. They are only remembered while the table
+ *  is small.
+ */
+void
+Configurator::add_snapshot_value(const std::string &key, unsigned int hash, VariantType type, bool found,
+                                 const Variant &value) const
+{
+  SnapshotValues::key_type index = make_pair(key, (int) type);
+
+  if (snapshot_values.size() < MAX_SNAPSHOT_VALUES ||
+      snapshot_values.find(index) != snapshot_values.end() ||
+      ConfigKey::find(key).is_valid())
+    {
+      ConfigSnapshot::Value &v = snapshot_values[index];
+      v.key = key;
+      v.hash = hash;
+      v.type = type;
+      v.found = found;
+      v.value = value;
+    }
+}
+
+
+//! Removes the snapshot, before the configuration file is changed.
+/*!
+ *  A snapshot of the new configuration file is written later, so that
+ *  the file has been written by then.
+ */
+void
+Configurator::discard_snapshot()
+{
+  if (snapshot != NULL)
+    {
+      snapshot->remove();
+      snapshot_dirty = true;
+      snapshot_time = 0;
+    }
+}
+
+
+//! Writes a snapshot of the values that were looked up.
+/*!
+ *  The snapshot is stamped with the configuration file that the values
+ *  came from. After a save, that is the file the persistence worker wrote,
+ *  so the snapshot waits until the worker has written it.
+ */
+void
+Configurator::write_snapshot()
+{
+  TRACE_ENTER("Configurator::write_snapshot");
+
+  if (save_pending)
+    {
+      PersistenceWorker::Result result;
+      if (!PersistenceWorker::get_instance()->get_result(filename, result))
+        {
+          // Not saved by the worker, so the new file is unknown.
+          save_pending = false;
+          file_stamp_valid = false;
+        }
+      else if (result.written == result.queued)
+        {
+          save_pending = false;
+          file_stamp_valid = result.ok;
+          file_stamp.size = result.size;
+          file_stamp.mtime = result.mtime;
+          file_stamp.inode = result.inode;
+        }
+    }
+
+  if (save_pending)
+    {
+      // The snapshot stays dirty, so it is tried again after the delay.
+      TRACE_MSG("Save pending");
+    }
+  else
+    {
+      if (snapshot != NULL && file_stamp_valid)
+        {
+          vector<ConfigSnapshot::Value> values;
+          values.reserve(snapshot_values.size());
+
+          for (SnapshotValues::const_iterator it = snapshot_values.begin(); it != snapshot_values.end(); it++)
+            {
+              values.push_back(it->second);
+            }
+
+          TRACE_MSG(values.size() << " values");
+          snapshot->write(values, file_stamp);
+        }
+
+      snapshot_dirty = false;
+    }
+
+  TRACE_EXIT();
+}
+
+
 void
 Configurator::config_changed_notify(const std::string &key)
 {
+  // The backend may report a key in a different form than it is read
+  // (e.g. GSettings replaces '_' by '-'), so forget all values.
+  invalidate_values();
   fire_configurator_event(key);
 }
 
@@ -25,11 +25,16 @@
 #include <string>
 #include <list>
 #include <map>
+#include <set>
+#include <vector>
 
 #include "Mutex.hh"
+#include "ConfigKey.hh"
+#include "ConfigSnapshot.hh"
 #include "IConfigurator.hh"
 #include "IConfiguratorListener.hh"
 #include "IConfigBackend.hh"
+#include "ListenerTrie.hh"
 
 using namespace workrave;
 using namespace std;
@@ -49,6 +54,7 @@ public:
   virtual ~Configurator();
 
   void heartbeat();
+  time_t get_next_heartbeat_time() const;
 
   // IConfigurator
   virtual void set_delay(const std::string &name, int delay);
@@ -57,6 +63,10 @@ public:
   virtual bool save(std::string filename);
   virtual bool save();
 
+  virtual void begin_transaction();
+  virtual bool commit_transaction();
+  virtual void abort_transaction();
+
   virtual bool remove_key(const std::string &key) const;
   virtual bool rename_key(const std::string &key, const std::string &new_key);
 
@@ -70,6 +80,16 @@ public:
   virtual void get_value_with_default(const std::string & key, int &out, const int def) const;
   virtual void get_value_with_default(const std::string & key, double &out, const double def) const;
 
+  virtual bool get_value(const ConfigKey &key, std::string &out) const;
+  virtual bool get_value(const ConfigKey &key, bool &out) const;
+  virtual bool get_value(const ConfigKey &key, int &out) const;
+  virtual bool get_value(const ConfigKey &key, double &out) const;
+
+  virtual void get_value_with_default(const ConfigKey &key, std::string &out, string s) const;
+  virtual void get_value_with_default(const ConfigKey &key, bool &out, const bool def) const;
+  virtual void get_value_with_default(const ConfigKey &key, int &out, const int def) const;
+  virtual void get_value_with_default(const ConfigKey &key, double &out, const double def) const;
+
   virtual bool set_value(const std::string &key, const std::string &v, ConfigFlags flags = CONFIG_FLAG_NONE);
   virtual bool set_value(const std::string &key, const char *v, ConfigFlags flags = CONFIG_FLAG_NONE);
   virtual bool set_value(const std::string &key, int v, ConfigFlags flags = CONFIG_FLAG_NONE);
@@ -85,12 +105,17 @@ public:
   virtual bool find_listener(IConfiguratorListener *listener, std::string &key) const;
 
 private:
-  typedef std::list<std::pair<std::string, IConfiguratorListener *> > Listeners;
-  typedef std::list<std::pair<std::string, IConfiguratorListener *> >::iterator ListenerIter;
-  typedef std::list<std::pair<std::string, IConfiguratorListener *> >::const_iterator ListenerCIter;
-
   //! Configuration change listeners.
-  Listeners listeners;
+  ListenerTrie listeners;
+
+  //! Number of nested hold_notifications() calls.
+  int notify_depth;
+
+  //! Changed keys whose notification is held, in order.
+  std::list<std::string> pending_keys;
+
+  //! Changed keys whose notification is held.
+  std::set<std::string> pending_key_set;
 
 private:
   struct DelayedConfig
@@ -100,6 +125,12 @@ private:
     time_t until;
   };
 
+  struct TransactionValue
+  {
+    Variant value;
+    ConfigFlags flags;
+  };
+
   struct Setting
   {
     std::string key;
@@ -110,6 +141,36 @@ private:
   typedef DelayedList::iterator DelayedListIter;
   typedef DelayedList::const_iterator DelayedListCIter;
 
+  //! Cached result of a lookup.
+  struct CachedValue
+  {
+    CachedValue() : valid(false), found(false), type(VARIANT_TYPE_NONE)
+    {
+      value.type = VARIANT_TYPE_NONE;
+    }
+
+    //! Is the entry up to date?
+    bool valid;
+
+    //! Does the key have a value of the requested type?
+    bool found;
+
+    //! Requested type.
+    VariantType type;
+
+    //! The value.
+    Variant value;
+  };
+
+  typedef std::vector<CachedValue> ValueCache;
+
+  //! Values in the configuration file, by normalized key and requested type.
+  typedef std::map<std::pair<std::string, int>, ConfigSnapshot::Value> SnapshotValues;
+
+  typedef std::map<std::string, TransactionValue> TransactionList;
+  typedef TransactionList::iterator TransactionListIter;
+  typedef TransactionList::const_iterator TransactionListCIter;
+
   typedef std::map<std::string, Setting> Settings;
   typedef std::map<std::string, Setting>::iterator SettingIter;
   typedef std::map<std::string, Setting>::const_iterator SettingCIter;
@@ -120,8 +181,20 @@ private:
 
   bool set_value(const std::string &key, Variant &value, ConfigFlags flags = CONFIG_FLAG_NONE);
   bool get_value(const std::string &key, VariantType type, Variant &value) const;
+  const Variant *find_value(const ConfigKey &key, VariantType type) const;
+  bool lookup_value(const std::string &key, unsigned int hash, VariantType type, Variant &value) const;
+  void invalidate_value(const std::string &key) const;
+  void invalidate_values() const;
+
+  void load_backend() const;
+  void add_snapshot_value(const std::string &key, unsigned int hash, VariantType type, bool found,
+                          const Variant &value) const;
+  void discard_snapshot();
+  void write_snapshot();
 
   void fire_configurator_event(const std::string &key);
+  void hold_notifications();
+  void release_notifications();
   void strip_leading_slash(std::string &key) const;
   void strip_trailing_slash(std::string &key) const;
   void add_trailing_slash(std::string &key) const;
@@ -135,11 +208,50 @@ private:
   //! Delayed settings
   DelayedList delayed_config;
 
+  //! Number of nested begin_transaction() calls.
+  int transaction_depth;
+
+  //! Values set during the transaction.
+  TransactionList transaction;
+
+  //! Time at which an unfinished transaction is aborted.
+  time_t transaction_time;
+
+  //! Values that were looked up, by key number.
+  mutable ValueCache cache;
+
   //! The backend in use.
   IConfigBackend *backend;
 
+  //! Configuration file of the backend.
+  std::string filename;
+
+  //! Has the configuration file been loaded into the backend?
+  mutable bool backend_loaded;
+
+  //! Snapshot of the values in the configuration file, or NULL.
+  ConfigSnapshot *snapshot;
+
+  //! Values that were looked up in the snapshot or the backend.
+  mutable SnapshotValues snapshot_values;
+
+  //! Were values looked up in the backend since the snapshot was written?
+  mutable bool snapshot_dirty;
+
+  //! Next snapshot write time.
+  time_t snapshot_time;
+
+  //! Stamp of the configuration file that the values came from.
+  mutable ConfigSnapshot::Stamp file_stamp;
+
+  //! Is the stamp of the configuration file known?
+  mutable bool file_stamp_valid;
+
+  //! Is a save waiting to be written by the persistence worker?
+  bool save_pending;
+
   //! Next auto save time.
-  time_t auto_save_time;
+  mutable time_t auto_save_time;
 };
 
 
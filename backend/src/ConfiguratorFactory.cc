@@ -32,7 +32,7 @@
 #ifdef HAVE_GSETTINGS
 #include "GSettingsConfigurator.hh"
 #endif
-#ifdef HAVE_GDOME
+#ifdef HAVE_XML
 #include "XMLConfigurator.hh"
 #endif
 #ifdef HAVE_GCONF
@@ -52,7 +52,7 @@ ConfiguratorFactory::create(Format fmt)
   Configurator *c =  NULL;
   IConfigBackend *b = NULL;
 
-#ifdef HAVE_GDOME
+#ifdef HAVE_XML
   if (fmt == FormatXml)
     {
       b = new XMLConfigurator();
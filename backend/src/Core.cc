@@ -32,6 +32,14 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <vector>
+
+#include <glib.h>
+#if defined(PLATFORM_OS_UNIX) && GLIB_CHECK_VERSION(2, 36, 0)
+#include <signal.h>
+#include <glib-unix.h>
+#endif
 
 #include "Core.hh"
 
@@ -50,7 +58,9 @@
 #include "TimePredFactory.hh"
 #include "TimePred.hh"
 #include "TimeSource.hh"
+#include "timeutil.h"
 #include "InputMonitorFactory.hh"
+#include "PersistenceWorker.hh"
 
 #ifdef HAVE_DISTRIBUTION
 #include "DistributionManager.hh"
@@ -81,6 +91,23 @@ Core *Core::instance = NULL;
 
 const char *WORKRAVESTATE="WorkRaveState";
 const int SAVESTATETIME = 60;
+const int MAX_HEARTBEAT_INTERVAL = SAVESTATETIME;
+
+//! Heartbeats that are later than this are not counted as jitter.
+const int MAX_HEARTBEAT_JITTER = 10;
+
+static const char *heartbeat_phase_names[] =
+  {
+    "timewarp",
+    "config",
+    "distribution",
+    "state",
+    "timers",
+    "breaks",
+    "persist",
+    "total",
+    "jitter",
+  };
 
 #define DBUS_PATH_WORKRAVE         "/org/workrave/Workrave/Core"
 #define DBUS_SERVICE_WORKRAVE      "org.workrave.Workrave"
@@ -88,7 +115,9 @@ const int SAVESTATETIME = 60;
 //! Constructs a new Core.
 Core::Core() :
   last_process_time(0),
+  heartbeat_interval(1),
   master_node(true),
+  timer_monitor_state(ACTIVITY_UNKNOWN),
   configurator(NULL),
   monitor(NULL),
   application(NULL),
@@ -108,6 +137,9 @@ Core::Core() :
   ,
   dist_manager(NULL),
   remote_state(ACTIVITY_IDLE),
+  published_state(ACTIVITY_UNKNOWN),
+  last_publish_time(0),
+  publish_interval(2),
   idlelog_manager(NULL)
 #  ifndef NDEBUG
   ,
@@ -117,6 +149,7 @@ Core::Core() :
 {
   TRACE_ENTER("Core::Core");
   current_time = time(NULL);
+  tvRESETTIME(last_heartbeat_tick);
 
   assert(! instance);
   instance = this;
@@ -154,6 +187,9 @@ Core::~Core()
 #endif
 #endif
 
+  // Write everything that was saved above.
+  delete PersistenceWorker::get_instance();
+
   TRACE_EXIT();
 }
 
@@ -171,6 +207,8 @@ Core::init(int argc, char **argv, IApp *app, const string &display_name)
   this->argc = argc;
   this->argv = argv;
 
+  PersistenceWorker::get_instance()->start();
+
   init_configurator();
   init_monitor(display_name);
 
@@ -184,6 +222,10 @@ Core::init(int argc, char **argv, IApp *app, const string &display_name)
 
   load_state();
   load_misc();
+
+#if defined(PLATFORM_OS_UNIX) && GLIB_CHECK_VERSION(2, 36, 0)
+  g_unix_signal_add(SIGUSR1, on_dump_signal, this);
+#endif
 }
 
 
@@ -206,7 +248,7 @@ Core::init_configurator()
 #endif
       
       configurator = ConfiguratorFactory::create(ConfiguratorFactory::FormatNative);
-#if defined(HAVE_GDOME)
+#if defined(HAVE_XML)
       if (configurator == NULL)
         {
           string configFile = Util::complete_directory("config.xml", Util::SEARCH_PATH_CONFIG);
@@ -303,6 +345,7 @@ Core::init_breaks()
   for (int i = 0; i < BREAK_ID_SIZEOF; i++)
     {
       breaks[i].init(BreakId(i), application);
+      breaks[i].get_timer()->set_deadline_queue(&timer_deadlines, i);
     }
   application->set_break_response(this);
 }
@@ -327,6 +370,26 @@ Core::init_distribution_manager()
 
   idlelog_manager = new IdleLogManager(dist_manager->get_my_id(), this);
   idlelog_manager->init();
+
+  configurator->set_value(CoreConfig::CFG_KEY_DISTRIBUTION_STATE_INTERVAL, 2, CONFIG_FLAG_DEFAULT);
+  load_distribution_config();
+
+  configurator->add_listener(CoreConfig::CFG_KEY_DISTRIBUTION_STATE_INTERVAL, this);
+}
+
+
+//! Loads the configuration of the state updates.
+void
+Core::load_distribution_config()
+{
+  int interval;
+  if (! configurator->get_value(CoreConfig::CFG_KEY_DISTRIBUTION_STATE_INTERVAL, interval) ||
+      interval < 0 || interval > 60)
+    {
+      interval = 2;
+    }
+
+  publish_interval = interval;
 }
 #endif
 
@@ -408,6 +471,13 @@ Core::config_changed_notify(const string &key)
       load_monitor_config();
     }
 
+#ifdef HAVE_DISTRIBUTION
+  if (key == CoreConfig::CFG_KEY_DISTRIBUTION_STATE_INTERVAL)
+    {
+      load_distribution_config();
+    }
+#endif
+
   if (key == CoreConfig::CFG_KEY_OPERATION_MODE)
     {
       int mode;
@@ -437,6 +507,9 @@ Core::config_changed_notify(const string &key)
       TRACE_MSG("Setting usage mode");
       set_usage_mode_internal(UsageMode(mode), false);
     }
+
+  // Timer and break settings may move the next timer event.
+  wakeup();
   TRACE_EXIT();
 }
 
@@ -799,6 +872,8 @@ Core::set_operation_mode_internal(
             }
 #endif
       }
+
+      wakeup();
   }
 
   TRACE_EXIT();
@@ -849,6 +924,8 @@ Core::set_usage_mode_internal(UsageMode mode, bool persistent)
             }
 #endif
         }
+
+      wakeup();
     }
 }
 
@@ -869,6 +946,8 @@ Core::force_break(BreakId id, BreakHint break_hint)
 #ifdef HAVE_DISTRIBUTION
   send_break_control_message_bool_param(id, BCM_START_BREAK, break_hint);
 #endif
+
+  wakeup();
 }
 
 
@@ -909,6 +988,7 @@ Core::time_changed()
       breaks[i].get_timer()->shift_time(0);
     }
 
+  wakeup();
   TRACE_EXIT();
 }
 
@@ -947,6 +1027,8 @@ Core::set_powersave(bool down)
       TRACE_MSG("resume time " << powersave_resume_time);
       remove_operation_mode_override( "powersave" );
     }
+
+  wakeup();
   TRACE_EXIT();
 }
 
@@ -1112,26 +1194,49 @@ Core::heartbeat()
   TRACE_ENTER("Core::heartbeat");
   assert(application != NULL);
 
+  GTimeVal tick, phase_start;
+  g_get_current_time(&tick);
+  phase_start = tick;
+
+  // Measure how late this heartbeat is. An earlier heartbeat is a wakeup.
+  if (!tvTIMEEQ0(last_heartbeat_tick))
+    {
+      GTimeVal delay;
+      tvSUBTIME(delay, tick, last_heartbeat_tick);
+      delay.tv_sec -= heartbeat_interval;
+
+      if (!tvTIMELT0(delay) && delay.tv_sec < MAX_HEARTBEAT_JITTER)
+        {
+          heartbeat_latency[HEARTBEAT_PHASE_JITTER].record(delay.tv_sec * G_USEC_PER_SEC + delay.tv_usec);
+        }
+    }
+  last_heartbeat_tick = tick;
+
   // Set current time.
   current_time = time(NULL);
 
   // Performs timewarp checking.
   bool warped = process_timewarp();
+  end_heartbeat_phase(HEARTBEAT_PHASE_TIMEWARP, phase_start);
 
   // Process configuration
   configurator->heartbeat();
+  end_heartbeat_phase(HEARTBEAT_PHASE_CONFIG, phase_start);
 
   // Perform distribution processing.
   process_distribution();
+  end_heartbeat_phase(HEARTBEAT_PHASE_DISTRIBUTION, phase_start);
 
   if (!warped)
     {
       // Perform state computation.
       process_state();
     }
+  end_heartbeat_phase(HEARTBEAT_PHASE_STATE, phase_start);
 
   // Perform timer processing.
   process_timers();
+  end_heartbeat_phase(HEARTBEAT_PHASE_TIMERS, phase_start);
 
   // Send heartbeats to other components.
   for (int i = 0; i < BREAK_ID_SIZEOF; i++)
@@ -1142,21 +1247,214 @@ Core::heartbeat()
           bc->heartbeat();
         }
     }
+  end_heartbeat_phase(HEARTBEAT_PHASE_BREAKS, phase_start);
 
-  // Make state persistent.
-  if (current_time % SAVESTATETIME == 0)
+  // Make state persistent. The heartbeat may skip seconds, so check
+  // whether a save boundary was passed since the previous heartbeat.
+  if (last_process_time != 0 &&
+      current_time / SAVESTATETIME != last_process_time / SAVESTATETIME)
     {
       statistics->update();
       save_state();
     }
+  end_heartbeat_phase(HEARTBEAT_PHASE_PERSIST, phase_start);
 
   // Done.
   last_process_time = current_time;
+  end_heartbeat_phase(HEARTBEAT_PHASE_TOTAL, tick);
 
   TRACE_EXIT();
 }
 
 
+//! Records the latency of a heartbeat phase that started at the specified time.
+/*!
+ *  On return, \a start is the start of the next phase.
+ */
+void
+Core::end_heartbeat_phase(HeartbeatPhase phase, GTimeVal &start)
+{
+  GTimeVal now, latency;
+  g_get_current_time(&now);
+  tvSUBTIME(latency, now, start);
+
+  heartbeat_latency[phase].record(latency.tv_sec * G_USEC_PER_SEC + latency.tv_usec);
+  start = now;
+}
+
+
+//! Returns the heartbeat latencies.
+void
+Core::get_heartbeat_latency(HeartbeatLatencies &latencies) const
+{
+  latencies.clear();
+
+  for (int i = 0; i < HEARTBEAT_PHASE_SIZEOF; i++)
+    {
+      const LatencyHistogram &h = heartbeat_latency[i];
+      HeartbeatLatency latency;
+
+      latency.phase = heartbeat_phase_names[i];
+      latency.count = h.get_count();
+      latency.p50 = h.get_percentile(50.0);
+      latency.p90 = h.get_percentile(90.0);
+      latency.p99 = h.get_percentile(99.0);
+      latency.max = h.get_max();
+
+      latencies.push_back(latency);
+    }
+}
+
+
+//! Writes the heartbeat latencies to a file.
+void
+Core::dump_heartbeat_latency() const
+{
+  stringstream ss;
+
+  ss << setw(12) << "phase"
+     << setw(10) << "count"
+     << setw(10) << "min"
+     << setw(10) << "mean"
+     << setw(10) << "p50"
+     << setw(10) << "p90"
+     << setw(10) << "p99"
+     << setw(10) << "p99.9"
+     << setw(10) << "max" << endl;
+
+  for (int i = 0; i < HEARTBEAT_PHASE_SIZEOF; i++)
+    {
+      const LatencyHistogram &h = heartbeat_latency[i];
+
+      ss << setw(12) << heartbeat_phase_names[i]
+         << setw(10) << h.get_count()
+         << setw(10) << h.get_min()
+         << setw(10) << h.get_mean()
+         << setw(10) << h.get_percentile(50.0)
+         << setw(10) << h.get_percentile(90.0)
+         << setw(10) << h.get_percentile(99.0)
+         << setw(10) << h.get_percentile(99.9)
+         << setw(10) << h.get_max() << endl;
+    }
+
+  string data = ss.str();
+  PersistenceWorker::get_instance()->write(Util::get_home_directory() + "heartbeat-latency.txt", data);
+}
+
+
+#if defined(PLATFORM_OS_UNIX) && GLIB_CHECK_VERSION(2, 36, 0)
+//! Dumps the heartbeat latencies on SIGUSR1.
+gboolean
+Core::on_dump_signal(gpointer data)
+{
+  Core *core = (Core *) data;
+  core->dump_heartbeat_latency();
+  return TRUE;
+}
+#endif
+
+
+//! Returns the number of seconds until the next heartbeat is needed.
+/*!
+ *  The heartbeat runs every second while the user is active, while any
+ *  timer is running or resetting, and while a break is in progress. When
+ *  nothing is going on, the GUI only needs to call the heartbeat when the
+ *  next timer, configuration or statistics event is due. User activity
+ *  during such an interval results in a wakeup.
+ */
+int
+Core::get_heartbeat_interval()
+{
+  TRACE_ENTER("Core::get_heartbeat_interval");
+
+  bool need_heartbeat = (monitor_state != ACTIVITY_IDLE ||
+                         powersave ||
+                         !external_activity.empty());
+
+#ifdef HAVE_DISTRIBUTION
+  if (dist_manager != NULL && dist_manager->get_enabled())
+    {
+      need_heartbeat = true;
+    }
+#endif
+
+  // Make sure the state is saved at the usual time.
+  time_t next_time = (current_time / SAVESTATETIME + 1) * SAVESTATETIME;
+
+  time_t config_time = configurator->get_next_heartbeat_time();
+  if (config_time != 0 && config_time < next_time)
+    {
+      next_time = config_time;
+    }
+
+  time_t timer_time = timer_deadlines.get_next_deadline();
+  if (timer_time != 0 && timer_time < next_time)
+    {
+      next_time = timer_time;
+    }
+
+  for (int i = 0; i < BREAK_ID_SIZEOF && !need_heartbeat; i++)
+    {
+      BreakControl *bc = breaks[i].get_break_control();
+      Timer *timer = breaks[i].get_timer();
+
+      if ((bc != NULL && bc->need_heartbeat()) ||
+          timer->get_state() == STATE_RUNNING ||
+          timer->get_next_reset_time() != 0 ||
+          timer->has_activity_monitor())
+        {
+          // Break window or timer bars change every second.
+          need_heartbeat = true;
+        }
+    }
+
+  int interval = 1;
+  if (!need_heartbeat)
+    {
+      interval = (int)(next_time - current_time);
+      if (interval < 1)
+        {
+          interval = 1;
+        }
+      else if (interval > MAX_HEARTBEAT_INTERVAL)
+        {
+          interval = MAX_HEARTBEAT_INTERVAL;
+        }
+    }
+
+  if (interval > 1)
+    {
+      // Wake up as soon as the user becomes active.
+      monitor->set_wakeup_listener(this);
+    }
+
+  heartbeat_interval = interval;
+
+  TRACE_RETURN(interval);
+  return interval;
+}
+
+
+//! Requests an immediate heartbeat from the GUI.
+void
+Core::wakeup()
+{
+  if (heartbeat_interval > 1 && core_event_listener != NULL)
+    {
+      core_event_listener->core_event_heartbeat_wakeup();
+    }
+}
+
+
+//! Notification of user activity while the heartbeat is slowed down.
+bool
+Core::action_notify()
+{
+  wakeup();
+  return false;   // false: kill listener.
+}
+
+
 //! Performs all distribution processing.
 void
 Core::process_distribution()
@@ -1171,6 +1469,13 @@ Core::process_distribution()
   // Retrieve State.
   ActivityState state = monitor->get_current_state();
 
+#ifndef NDEBUG
+  if (fake_monitor != NULL)
+    {
+      state = fake_monitor->get_current_state();
+    }
+#endif
+
   if (dist_manager != NULL)
     {
       dist_manager->heartbeart();
@@ -1183,23 +1488,20 @@ Core::process_distribution()
         }
     }
 
-  if ( (previous_master_mode != master_node) ||
-       (master_node && local_state != state) )
+  if (previous_master_mode != master_node)
     {
-      PacketBuffer buffer;
-      buffer.create();
-
-      buffer.pack_ushort(1);
-      buffer.pack_ushort(state);
-
-      dist_manager->broadcast_client_message(DCM_MONITOR, buffer);
-
-      buffer.clear();
-      bool ret = request_timer_state(buffer);
-      if (ret)
-        {
-          dist_manager->broadcast_client_message(DCM_TIMERS, buffer);
-        }
+      // The master changed, so send the complete state.
+      publish_state(state, true);
+    }
+  else if (master_node && state != published_state &&
+           (current_time >= last_publish_time + publish_interval ||
+            current_time < last_publish_time))
+    {
+      // Noisy activity can toggle the state every second. Only send the
+      // state it settled on, at most once per interval. The timers follow
+      // the monitor state on all clients, and the complete state is sent
+      // periodically by the distribution manager.
+      publish_state(state, false);
     }
 
 #endif
@@ -1268,6 +1570,7 @@ Core::report_external_activity(std::string who, bool act)
   if (act)
     {
       external_activity[who] = current_time + 10;
+      wakeup();
     }
   else
     {
@@ -1330,11 +1633,16 @@ Core::process_timers()
   TRACE_ENTER("Core::process_timers");
 
   TimerInfo infos[BREAK_ID_SIZEOF];
+  bool due[BREAK_ID_SIZEOF];
+
+  // A change in activity affects all timers.
+  bool state_changed = (monitor_state != timer_monitor_state);
+  timer_monitor_state = monitor_state;
 
   for (int i = 0; i < BREAK_ID_SIZEOF; i++)
     {
       Timer *timer = breaks[i].get_timer();
-      
+
       infos[i].enabled = breaks[i].is_enabled();
       if (infos[i].enabled)
         {
@@ -1356,9 +1664,35 @@ Core::process_timers()
             }
         }
 
-      // First process only timer that do not have their
-      // own activity monitor.
-      if (!(timer->has_activity_monitor()))
+      // Timers with their own activity monitor poll it on every heartbeat.
+      due[i] = state_changed || timer->has_activity_monitor();
+    }
+
+  // Only process timers with a pending event.
+  int id;
+  while ((id = timer_deadlines.pop_due(current_time)) != -1)
+    {
+      due[id] = true;
+    }
+
+  for (int i = 0; i < BREAK_ID_SIZEOF; i++)
+    {
+      if (!due[i])
+        {
+          Timer *timer = breaks[i].get_timer();
+
+          infos[i].event = TIMER_EVENT_NONE;
+          infos[i].idle_time = timer->get_elapsed_idle_time();
+          infos[i].elapsed_time = timer->get_elapsed_time();
+        }
+    }
+
+  // First process only timer that do not have their
+  // own activity monitor.
+  for (int i = 0; i < BREAK_ID_SIZEOF; i++)
+    {
+      Timer *timer = breaks[i].get_timer();
+      if (due[i] && !(timer->has_activity_monitor()))
         {
           timer->process(monitor_state, infos[i]);
         }
@@ -1408,8 +1742,14 @@ Core::process_timewarp()
   TRACE_ENTER("Core::process_timewarp");
   if (last_process_time != 0)
     {
-      time_t gap = current_time - 1 - last_process_time;
-  
+      // The GUI may have been asked to wait longer than a second, or may
+      // have been woken up early.
+      time_t gap = current_time - heartbeat_interval - last_process_time;
+      if (gap < 0 && current_time >= last_process_time)
+        {
+          gap = 0;
+        }
+
       if (abs((int)gap) > 5)
         {
           TRACE_MSG("gap " << gap << " " << powersave << " " << operation_mode << " " << powersave_resume_time << " " << current_time);
@@ -1462,7 +1802,8 @@ Core::process_timewarp()
   TRACE_ENTER("Core::process_timewarp");
   if (last_process_time != 0)
     {
-      int gap = current_time - 1 - last_process_time;
+      // The GUI may have been asked to wait longer than a second.
+      int gap = current_time - heartbeat_interval - last_process_time;
 
       if (gap >= 30)
         {
@@ -1684,11 +2025,7 @@ Core::daily_reset()
 void
 Core::save_state() const
 {
-  stringstream ss;
-  ss << Util::get_home_directory();
-  ss << "state" << ends;
-
-  ofstream stateFile(ss.str().c_str());
+  stringstream stateFile;
 
   stateFile << "WorkRaveState 3"  << endl
             << get_time() << endl;
@@ -1700,7 +2037,8 @@ Core::save_state() const
       stateFile << stateStr << endl;
     }
 
-  stateFile.close();
+  string state = stateFile.str();
+  PersistenceWorker::get_instance()->write(Util::get_home_directory() + "state", state);
 }
 
 
@@ -1893,6 +2231,8 @@ Core::request_client_message(DistributionClientMessageID id, PacketBuffer &buffe
       break;
 
     case DCM_MONITOR:
+      buffer.pack_ushort(1);
+      buffer.pack_ushort(monitor->get_current_state());
       ret = true;
       break;
 
@@ -1901,8 +2241,17 @@ Core::request_client_message(DistributionClientMessageID id, PacketBuffer &buffe
       break;
 
     case DCM_IDLELOG:
-      idlelog_manager->get_idlelog(buffer);
-      ret = true;
+      if (idlelog_manager->is_incremental_sync_possible())
+        {
+          idlelog_manager->get_idlelog(buffer);
+          ret = true;
+        }
+      else
+        {
+          // Only the clients that do not synchronize incrementally get my
+          // entire idle log.
+          send_idlelogs();
+        }
       break;
 
     default:
@@ -1920,8 +2269,6 @@ Core::client_message(DistributionClientMessageID id, bool master, const char *cl
 {
   bool ret = false;
 
-  (void) client_id;
-
   switch (id)
     {
     case DCM_BREAKS:
@@ -1944,7 +2291,10 @@ Core::client_message(DistributionClientMessageID id, bool master, const char *cl
       break;
 
     case DCM_IDLELOG:
-      idlelog_manager->set_idlelog(buffer);
+      if (idlelog_manager->set_idlelog(buffer) && client_id != NULL)
+        {
+          send_idlelog(client_id);
+        }
       compute_timers();
       ret = true;
       break;
@@ -1957,6 +2307,32 @@ Core::client_message(DistributionClientMessageID id, bool master, const char *cl
 }
 
 
+//! Sends my idle log to the specified client.
+void
+Core::send_idlelog(string client_id)
+{
+  PacketBuffer buffer;
+  buffer.create();
+
+  idlelog_manager->get_idlelog(buffer, client_id);
+  dist_manager->unicast_client_message(DCM_IDLELOG, buffer, client_id);
+}
+
+
+//! Sends my idle log to each signed on client, in the format it supports.
+void
+Core::send_idlelogs()
+{
+  list<string> ids;
+  idlelog_manager->get_connected_clients(ids);
+
+  for (list<string>::iterator i = ids.begin(); i != ids.end(); i++)
+    {
+      send_idlelog(*i);
+    }
+}
+
+
 bool
 Core::request_break_state(PacketBuffer &buffer)
 {
@@ -2136,26 +2512,41 @@ Core::set_monitor_state(bool master, PacketBuffer &buffer)
 }
 
 
-//! A remote client has signed on.
+//! Sends the monitor state, and optionally the timer state, to all clients.
 void
-Core::signon_remote_client(string client_id)
+Core::publish_state(ActivityState state, bool full)
 {
-  idlelog_manager->signon_remote_client(client_id);
+  PacketBuffer buffer;
+  buffer.create();
+
+  buffer.pack_ushort(1);
+  buffer.pack_ushort(state);
 
-  if (master_node)
+  dist_manager->broadcast_client_message(DCM_MONITOR, buffer);
+
+  if (full)
     {
-      PacketBuffer buffer;
-      buffer.create();
+      buffer.clear();
+      bool ret = request_timer_state(buffer);
+      if (ret)
+        {
+          dist_manager->broadcast_client_message(DCM_TIMERS, buffer);
+        }
+    }
 
-      ActivityState state = monitor->get_current_state();
+  published_state = state;
+  last_publish_time = current_time;
+}
 
-      buffer.pack_ushort(1);
-      buffer.pack_ushort(state);
 
-      dist_manager->broadcast_client_message(DCM_MONITOR, buffer);
+//! A remote client has signed on.
+void
+Core::signon_remote_client(string client_id)
+{
+  idlelog_manager->signon_remote_client(client_id);
 
-      buffer.clear();
-    }
+  // If I am master, the distribution link sends my state to the client
+  // along with its signon messages.
 }
 
 
@@ -2181,21 +2572,38 @@ Core::compute_timers()
 {
   TRACE_ENTER("IdleLogManager:compute_timers");
 
+  int idle = idlelog_manager->compute_idle_time();
+
+  // Compute the active time of all breaks that reset in a single pass.
+  vector<int> autoresets;
+  for (int i = 0; i < BREAK_ID_SIZEOF; i++)
+    {
+      int autoreset = breaks[i].get_timer()->get_auto_reset();
+      if (autoreset != 0)
+        {
+          autoresets.push_back(autoreset);
+        }
+    }
+
+  vector<time_t> active_times;
+  idlelog_manager->compute_active_time(autoresets, active_times);
+
+  int index = 0;
   for (int i = 0; i < BREAK_ID_SIZEOF; i++)
     {
       int autoreset = breaks[i].get_timer()->get_auto_reset();
-      int idle = idlelog_manager->compute_idle_time();
 
       if (autoreset != 0)
         {
-          int active_time = idlelog_manager->compute_active_time(autoreset);
+          int active_time = active_times[index++];
+          int break_idle = idle;
 
-          if (idle > autoreset)
+          if (break_idle > autoreset)
             {
-              idle = autoreset;
+              break_idle = autoreset;
             }
 
-          breaks[i].get_timer()->set_values(active_time, idle);
+          breaks[i].get_timer()->set_values(active_time, break_idle);
         }
       else
         {
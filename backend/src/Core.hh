@@ -42,13 +42,17 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <list>
 
+#include "ActivityMonitorListener.hh"
 #include "Break.hh"
+#include "DeadlineQueue.hh"
 #include "IBreakResponse.hh"
 #include "IActivityMonitor.hh"
 #include "ICore.hh"
 #include "ICoreEventListener.hh"
 #include "IConfiguratorListener.hh"
+#include "LatencyHistogram.hh"
 #include "TimeSource.hh"
 #include "Timer.hh"
 #include "Statistics.hh"
@@ -84,9 +88,23 @@ class Core :
   public TimeSource,
   public ICore,
   public IConfiguratorListener,
-  public IBreakResponse
+  public IBreakResponse,
+  public ActivityMonitorListener
 {
 public:
+  //! Latency of a phase of the heartbeat, in microseconds.
+  struct HeartbeatLatency
+  {
+    std::string phase;
+    gint64 count;
+    gint64 p50;
+    gint64 p90;
+    gint64 p99;
+    gint64 max;
+  };
+
+  typedef std::list<HeartbeatLatency> HeartbeatLatencies;
+
   Core();
   virtual ~Core();
 
@@ -145,6 +163,7 @@ public:
   void get_timer_remaining(BreakId id,int *value);
   void get_timer_idle(BreakId id, int *value);
   void get_timer_overdue(BreakId id,int *value);
+  void get_heartbeat_latency(HeartbeatLatencies &latencies) const;
 
   // BreakResponseInterface
   void postpone_break(BreakId break_id);
@@ -166,6 +185,21 @@ private:
     };
 #endif
 
+  //! Phases of the heartbeat of which the latency is measured.
+  enum HeartbeatPhase
+    {
+      HEARTBEAT_PHASE_TIMEWARP,
+      HEARTBEAT_PHASE_CONFIG,
+      HEARTBEAT_PHASE_DISTRIBUTION,
+      HEARTBEAT_PHASE_STATE,
+      HEARTBEAT_PHASE_TIMERS,
+      HEARTBEAT_PHASE_BREAKS,
+      HEARTBEAT_PHASE_PERSIST,
+      HEARTBEAT_PHASE_TOTAL,
+      HEARTBEAT_PHASE_JITTER,
+      HEARTBEAT_PHASE_SIZEOF
+    };
+
   void init(int argc, char **argv, IApp *application, const std::string &display_name);
   void init_breaks();
   void init_configurator();
@@ -177,6 +211,14 @@ private:
   void load_monitor_config();
   void config_changed_notify(const std::string &key);
   void heartbeat();
+  int get_heartbeat_interval();
+  void wakeup();
+  bool action_notify();
+  void end_heartbeat_phase(HeartbeatPhase phase, GTimeVal &start);
+  void dump_heartbeat_latency() const;
+#if defined(PLATFORM_OS_UNIX) && GLIB_CHECK_VERSION(2, 36, 0)
+  static gboolean on_dump_signal(gpointer data);
+#endif
   void timer_action(BreakId id, TimerInfo info);
   void process_distribution();
   void process_state();
@@ -210,6 +252,10 @@ private:
   bool set_timer_state(PacketBuffer &buffer);
 
   bool set_monitor_state(bool master, PacketBuffer &buffer);
+  void send_idlelog(string client_id);
+  void send_idlelogs();
+  void publish_state(ActivityState state, bool full);
+  void load_distribution_config();
 
   enum BreakControlMessage
     {
@@ -246,12 +292,27 @@ private:
   //! The time we last processed the timers.
   time_t last_process_time;
 
+  //! Number of seconds the GUI waits before the next heartbeat.
+  int heartbeat_interval;
+
+  //! Latency of each phase of the heartbeat.
+  LatencyHistogram heartbeat_latency[HEARTBEAT_PHASE_SIZEOF];
+
+  //! Start of the previous heartbeat.
+  GTimeVal last_heartbeat_tick;
+
   //! Are we the master node??
   bool master_node;
 
   //! List of breaks.
   Break breaks[BREAK_ID_SIZEOF];
 
+  //! Next event time of each break timer.
+  DeadlineQueue timer_deadlines;
+
+  //! Monitor state the timers were last processed with.
+  ActivityState timer_monitor_state;
+
   //! The Configurator.
   Configurator *configurator;
 
@@ -312,6 +373,15 @@ private:
   //! State of the remote master.
   ActivityState remote_state;
 
+  //! Monitor state last sent to the other clients.
+  ActivityState published_state;
+
+  //! Time the monitor state was last sent.
+  time_t last_publish_time;
+
+  //! Minimum number of seconds between monitor state updates.
+  int publish_interval;
+
   //! Manager that collects idle times of all clients.
   IdleLogManager *idlelog_manager;
 
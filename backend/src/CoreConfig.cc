@@ -66,6 +66,7 @@ const string CoreConfig::CFG_KEY_DISTRIBUTION_TCP_USERNAME = "distribution/usern
 const string CoreConfig::CFG_KEY_DISTRIBUTION_TCP_PASSWORD = "distribution/password";
 const string CoreConfig::CFG_KEY_DISTRIBUTION_TCP_ATTEMPTS = "distribution/reconnect_attempts";
 const string CoreConfig::CFG_KEY_DISTRIBUTION_TCP_INTERVAL = "distribution/reconnect_interval";
+const string CoreConfig::CFG_KEY_DISTRIBUTION_STATE_INTERVAL = "distribution/state_interval";
 
 
 bool
@@ -0,0 +1,150 @@
+// DeadlineQueue.cc --- Priority queue of timer deadlines
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+
+#include "debug.hh"
+
+#include "DeadlineQueue.hh"
+
+using namespace std;
+
+//! Number of outdated entries tolerated per ID before compacting.
+static const size_t MAX_STALE_PER_ID = 4;
+
+
+DeadlineQueue::DeadlineQueue()
+{
+}
+
+
+void
+DeadlineQueue::schedule(int id, time_t deadline)
+{
+  if ((size_t)id >= deadlines.size())
+    {
+      deadlines.resize(id + 1, 0);
+    }
+
+  if (deadlines[id] == deadline)
+    {
+      return;
+    }
+
+  deadlines[id] = deadline;
+
+  if (deadline != 0)
+    {
+      heap.push_back(Entry(deadline, id, false));
+      push_heap(heap.begin(), heap.end());
+    }
+
+  if (heap.size() > MAX_STALE_PER_ID * (deadlines.size() + 1))
+    {
+      compact();
+    }
+}
+
+
+void
+DeadlineQueue::wakeup(int id, time_t now)
+{
+  heap.push_back(Entry(now, id, true));
+  push_heap(heap.begin(), heap.end());
+}
+
+
+int
+DeadlineQueue::pop_due(time_t now)
+{
+  while (!heap.empty() && heap.front().time <= now)
+    {
+      Entry entry = heap.front();
+      bool valid = is_valid(entry);
+      pop();
+
+      if (valid)
+        {
+          if (!entry.forced)
+            {
+              // Consumed. The owner reschedules after processing.
+              deadlines[entry.id] = 0;
+            }
+          return entry.id;
+        }
+    }
+
+  return -1;
+}
+
+
+time_t
+DeadlineQueue::get_next_deadline()
+{
+  while (!heap.empty() && !is_valid(heap.front()))
+    {
+      pop();
+    }
+
+  return heap.empty() ? 0 : heap.front().time;
+}
+
+
+//! Is the entry still the current deadline of its ID?
+bool
+DeadlineQueue::is_valid(const Entry &entry) const
+{
+  return entry.forced ||
+    ((size_t)entry.id < deadlines.size() && deadlines[entry.id] == entry.time);
+}
+
+
+//! Removes the top of the heap.
+void
+DeadlineQueue::pop()
+{
+  pop_heap(heap.begin(), heap.end());
+  heap.pop_back();
+}
+
+
+//! Removes all outdated entries.
+void
+DeadlineQueue::compact()
+{
+  TRACE_ENTER_MSG("DeadlineQueue::compact", heap.size());
+
+  vector<Entry> valid;
+  for (vector<Entry>::const_iterator i = heap.begin(); i != heap.end(); i++)
+    {
+      if (is_valid(*i))
+        {
+          valid.push_back(*i);
+        }
+    }
+
+  heap.swap(valid);
+  make_heap(heap.begin(), heap.end());
+
+  TRACE_EXIT();
+}
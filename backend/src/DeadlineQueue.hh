@@ -0,0 +1,77 @@
+// DeadlineQueue.hh --- Priority queue of timer deadlines
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef DEADLINEQUEUE_HH
+#define DEADLINEQUEUE_HH
+
+#include <time.h>
+#include <vector>
+
+//! Min-heap of deadlines, one deadline per ID.
+/*!
+ *  Rescheduling an ID does not remove its previous heap entry. Outdated
+ *  entries are skipped when they reach the top of the heap, and the heap
+ *  is compacted when too many of them accumulate.
+ */
+class DeadlineQueue
+{
+public:
+  DeadlineQueue();
+
+  //! Sets the deadline of the specified ID. A deadline of 0 cancels it.
+  void schedule(int id, time_t deadline);
+
+  //! Makes the specified ID due at the given time, without changing its deadline.
+  void wakeup(int id, time_t now);
+
+  //! Removes and returns an ID that is due at the given time, or -1.
+  int pop_due(time_t now);
+
+  //! Returns the earliest pending deadline, or 0 if there is none.
+  time_t get_next_deadline();
+
+private:
+  struct Entry
+  {
+    Entry(time_t t, int i, bool f) : time(t), id(i), forced(f) {}
+
+    //! Heap order: earliest deadline at the top.
+    bool operator<(const Entry &other) const
+    {
+      return time > other.time;
+    }
+
+    time_t time;
+    int id;
+    bool forced;
+  };
+
+  bool is_valid(const Entry &entry) const;
+  void pop();
+  void compact();
+
+private:
+  //! The heap.
+  std::vector<Entry> heap;
+
+  //! Current deadline per ID.
+  std::vector<time_t> deadlines;
+};
+
+#endif // DEADLINEQUEUE_HH
@@ -77,6 +77,10 @@ public:
   virtual bool broadcast_client_message(DistributionClientMessageID id,
                                         PacketBuffer &buffer) = 0;
 
+  //! Sends a client message to the specified remote host.
+  virtual bool unicast_client_message(DistributionClientMessageID id,
+                                      PacketBuffer &buffer, string client_id) = 0;
+
   //! Disconnects from all remote clients.
   virtual bool disconnect_all() = 0;
 
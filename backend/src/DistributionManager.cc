@@ -353,6 +353,29 @@ DistributionManager::broadcast_client_message(DistributionClientMessageID id, Pa
 }
 
 
+//! Sends a client message to one client.
+bool
+DistributionManager::unicast_client_message(DistributionClientMessageID id, PacketBuffer &buffer,
+                                            string client_id)
+{
+  bool ret = false;
+
+  if (link != NULL)
+    {
+      ret = link->unicast_client_message(id, buffer, client_id);
+    }
+  return ret;
+}
+
+
+//! Returns the link to the other clients.
+DistributionLink *
+DistributionManager::get_link() const
+{
+  return link;
+}
+
+
 //! Event from Link that our 'master' status changed.
 void
 DistributionManager::master_changed(bool new_master, string id)
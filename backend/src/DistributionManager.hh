@@ -70,12 +70,14 @@ public:
   bool remove_listener(DistributionListener *listener);
 
   bool broadcast_client_message(DistributionClientMessageID id, PacketBuffer &buffer);
+  bool unicast_client_message(DistributionClientMessageID id, PacketBuffer &buffer, string client_id);
   bool add_peer(string peer);
   bool remove_peer(string peer);
   bool disconnect_all();
   bool reconnect_all();
   void set_peers(string peers, bool connect = true);
   list<string> get_peers() const;
+  DistributionLink *get_link() const;
 
   // Logging.
   bool add_log_listener(DistributionLogListener *listener);
@@ -68,7 +68,8 @@ DistributionSocketLink::DistributionSocketLink(Configurator *conf) :
   password(NULL),
   master_client(NULL),
   i_am_master(false),
-  master_locked(false),
+  master_lease_time(0),
+  master_epoch(0),
   server_port(DEFAULT_PORT),
   server_socket(NULL),
   network_enabled(false),
@@ -77,6 +78,7 @@ DistributionSocketLink::DistributionSocketLink(Configurator *conf) :
   reconnect_interval(DEFAULT_INTERVAL),
   heartbeat_count(0)
 {
+  memset(&send_stats, 0, sizeof(send_stats));
   socket_driver = SocketDriver::create();
   init_my_id();
 }
@@ -122,6 +124,8 @@ DistributionSocketLink::heartbeat()
       TRACE_ENTER("DistributionSocketLink::heartbeat");
       heartbeat_count++;
 
+      close_overflowed_clients();
+
       time_t current_time = time(NULL);
 
       // See if we have some clients that need reconncting.
@@ -144,6 +148,7 @@ DistributionSocketLink::heartbeat()
                 {
                   c->socket->close();
                   delete c->socket;
+                  c->reset_connection();
                 }
 
               ISocket *socket = socket_driver->create_socket();
@@ -161,6 +166,11 @@ DistributionSocketLink::heartbeat()
         {
           send_client_message(DCMT_MASTER);
         }
+
+      if (heartbeat_count % SEND_STATS_TRACE_INTERVAL == 0)
+        {
+          trace_send_stats();
+        }
       TRACE_EXIT();
     }
 }
@@ -353,10 +363,11 @@ DistributionSocketLink::claim()
     }
   else if (!i_am_master && clients.size() > 0)
     {
-      // No one is master. Just force to be master
-      // potential problem when more client do this simultaneously...
-      send_new_master();
+      // No one is master. Just force to be master. If more clients do
+      // this simultaneously, the master epoch decides.
       i_am_master = true;
+      advance_master_epoch();
+      send_new_master();
     }
   else
     {
@@ -369,10 +380,15 @@ DistributionSocketLink::claim()
 
 
 //! Lock the master status. Claim will be denied when locked.
+/*!
+ *  The lock is a lease that must be renewed periodically. It expires by
+ *  itself, so that a master that stops renewing it cannot keep the
+ *  master status.
+ */
 bool
 DistributionSocketLink::set_lock_master(bool lock)
 {
-  master_locked = lock;
+  master_lease_time = lock ? time(NULL) + MASTER_LEASE_TIME : 0;
   return true;
 }
 
@@ -491,7 +507,43 @@ bool
 DistributionSocketLink::broadcast_client_message(DistributionClientMessageID dsid,
                                                  PacketBuffer &buffer)
 {
-  TRACE_ENTER("DistributionSocketLink::broadcast_client_message");
+  return send_client_message(dsid, buffer, NULL);
+}
+
+
+//! Sends a client message to one client.
+bool
+DistributionSocketLink::unicast_client_message(DistributionClientMessageID dsid,
+                                               PacketBuffer &buffer, string client_id)
+{
+  TRACE_ENTER_MSG("DistributionSocketLink::unicast_client_message", client_id);
+
+  bool ret = false;
+
+  Client *client = find_client_by_id((gchar *)client_id.c_str());
+  if (client != NULL && client->welcome)
+    {
+      ret = send_client_message(dsid, buffer, client);
+    }
+
+  TRACE_RETURN(ret);
+  return ret;
+}
+
+
+//! Sends a client message to the specified client, or to all if NULL.
+bool
+DistributionSocketLink::send_client_message(DistributionClientMessageID dsid,
+                                            PacketBuffer &buffer, Client *to)
+{
+  TRACE_ENTER("DistributionSocketLink::send_client_message");
+
+  if (buffer.bytes_written() > MAX_SHORT_PACKET_SIZE)
+    {
+      send_client_message_chunks(dsid, (guint8 *)buffer.get_buffer(), buffer.bytes_written(), to);
+      TRACE_RETURN("Chunked");
+      return true;
+    }
 
   PacketBuffer packet;
   packet.create();
@@ -506,7 +558,14 @@ DistributionSocketLink::broadcast_client_message(DistributionClientMessageID dsi
   packet.pack_raw((unsigned char *)buffer.get_buffer(),
                   buffer.bytes_written());
 
-  send_packet_broadcast(packet);
+  if (to != NULL)
+    {
+      send_packet(to, packet);
+    }
+  else
+    {
+      send_packet_broadcast(packet);
+    }
   TRACE_EXIT();
   return true;
 }
@@ -569,6 +628,7 @@ DistributionSocketLink::add_client(gchar *id, gchar *host, gint port, ClientType
         {
           c->socket->close();
           delete c->socket;
+          c->reset_connection();
         }
 
       ISocket *socket = socket_driver->create_socket();
@@ -586,12 +646,13 @@ DistributionSocketLink::add_client(gchar *id, gchar *host, gint port, ClientType
 
       client->type = type;
       client->peer = peer;
-      client->packet.create();
       client->hostname = g_strdup(host);
       client->id = g_strdup(id);
       client->port = port;
+      client->welcome = (type == CLIENTTYPE_ROUTED && peer != NULL && peer->welcome);
 
       clients.push_back(client);
+      index_client(client);
 
       if (client->id != NULL)
         {
@@ -679,12 +740,16 @@ DistributionSocketLink::set_client_id(Client *client, gchar *id)
   if (ret)
     {
       // No duplicate, so change the canonical name.
+      unindex_client(client);
+
       g_free(client->id);
       g_free(client->hostname);
       client->id = g_strdup(id);
       client->hostname = NULL;
       client->port = 0;
 
+      index_client(client);
+
       if (client->id != NULL)
         {
           dist_manager->signon_remote_client(client->id);
@@ -720,6 +785,7 @@ DistributionSocketLink::remove_client(Client *client)
 
           dist_manager->log(_("Removing client %s."),
                             (*i)->id == NULL ? "Unknown" : (*i)->id);
+          unindex_client(*i);
           delete *i;
           i = clients.erase(i);
         }
@@ -766,6 +832,7 @@ DistributionSocketLink::remove_peer_clients(Client *client)
               set_master(NULL);
             }
 
+          unindex_client(*i);
           delete *i;
           i = clients.erase(i);
         }
@@ -811,6 +878,7 @@ DistributionSocketLink::close_client(Client *client, bool reconnect /* = false*/
           TRACE_MSG("Still connected");
           // Still connected. Disconect.
           delete client->socket;
+          client->reset_connection();
           client->socket = NULL;
 
           if (reconnect)
@@ -840,6 +908,7 @@ DistributionSocketLink::close_client(Client *client, bool reconnect /* = false*/
 
           // Still connected. Disconect.
           delete client->socket;
+          client->reset_connection();
           client->socket = NULL;
 
           client->reconnect_count = 0;
@@ -856,36 +925,89 @@ DistributionSocketLink::close_client(Client *client, bool reconnect /* = false*/
 bool
 DistributionSocketLink::is_client_valid(Client *client)
 {
-  list<Client *>::iterator i = clients.begin();
-  bool ret = false;
+  return client_set.find(client) != client_set.end();
+}
+
 
-  while (!ret && i != clients.end())
+//! Returns the key of a canonical name and port in the client index.
+static string
+get_canonical_key(const gchar *name, gint port)
+{
+  char buf[16];
+  snprintf(buf, sizeof(buf), ":%d", port);
+  return string(name) + buf;
+}
+
+
+//! Adds a client to the indexes.
+void
+DistributionSocketLink::index_client(Client *client)
+{
+  client_set.insert(client);
+
+  if (client->id != NULL)
+    {
+      clients_by_id.insert(make_pair(string(client->id), client));
+    }
+  if (client->hostname != NULL)
+    {
+      clients_by_name.insert(make_pair(get_canonical_key(client->hostname, client->port), client));
+    }
+}
+
+
+//! Removes a client from the indexes.
+void
+DistributionSocketLink::unindex_client(Client *client)
+{
+  client_set.erase(client);
+
+  if (client->id != NULL)
     {
-      if (*i == client)
+      pair<ClientIndex::iterator, ClientIndex::iterator> range = clients_by_id.equal_range(client->id);
+      for (ClientIndex::iterator i = range.first; i != range.second; i++)
         {
-          ret = true;
+          if (i->second == client)
+            {
+              clients_by_id.erase(i);
+              break;
+            }
         }
-      i++;
     }
 
-  return ret;
+  if (client->hostname != NULL)
+    {
+      string key = get_canonical_key(client->hostname, client->port);
+      pair<ClientIndex::iterator, ClientIndex::iterator> range = clients_by_name.equal_range(key);
+      for (ClientIndex::iterator i = range.first; i != range.second; i++)
+        {
+          if (i->second == client)
+            {
+              clients_by_name.erase(i);
+              break;
+            }
+        }
+    }
 }
 
 
 //! Finds a remote client by its canonical name and port.
+/*!
+ *  If several clients have the same name, the one added last is returned.
+ */
 DistributionSocketLink::Client *
 DistributionSocketLink::find_client_by_canonicalname(gchar *name, gint port)
 {
   Client *ret = NULL;
-  list<Client *>::iterator i = clients.begin();
 
-  while (i != clients.end())
+  if (name != NULL)
     {
-      if ((*i)->port == port && (*i)->hostname != NULL && strcmp((*i)->hostname, name) == 0)
+      pair<ClientIndex::iterator, ClientIndex::iterator> range =
+        clients_by_name.equal_range(get_canonical_key(name, port));
+      if (range.first != range.second)
         {
-          ret = *i;
+          ret = (--range.second)->second;
         }
-      i++;
     }
   return ret;
 }
@@ -895,15 +1017,14 @@ DistributionSocketLink::Client *
 DistributionSocketLink::find_client_by_id(gchar *id)
 {
   Client *ret = NULL;
-  list<Client *>::iterator i = clients.begin();
 
-  while (i != clients.end())
+  if (id != NULL)
     {
-      if ((*i)->id != NULL && strcmp((*i)->id, id) == 0)
+      pair<ClientIndex::iterator, ClientIndex::iterator> range = clients_by_id.equal_range(id);
+      if (range.first != range.second)
         {
-          ret = *i;
+          ret = (--range.second)->second;
         }
-      i++;
     }
   return ret;
 }
@@ -990,14 +1111,57 @@ DistributionSocketLink::set_master_by_id(gchar *id)
 }
 
 
+//! Starts a new master epoch.
+void
+DistributionSocketLink::advance_master_epoch()
+{
+  master_epoch++;
+  if (master_epoch == 0)
+    {
+      // 0 means unknown.
+      master_epoch = 1;
+    }
+}
+
+
+//! Returns whether a master change is older than the current master.
+/*!
+ *  Epochs are compared with wrap-around. If two clients become master in
+ *  the same epoch, the one with the highest ID wins. Clients that do not
+ *  support epochs send epoch 0, which is always accepted.
+ */
+bool
+DistributionSocketLink::is_master_epoch_stale(gint epoch, const gchar *id)
+{
+  bool ret = false;
+
+  if (epoch != 0 && master_epoch != 0)
+    {
+      gint16 diff = (gint16)(guint16)(epoch - master_epoch);
+
+      if (diff < 0)
+        {
+          ret = true;
+        }
+      else if (diff == 0)
+        {
+          string master = get_master();
+          ret = (id == NULL || (master != "" && strcmp(id, master.c_str()) < 0));
+        }
+    }
+
+  return ret;
+}
+
+
 //! Initialize an outgoing packet.
 void
 DistributionSocketLink::init_packet(PacketBuffer &packet, PacketCommand cmd)
 {
   // Length.
   packet.pack_ushort(0);
-  // Version
-  packet.pack_byte(3);
+  // Version. The layout of a packet is the same in all protocol versions.
+  packet.pack_byte(PROTOCOL_VERSION_3);
   // Flags
   packet.pack_byte(0);
   // Command
@@ -1023,10 +1187,9 @@ DistributionSocketLink::send_packet_except(PacketBuffer &packet, Client *client)
 {
   TRACE_ENTER("DistributionSocketLink::send_packet_except");
 
-  gint size = packet.bytes_written();
-
-  // Length.
-  packet.poke_ushort(0, size);
+  // All recipients share the same copy of the packet.
+  int version = 0;
+  SharedPacket *shared = create_shared_packet(packet, version);
 
   list<Client *>::iterator i = clients.begin();
   while (i != clients.end())
@@ -1035,19 +1198,20 @@ DistributionSocketLink::send_packet_except(PacketBuffer &packet, Client *client)
 
       if (c != client && c->socket != NULL)
         {
-          int bytes_written = 0;
-          try
+          if (c->version >= version)
             {
-              c->socket->write(packet.get_buffer(), size, bytes_written);
+              queue_packet(c, shared);
             }
-          catch (SocketException &)
+          else
             {
-              TRACE_MSG("Failed to send");
+              TRACE_MSG("Not supported by " << (c->id != NULL ? c->id : "Unknown"));
             }
         }
       i++;
     }
 
+  shared->unref();
+
   TRACE_EXIT();
 }
 
@@ -1091,37 +1255,222 @@ DistributionSocketLink::send_packet(Client *client, PacketBuffer &packet)
           TRACE_MSG("Sending to " << client->id);
         }
 
-      gint size = packet.bytes_written();
+      int version = 0;
+      SharedPacket *shared = create_shared_packet(packet, version);
+
+      if (client->version >= version)
+        {
+          queue_packet(client, shared);
+        }
+      else
+        {
+          TRACE_MSG("Not supported by client");
+        }
+
+      shared->unref();
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Serializes a packet for sending.
+/*!
+ *  \param version is set to the protocol version the recipient must
+ *  support.
+ */
+SharedPacket *
+DistributionSocketLink::create_shared_packet(PacketBuffer &packet, int &version)
+{
+  gint size = packet.bytes_written();
+  gchar *buffer = packet.get_buffer();
+  SharedPacket *shared = NULL;
+
+  gint cmd = ((guint8)buffer[4] << 8) + (guint8)buffer[5];
+  version = (cmd == PACKET_CLIENTMSG_CHUNK) ? PROTOCOL_VERSION_4 : PROTOCOL_VERSION_3;
 
+  if (size <= MAX_SHORT_PACKET_SIZE)
+    {
       // Length.
       packet.poke_ushort(0, size);
+      shared = new SharedPacket(buffer, size);
+    }
+  else
+    {
+      // Long packet: zero length, followed by the extended header.
+      packet.poke_ushort(0, 0);
+
+      gchar header[6];
+      header[0] = 0;
+      header[1] = 0;
+      header[2] = (size >> 24) & 0xff;
+      header[3] = (size >> 16) & 0xff;
+      header[4] = (size >> 8) & 0xff;
+      header[5] = size & 0xff;
+
+      shared = new SharedPacket(header, sizeof(header), buffer, size);
+      version = PROTOCOL_VERSION_4;
+    }
+
+  return shared;
+}
+
+
+//! Queues a packet for the specified client.
+/*!
+ *  The packet is written immediately if nothing else is waiting for the
+ *  client. A client whose queue exceeds the high-water mark cannot keep
+ *  up; it receives no more packets and is disconnected at the next
+ *  heartbeat. Dropping packets from the middle of the stream is not an
+ *  option, as that would corrupt it.
+ */
+void
+DistributionSocketLink::queue_packet(Client *client, SharedPacket *packet)
+{
+  TRACE_ENTER("DistributionSocketLink::queue_packet");
+
+  if (client->send_overflow)
+    {
+      TRACE_RETURN("Overflowed");
+      return;
+    }
+
+  bool was_empty = client->send_queue.empty();
+
+  client->send_queue.push(packet);
+  send_stats.packets++;
+  send_stats.bytes += packet->get_size();
+
+  if (was_empty)
+    {
+      flush_client(client);
+    }
+
+  gsize queued = client->send_queue.get_size();
+  if ((gint64)queued > send_stats.peak)
+    {
+      send_stats.peak = queued;
+    }
+
+  if (queued > SEND_QUEUE_HIGH_WATER)
+    {
+      TRACE_MSG("Send queue overflow " << (client->id != NULL ? client->id : "Unknown") << " " << queued);
+      client->send_overflow = true;
+      client->send_queue.clear();
+      send_stats.overflows++;
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Writes as much of the send queue of a client as its socket accepts.
+void
+DistributionSocketLink::flush_client(Client *client)
+{
+  TRACE_ENTER("DistributionSocketLink::flush_client");
+
+  if (client->socket == NULL)
+    {
+      client->send_queue.clear();
+      TRACE_RETURN("Not connected");
+      return;
+    }
+
+  try
+    {
+      send_stats.bytes_written += client->send_queue.flush(client->socket);
+    }
+  catch (SocketException &)
+    {
+      // The read side notices the broken connection.
+      TRACE_MSG("Failed to send");
+      client->send_queue.clear();
+    }
+
+  if (!client->send_queue.empty())
+    {
+      send_stats.blocked++;
+    }
+
+  client->socket->set_write_notify(!client->send_queue.empty());
+
+  TRACE_EXIT();
+}
+
 
-      int bytes_written = 0;
-      try
+//! Disconnects all clients whose send queue overflowed.
+void
+DistributionSocketLink::close_overflowed_clients()
+{
+  bool done = false;
+  while (!done)
+    {
+      // Closing a client may remove other clients.
+      Client *overflowed = NULL;
+      for (list<Client *>::iterator i = clients.begin(); overflowed == NULL && i != clients.end(); i++)
         {
-          client->socket->write(packet.get_buffer(), size, bytes_written);
+          if ((*i)->send_overflow)
+            {
+              overflowed = *i;
+            }
         }
-      catch (SocketException &)
+
+      if (overflowed != NULL)
         {
-          TRACE_MSG("Failed to send");
+          dist_manager->log(_("Client %s cannot keep up, reconnecting."),
+                            overflowed->id == NULL ? "Unknown" : overflowed->id);
+
+          overflowed->send_overflow = false;
+          close_client(overflowed, overflowed->outbound);
         }
+      done = (overflowed == NULL);
     }
+}
 
+
+//! Returns the counters of the send queues.
+void
+DistributionSocketLink::get_send_stats(SendStats &stats) const
+{
+  stats = send_stats;
+  stats.queued = 0;
+
+  for (list<Client *>::const_iterator i = clients.begin(); i != clients.end(); i++)
+    {
+      stats.queued += (*i)->send_queue.get_size();
+    }
+}
+
+
+//! Traces the counters of the send queues.
+void
+DistributionSocketLink::trace_send_stats() const
+{
+  TRACE_ENTER("DistributionSocketLink::trace_send_stats");
+
+  SendStats stats;
+  get_send_stats(stats);
+
+  TRACE_MSG("packets " << stats.packets << " bytes " << stats.bytes
+            << " written " << stats.bytes_written << " blocked " << stats.blocked
+            << " overflows " << stats.overflows << " queued " << stats.queued
+            << " peak " << stats.peak);
   TRACE_EXIT();
 }
 
 
 //! Processed an incoming packet.
 void
-DistributionSocketLink::process_client_packet(Client *client)
+DistributionSocketLink::process_client_packet(Client *client, PacketBuffer &packet)
 {
   TRACE_ENTER("DistributionSocketLink::process_client_packet");
-  PacketBuffer &packet = client->packet;
 
   client->claim_count = 0;
 
+  // The length of a long packet is in its extended header.
   gint size = packet.unpack_ushort();
-  g_assert(size == packet.bytes_written());
+  g_assert(size == packet.bytes_written() || size == 0);
 
   gint version = packet.unpack_byte();
   gint flags = packet.unpack_byte();
@@ -1188,9 +1537,20 @@ DistributionSocketLink::process_client_packet(Client *client)
 
           source = NULL;
         }
+      else
+        {
+          // Addressed to me, so do not pass it on.
+          forward = false;
+        }
         g_free(id);
     }
 
+  if (source != NULL)
+    {
+      // The routed source answered as well.
+      source->claim_count = 0;
+    }
+
   TRACE_MSG("size = " << size << ", version = " << version << ", flags = " << flags);
 
   if (source != NULL || type == PACKET_CLIENT_LIST)
@@ -1232,6 +1592,10 @@ DistributionSocketLink::process_client_packet(Client *client)
           handle_client_message(packet, source);
           break;
 
+        case PACKET_CLIENTMSG_CHUNK:
+          handle_client_message_chunk(packet, source);
+          break;
+
         case PACKET_DUPLICATE:
           handle_duplicate(packet, source);
           forward = false;
@@ -1242,20 +1606,12 @@ DistributionSocketLink::process_client_packet(Client *client)
           break;
         }
 
-      if (forward &&
-          find(clients.begin(), clients.end(), client) != clients.end())
+      if (forward && is_client_valid(client))
         {
           forward_packet_except(packet, client, source);
         }
     }
 
-  if (find(clients.begin(), clients.end(), client) != clients.end())
-    {
-      // hack... client may have been removed...
-      packet.clear();
-      packet.resize(0);
-    }
-  
   TRACE_EXIT();
 }
 
@@ -1331,6 +1687,7 @@ DistributionSocketLink::send_hello1(Client *client)
   packet.pack_string(username);
   packet.pack_string(get_my_id());
   packet.pack_string(rnd);
+  packet.pack_byte(PROTOCOL_VERSION);
 
   send_packet(client, packet);
   TRACE_EXIT();
@@ -1347,7 +1704,14 @@ DistributionSocketLink::handle_hello1(PacketBuffer &packet, Client *client)
   gchar *id = packet.unpack_string();
   gchar *rnd = packet.unpack_string();
 
-  TRACE_MSG(user << " " << id << " " << rnd);
+  // Clients older than version 4 do not send their version.
+  if (packet.bytes_available() > 0)
+    {
+      int version = packet.unpack_byte();
+      client->version = MIN(version, (int)PROTOCOL_VERSION);
+    }
+
+  TRACE_MSG(user << " " << id << " " << rnd << " " << client->version);
   
   dist_manager->log(_("Client %s saying hello."), id != NULL ? id : "Unknown");
   
@@ -1390,6 +1754,7 @@ DistributionSocketLink::send_hello2(Client *client, gchar *rnd)
   packet.pack_string(username);
   packet.pack_string(g_hmac_get_string(hmac));
   packet.pack_string(get_my_id());
+  packet.pack_byte(PROTOCOL_VERSION);
 
   g_hmac_unref (hmac);
 
@@ -1408,7 +1773,13 @@ DistributionSocketLink::handle_hello2(PacketBuffer &packet, Client *client)
   gchar *pass = packet.unpack_string();
   gchar *id = packet.unpack_string();
 
-  TRACE_MSG(user << " " << pass << " " << id << " " << client->challenge);
+  if (packet.bytes_available() > 0)
+    {
+      int version = packet.unpack_byte();
+      client->version = MIN(version, (int)PROTOCOL_VERSION);
+    }
+
+  TRACE_MSG(user << " " << pass << " " << id << " " << client->challenge << " " << client->version);
   
   dist_manager->log(_("Client %s saying hello."), id != NULL ? id : "Unknown");
 
@@ -1428,6 +1799,7 @@ DistributionSocketLink::handle_hello2(PacketBuffer &packet, Client *client)
           // Welcome!
           send_welcome(client);
           client->welcome = true;
+          client->reader.set_long_packets_enabled(client->version >= PROTOCOL_VERSION_4);
         }
       else
         {
@@ -1527,6 +1899,7 @@ DistributionSocketLink::handle_signoff(PacketBuffer &packet, Client *client)
             {
               TRACE_MSG("Remove connection");
               delete c->socket;
+              c->reset_connection();
               c->socket = NULL;
             }
 
@@ -1612,7 +1985,8 @@ DistributionSocketLink::handle_welcome(PacketBuffer &packet, Client *client)
   if (ok)
     {
       client->welcome = true;
-      
+      client->reader.set_long_packets_enabled(client->version >= PROTOCOL_VERSION_4);
+
       // The connected client offers the master client.
       // This info will be received in the client list.
       // So, we no longer know who's master...
@@ -1664,6 +2038,7 @@ DistributionSocketLink::send_client_list(Client *client, bool except)
       packet.pack_string(get_my_id());         // ID
       packet.pack_string(get_my_id());         // Canonical name
       packet.pack_ushort(server_port);         // Listen port.
+      packet.pack_ushort(master_epoch);        // Master epoch.
 
       // Size of the client data.
       packet.poke_ushort(pos, packet.bytes_written() - pos);
@@ -1692,6 +2067,7 @@ DistributionSocketLink::send_client_list(Client *client, bool except)
               packet.pack_string(c->id);        // ID
               packet.pack_string(c->hostname);  // Canonical name
               packet.pack_ushort(c->port);      // Listen port.
+              packet.pack_ushort(master_epoch); // Master epoch.
 
               // Size of the client data.
               packet.poke_ushort(pos, packet.bytes_written() - pos);
@@ -1722,7 +2098,9 @@ DistributionSocketLink::handle_client_list(PacketBuffer &packet, Client *client,
 {
   TRACE_ENTER("DistributionSocketLink::handle_client_list");
 
-  if (!client->welcome)
+  // The list of a client that is not yet known introduces the client. It
+  // is trusted if the connected client that passed it on is.
+  if (!(client != NULL ? client : direct)->welcome)
     {
       TRACE_EXIT();
       return false;;
@@ -1734,6 +2112,7 @@ DistributionSocketLink::handle_client_list(PacketBuffer &packet, Client *client,
   (void) flags;
 
   gchar *master_id = NULL;
+  gint epoch = 0;
 
   gchar **names = new gchar*[num_clients];
   gchar **ids = new gchar*[num_clients];
@@ -1760,6 +2139,11 @@ DistributionSocketLink::handle_client_list(PacketBuffer &packet, Client *client,
         {
           master_id = g_strdup(id);
           TRACE_MSG("Master: " << master_id);
+
+          if (size - (packet.bytes_read() - pos) >= 2)
+            {
+              epoch = packet.unpack_ushort();
+            }
         }
 
       if (id != NULL)
@@ -1798,21 +2182,67 @@ DistributionSocketLink::handle_client_list(PacketBuffer &packet, Client *client,
         }
 
       TRACE_MSG("Adding: ");
+      list<Client *> new_clients;
       for (int i = 0; i < num_clients; i++)
         {
           if (ids[i] != NULL && names[i] != NULL)
             {
               add_client(ids[i], names[i], ports[i], CLIENTTYPE_ROUTED, direct);
+
+              Client *c = find_client_by_id(ids[i]);
+              if (c != NULL)
+                {
+                  new_clients.push_back(c);
+                }
             }
         }
 
-      if (master_id != NULL)
+      if (master_id != NULL && is_master_epoch_stale(epoch, master_id))
+        {
+          TRACE_MSG("Stale master " << master_id << ", current epoch " << master_epoch);
+
+          if (i_am_master)
+            {
+              // Make the stale master step down.
+              send_new_master(client != NULL ? client : direct);
+            }
+        }
+      else if (master_id != NULL)
         {
+          if (epoch != 0)
+            {
+              master_epoch = epoch;
+            }
           set_master_by_id(master_id);
           TRACE_MSG(master_id << " is now master");
         }
 
-      send_client_message(DCMT_SIGNON);
+      // The master state goes along with the signon state, so that the
+      // master does not have to send it again for each client that signs on.
+      DistributionClientMessageType type = DCMT_SIGNON;
+      if (i_am_master)
+        {
+          type = (DistributionClientMessageType)(DCMT_SIGNON | DCMT_MASTER);
+        }
+
+      if (client != NULL && direct == client)
+        {
+          // Connected to a new client, so all clients must know my state.
+          send_client_message(type);
+        }
+      else if (new_clients.size() > MAX_SIGNON_UNICASTS)
+        {
+          send_client_message(type);
+        }
+      else
+        {
+          // Only the clients that joined elsewhere in the network need my
+          // state. The others already have it.
+          for (list<Client *>::iterator i = new_clients.begin(); i != new_clients.end(); i++)
+            {
+              send_client_message(type, *i);
+            }
+        }
     }
   else
     {
@@ -1859,7 +2289,7 @@ DistributionSocketLink::send_claim(Client *client)
       packet.create();
       init_packet(packet, PACKET_CLAIM);
 
-      packet.pack_ushort(0);
+      packet.pack_ushort(master_epoch);
 
       client->next_claim_time = time(NULL) + 10;
 
@@ -1893,7 +2323,7 @@ DistributionSocketLink::handle_claim(PacketBuffer &packet, Client *client)
   
   /*gint count = */ packet.unpack_ushort();
 
-  if (i_am_master && master_locked)
+  if (i_am_master && time(NULL) < master_lease_time)
     {
       dist_manager->log(_("Rejecting master request from client %s."),
                         client->id == NULL ? "Unknown" : client->id);
@@ -1909,6 +2339,7 @@ DistributionSocketLink::handle_claim(PacketBuffer &packet, Client *client)
       // Marks client as master
       set_master(client);
       assert(!i_am_master);
+      advance_master_epoch();
 
       // If I was previously master, distribute state.
       if (was_master)
@@ -1938,6 +2369,10 @@ DistributionSocketLink::send_claim_reject(Client *client)
   packet.create();
   init_packet(packet, PACKET_CLAIM_REJECT);
 
+  // Remaining time of my lease.
+  time_t lease = master_lease_time - time(NULL);
+  packet.pack_ushort(lease > 0 ? lease : 0);
+
   send_packet(client, packet);
   TRACE_EXIT();
 }
@@ -1948,7 +2383,6 @@ void
 DistributionSocketLink::handle_claim_reject(PacketBuffer &packet, Client *client)
 {
   TRACE_ENTER("DistributionSocketLink::handle_claim");
-  (void) packet;
 
   if (!client->welcome)
     {
@@ -1965,15 +2399,25 @@ DistributionSocketLink::handle_claim_reject(PacketBuffer &packet, Client *client
     {
       dist_manager->log(_("Client %s rejected master request, delaying."),
                         client->id == NULL ? "Unknown" : client->id);
-      client->reject_count++;
-      int count = client->reject_count;
 
-      if (count > 6)
+      if (packet.bytes_available() >= 2)
         {
-          count = 6;
+          // Claim again as soon as the lease of the master expires.
+          gint lease = packet.unpack_ushort();
+          client->next_claim_time = time(NULL) + MAX(lease, 1);
         }
+      else
+        {
+          client->reject_count++;
+          int count = client->reject_count;
+
+          if (count > 6)
+            {
+              count = 6;
+            }
 
-      client->next_claim_time = time(NULL) + 5 * count;
+          client->next_claim_time = time(NULL) + 5 * count;
+        }
     }
 
   TRACE_EXIT();
@@ -2004,7 +2448,7 @@ DistributionSocketLink::send_new_master(Client *client)
     }
 
   packet.pack_string(id);
-  packet.pack_ushort(0);
+  packet.pack_ushort(master_epoch);
 
   if (client != NULL)
     {
@@ -2037,17 +2481,34 @@ DistributionSocketLink::handle_new_master(PacketBuffer &packet, Client *client)
     }
 
   gchar *id = packet.unpack_string();
-  /* gint count = */ packet.unpack_ushort();
-
-  dist_manager->log(_("Client %s is now the new master."),
-                    id == NULL ? "Unknown" : id);
+  gint epoch = packet.unpack_ushort();
 
   if (client->id != NULL)
     {
-      TRACE_MSG("new master from " << client->id << " -> " << id);
+      TRACE_MSG("new master from " << client->id << " -> " << id << " " << epoch);
+    }
+
+  if (is_master_epoch_stale(epoch, id))
+    {
+      TRACE_MSG("Stale master, current epoch " << master_epoch);
+
+      if (i_am_master)
+        {
+          // Make the client step down.
+          send_new_master(client);
+        }
     }
+  else
+    {
+      dist_manager->log(_("Client %s is now the new master."),
+                        id == NULL ? "Unknown" : id);
 
-  set_master_by_id(id);
+      if (epoch != 0)
+        {
+          master_epoch = epoch;
+        }
+      set_master_by_id(id);
+    }
 
   g_free(id);
 
@@ -2057,7 +2518,7 @@ DistributionSocketLink::handle_new_master(PacketBuffer &packet, Client *client)
 
 // Distributes the current client message.
 void
-DistributionSocketLink::send_client_message(DistributionClientMessageType type)
+DistributionSocketLink::send_client_message(DistributionClientMessageType type, Client *to)
 {
   TRACE_ENTER("DistributionSocketLink:send_client_message");
 
@@ -2088,12 +2549,29 @@ DistributionSocketLink::send_client_message(DistributionClientMessageType type)
           itf->request_client_message(id, packet);
         }
 
+      int size = packet.bytes_written() - pos - 2;
+      if (size > MAX_SHORT_PACKET_SIZE)
+        {
+          // Too long for a client message entry. Send it in chunks and
+          // leave the entry empty.
+          guint8 *data = (guint8 *)packet.get_buffer() + pos + 2;
+          send_client_message_chunks(id, data, size, to);
+          packet.write_ptr = data;
+        }
+
       packet.update_size(pos);
 
       i++;
     }
 
-  send_packet_broadcast(packet);
+  if (to != NULL)
+    {
+      send_packet(to, packet);
+    }
+  else
+    {
+      send_packet_broadcast(packet);
+    }
   TRACE_EXIT();
 }
 
@@ -2156,6 +2634,119 @@ DistributionSocketLink::handle_client_message(PacketBuffer &packet, Client *clie
 }
 
 
+//! Sends a long client message in chunks to all clients that support it.
+/*!
+ *  \param to client to send the message to, or NULL to send it to all clients.
+ */
+void
+DistributionSocketLink::send_client_message_chunks(DistributionClientMessageID id, const guint8 *data, int size,
+                                                   Client *to)
+{
+  TRACE_ENTER_MSG("DistributionSocketLink::send_client_message_chunks", id << " " << size);
+
+  string master = get_master();
+
+  for (int offset = 0; offset < size; offset += CLIENTMSG_CHUNK_SIZE)
+    {
+      int chunk_size = MIN(CLIENTMSG_CHUNK_SIZE, size - offset);
+
+      PacketBuffer packet;
+      packet.create(chunk_size + 128);
+      init_packet(packet, PACKET_CLIENTMSG_CHUNK);
+
+      packet.pack_string(master);
+      packet.pack_ushort(id);
+      packet.pack_ulong(size);
+      packet.pack_ulong(offset);
+      packet.pack(data + offset, chunk_size);
+
+      if (to != NULL)
+        {
+          send_packet(to, packet);
+        }
+      else
+        {
+          send_packet_broadcast(packet);
+        }
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Handles a chunk of a long client message.
+/*!
+ *  The chunks of a message are sent consecutively, so only one message
+ *  per source client is received at a time.
+ */
+void
+DistributionSocketLink::handle_client_message_chunk(PacketBuffer &packet, Client *client)
+{
+  TRACE_ENTER("DistributionSocketLink:handle_client_message_chunk");
+
+  if (!client->welcome)
+    {
+      TRACE_EXIT();
+      return;
+    }
+
+  gchar *master = packet.unpack_string();
+  gint id = packet.unpack_ushort();
+  guint32 total = packet.unpack_ulong();
+  guint32 offset = packet.unpack_ulong();
+
+  int pos = 0;
+  int size = packet.read_size(pos);
+
+  TRACE_MSG("id = " << id << " " << offset << "/" << total << " " << size);
+
+  bool ok = (total > 0 && total <= MAX_CHUNKED_CLIENTMSG_SIZE &&
+             size <= packet.bytes_available() &&
+             offset + size <= total);
+
+  if (ok && offset == 0)
+    {
+      client->chunk.create(total);
+      client->chunk_id = id;
+    }
+
+  ok = ok && client->chunk_id == id && client->chunk.bytes_written() == (int)offset;
+
+  if (ok)
+    {
+      client->chunk.pack_raw(packet.read_ptr, size);
+
+      if (client->chunk.bytes_written() == (int)total)
+        {
+          ClientMessageMap::iterator it = client_message_map.find((DistributionClientMessageID)id);
+          if (it != client_message_map.end())
+            {
+              bool will_i_become_master = master != NULL && client_is_me(master);
+              it->second.listener->client_message((DistributionClientMessageID)id, will_i_become_master,
+                                                  client->id, client->chunk);
+            }
+
+          // Client may have been removed.
+          if (is_client_valid(client))
+            {
+              client->chunk.create();
+              client->chunk_id = -1;
+            }
+        }
+    }
+  else
+    {
+      TRACE_MSG("Dropping chunk");
+      client->chunk.create();
+      client->chunk_id = -1;
+    }
+
+  g_free(master);
+
+  TRACE_EXIT();
+}
+
+
 bool
 DistributionSocketLink::start_async_server()
 {
@@ -2197,9 +2788,6 @@ DistributionSocketLink::socket_accepted(ISocketServer *scon, ISocket *ccon)
       Client *client =  new Client;
       client->type = CLIENTTYPE_DIRECT;
       client->peer = NULL;
-      client->packet.create();
-
-      TRACE_RETURN(client->packet.bytes_available());
       client->socket = ccon;
       client->hostname = NULL;
       client->id = NULL;
@@ -2210,6 +2798,7 @@ DistributionSocketLink::socket_accepted(ISocketServer *scon, ISocket *ccon)
       ccon->set_data(client);
       ccon->set_listener(this);
       clients.push_back(client);
+      index_client(client);
 
       send_hello1(client);
     }
@@ -2226,8 +2815,6 @@ DistributionSocketLink::socket_io(ISocket *con, void *data)
   Client *client = (Client *)data;
   g_assert(client != NULL);
 
-  TRACE_MSG("1");
-
   if (!is_client_valid(client) && client->type == CLIENTTYPE_DIRECT)
     {
       TRACE_RETURN("Invalid client");
@@ -2235,31 +2822,10 @@ DistributionSocketLink::socket_io(ISocket *con, void *data)
     }
 
   int bytes_read = 0;
-  int bytes_to_read = 4;
-
-  TRACE_MSG("2 " << client->packet.bytes_available() );
-
-  if (client->packet.bytes_available() >= 4)
-    {
-      TRACE_MSG("3");
-
-      bytes_to_read = client->packet.peek_ushort(0) - 4;
-
-      TRACE_MSG("4 " << bytes_to_read);
-
-      if (bytes_to_read + 4 > client->packet.get_buffer_size())
-        {
-          TRACE_MSG("5 " << bytes_to_read << " " << client->packet.get_buffer_size());
-          // FIXME: the 1024 is lame...
-          client->packet.resize(bytes_to_read + 4 + 1024);
-        }
-    }
-
-  TRACE_MSG("5");
   bool ok = true;
   try
     {
-      con->read(client->packet.get_write_ptr(), bytes_to_read, bytes_read);
+      bytes_read = client->reader.read(con);
     }
   catch (SocketException &)
     {
@@ -2280,12 +2846,25 @@ DistributionSocketLink::socket_io(ISocket *con, void *data)
     }
   else
     {
-      g_assert(bytes_read > 0);
-      client->packet.write_ptr += bytes_read;
+      // Process all complete packets. Processing a packet may close or
+      // remove the client, which invalidates the remaining data.
+      PacketBuffer packet;
+      while (client->reader.next(packet))
+        {
+          process_client_packet(client, packet);
+
+          if (!is_client_valid(client) || client->socket != con)
+            {
+              TRACE_RETURN("Client closed");
+              return;
+            }
+        }
 
-      if (client->packet.peek_ushort(0) == client->packet.bytes_written())
+      if (!client->reader.is_valid())
         {
-          process_client_packet(client);
+          dist_manager->log(_("Client %s sent an invalid packet, closing."),
+                            client->id == NULL ? "Unknown" : client->id);
+          ret = false;
         }
     }
 
@@ -2360,6 +2939,28 @@ DistributionSocketLink::socket_closed(ISocket *con, void *data)
 }
 
 
+//! Socket can accept more data.
+void
+DistributionSocketLink::socket_writable(ISocket *con, void *data)
+{
+  TRACE_ENTER("DistributionSocketLink::socket_writable");
+  (void) con;
+
+  Client *client = (Client *)data;
+  g_assert(client != NULL);
+
+  if (!is_client_valid(client) && client->type == CLIENTTYPE_DIRECT)
+    {
+      TRACE_RETURN("Invalid client");
+      return;
+    }
+
+  flush_client(client);
+
+  TRACE_EXIT();
+}
+
+
 //! Read the configuration from the configurator.
 void
 DistributionSocketLink::read_configuration()
@@ -21,6 +21,7 @@
 
 #include <list>
 #include <map>
+#include <set>
 
 #if TIME_WITH_SYS_TIME
 # include <sys/time.h>
@@ -37,6 +38,8 @@
 #include "IDistributionClientMessage.hh"
 #include "IConfiguratorListener.hh"
 #include "PacketBuffer.hh"
+#include "PacketQueue.hh"
+#include "PacketReader.hh"
 
 #include "SocketDriver.hh"
 #include "WRID.hh"
@@ -44,6 +47,15 @@
 #define DEFAULT_PORT (27273)
 #define DEFAULT_INTERVAL (15)
 #define DEFAULT_ATTEMPTS (5)
+#define SEND_QUEUE_HIGH_WATER (256 * 1024)
+#define MAX_SHORT_PACKET_SIZE (0xffff)
+#define CLIENTMSG_CHUNK_SIZE (32 * 1024)
+#define MAX_CHUNKED_CLIENTMSG_SIZE (16 * 1024 * 1024)
+#define MAX_SIGNON_UNICASTS (4)
+#define SEND_STATS_TRACE_INTERVAL (60)
+// The lease is renewed every second, and time(NULL) truncates to whole
+// seconds, so it must span several renewals.
+#define MASTER_LEASE_TIME (5)
 
 class Configurator;
 
@@ -66,6 +78,18 @@ private:
     PACKET_CLAIM_REJECT = 0x0008,
     PACKET_SIGNOFF      = 0x0009,
     PACKET_HELLO2       = 0x000A,
+    PACKET_CLIENTMSG_CHUNK = 0x000B,
+  };
+
+  enum ProtocolVersion {
+    //! Packets of at most 64 KiB.
+    PROTOCOL_VERSION_3  = 3,
+
+    //! Long packets and chunked client messages.
+    PROTOCOL_VERSION_4  = 4,
+
+    //! Version supported by this client.
+    PROTOCOL_VERSION    = PROTOCOL_VERSION_4,
   };
 
   enum PacketFlags {
@@ -115,7 +139,10 @@ private:
       next_claim_time(0),
       reject_count(0),
       claim_count(0),
-      outbound(false)
+      outbound(false),
+      send_overflow(false),
+      version(PROTOCOL_VERSION_3),
+      chunk_id(-1)
     {
     }
 
@@ -132,6 +159,15 @@ private:
       hostname = NULL;
     }
 
+    //! Discards the state of the connection with the client.
+    void reset_connection()
+    {
+      send_queue.clear();
+      send_overflow = false;
+      reader.clear();
+      version = PROTOCOL_VERSION_3;
+    }
+
     //! Type of connection with client.
     ClientType type;
 
@@ -159,8 +195,8 @@ private:
     //!
     bool welcome;
 
-    //!
-    PacketBuffer packet;
+    //! Splits the received data into packets.
+    PacketReader reader;
 
     //! Reconnect counter;
     int reconnect_count;
@@ -179,10 +215,50 @@ private:
 
     //! Is this an outbound connection
     bool outbound;
+
+    //! Packets waiting to be written to the socket.
+    PacketQueue send_queue;
+
+    //! Did the send queue exceed the high-water mark?
+    bool send_overflow;
+
+    //! Protocol version of the connection.
+    int version;
+
+    //! Client message that is being received in chunks.
+    gint chunk_id;
+
+    //! Chunks received so far.
+    PacketBuffer chunk;
   };
 
 
 public:
+  //! Counters of the send queues.
+  struct SendStats
+  {
+    //! Number of packets queued, counted once per recipient.
+    gint64 packets;
+
+    //! Number of bytes queued.
+    gint64 bytes;
+
+    //! Number of bytes written to sockets.
+    gint64 bytes_written;
+
+    //! Number of times a socket could not accept all queued data.
+    gint64 blocked;
+
+    //! Number of connections closed because the queue exceeded the high-water mark.
+    gint64 overflows;
+
+    //! Number of bytes currently queued.
+    gint64 queued;
+
+    //! Largest number of bytes ever queued for one client.
+    gint64 peak;
+  };
+
   DistributionSocketLink(Configurator *conf);
   virtual ~DistributionSocketLink();
 
@@ -206,14 +282,20 @@ public:
                                IDistributionClientMessage *callback);
   bool unregister_client_message(DistributionClientMessageID id);
   bool broadcast_client_message(DistributionClientMessageID id, PacketBuffer &buffer);
+  bool unicast_client_message(DistributionClientMessageID id, PacketBuffer &buffer, string client_id);
+  void get_send_stats(SendStats &stats) const;
+  void trace_send_stats() const;
 
   void socket_accepted(ISocketServer *server, ISocket *con);
   void socket_connected(ISocket *con, void *data);
   void socket_io(ISocket *con, void *data);
   void socket_closed(ISocket *con, void *data);
+  void socket_writable(ISocket *con, void *data);
 
 private:
   bool is_client_valid(Client *client);
+  void index_client(Client *client);
+  void unindex_client(Client *client);
   bool add_client(gchar *id, gchar *host, gint port, ClientType type, Client *peer = NULL);
   void remove_client(Client *client);
   void remove_peer_clients(Client *client);
@@ -229,15 +311,21 @@ private:
   void set_master_by_id(gchar *id);
   void set_master(Client *client);
   void set_me_master();
+  void advance_master_epoch();
+  bool is_master_epoch_stale(gint epoch, const gchar *id);
 
   void init_packet(PacketBuffer &packet, PacketCommand cmd);
   void send_packet_broadcast(PacketBuffer &packet);
   void send_packet_except(PacketBuffer &packet, Client *client);
   void send_packet(Client *client, PacketBuffer &packet);
+  SharedPacket *create_shared_packet(PacketBuffer &packet, int &version);
+  void queue_packet(Client *client, SharedPacket *packet);
+  void flush_client(Client *client);
+  void close_overflowed_clients();
   void forward_packet_except(PacketBuffer &packet, Client *client, Client *source);
   void forward_packet(PacketBuffer &packet, Client *dest, Client *source);
 
-  void process_client_packet(Client *client);
+  void process_client_packet(Client *client, PacketBuffer &packet);
   void handle_hello1(PacketBuffer &packet, Client *client);
   void handle_hello2(PacketBuffer &packet, Client *client);
   void handle_signoff(PacketBuffer &packet, Client *client);
@@ -247,6 +335,7 @@ private:
   void handle_claim(PacketBuffer &packet, Client *client);
   void handle_new_master(PacketBuffer &packet, Client *client);
   void handle_client_message(PacketBuffer &packet, Client *client);
+  void handle_client_message_chunk(PacketBuffer &packet, Client *client);
   void handle_claim_reject(PacketBuffer &packet, Client *client);
 
   void send_hello1(Client *client);
@@ -258,7 +347,9 @@ private:
   void send_claim(Client *client);
   void send_new_master(Client *client = NULL);
   void send_claim_reject(Client *client);
-  void send_client_message(DistributionClientMessageType type);
+  void send_client_message(DistributionClientMessageType type, Client *to = NULL);
+  bool send_client_message(DistributionClientMessageID id, PacketBuffer &buffer, Client *to);
+  void send_client_message_chunks(DistributionClientMessageID id, const guint8 *data, int size, Client *to);
 
   bool start_async_server();
 
@@ -269,6 +360,7 @@ private:
   
 private:
   typedef map<DistributionClientMessageID, ClientMessageListener> ClientMessageMap;
+  typedef multimap<string, Client *> ClientIndex;
 
   //! The distribution manager.
   DistributionManager *dist_manager;
@@ -290,14 +382,26 @@ private:
   //! All clients.
   list<Client *> clients;
 
+  //! All clients, for validity checks.
+  set<Client *> client_set;
+
+  //! Clients by ID.
+  ClientIndex clients_by_id;
+
+  //! Clients by canonical name and port.
+  ClientIndex clients_by_name;
+
   //! Active client
   Client *master_client;
 
   //! Whether I'm the master.
   bool i_am_master;
 
-  //! Whether the master status is locked by me.
-  bool master_locked;
+  //! Time at which my lease on the master status expires.
+  time_t master_lease_time;
+
+  //! Number of the last master change, or 0 if unknown.
+  guint16 master_epoch;
 
   //! My name
   //gchar *myname;
@@ -326,6 +430,9 @@ private:
 
   //!
   int heartbeat_count;
+
+  //! Send queue counters.
+  SendStats send_stats;
 };
 
 #endif // DISTRIBUTIONSOCKETLINK_HH
@@ -188,10 +188,42 @@ GIOSocket::static_data_callback(GSocket *socket,
   return ret;
 }
 
+
+gboolean
+GIOSocket::static_write_callback(GSocket *socket,
+                                 GIOCondition condition,
+                                 gpointer user_data)
+{
+  TRACE_ENTER_MSG("GIOSocket::static_write_callback", (int)condition);
+
+  GIOSocket *giosocket = (GIOSocket *)user_data;
+
+  (void) socket;
+  (void) condition;
+
+  try
+    {
+      if (giosocket->listener != NULL)
+        {
+          giosocket->listener->socket_writable(giosocket, giosocket->user_data);
+        }
+    }
+  catch(...)
+    {
+      // Make sure that no exception reach the glib mainloop.
+    }
+
+  // The source is removed by set_write_notify.
+  TRACE_EXIT();
+  return TRUE;
+}
+
+
 //! Creates a new connection.
 GIOSocket::GIOSocket(GSocketConnection *connection) :
   connection(connection),
-  resolver(NULL)
+  resolver(NULL),
+  write_source(NULL)
 {
   TRACE_ENTER("GIOSocket::GIOSocket(con)");
   socket = g_socket_connection_get_socket(connection);
@@ -214,6 +246,7 @@ GIOSocket::GIOSocket() :
   socket(NULL),
   resolver(NULL),
   source(NULL),
+  write_source(NULL),
   port(0)
 {
   TRACE_ENTER("GIOSocket::GIOSocket()");
@@ -225,6 +258,7 @@ GIOSocket::GIOSocket() :
 GIOSocket::~GIOSocket()
 {
   TRACE_ENTER("GIOSocket::~GIOSocket");
+  set_write_notify(false);
   if (connection != NULL)
     {
       g_object_unref(connection);
@@ -339,16 +373,75 @@ void
 GIOSocket::write(void *buf, int count, int &bytes_written)
 {
   GError *error = NULL;
-  gsize num_written = 0;
+  gssize num_written = 0;
   if (socket != NULL)
     {
       num_written = g_socket_send(socket, (char *)buf, count, NULL, &error);
-      if (error != NULL)
+      check_write_error(error);
+    }
+  bytes_written = num_written > 0 ? (int) num_written : 0;
+}
+
+
+//! Write several buffers to the connection using a single system call.
+void
+GIOSocket::writev(const SocketBuffer *buffers, int count, int &bytes_written)
+{
+  if (socket == NULL)
+    {
+      throw SocketException("socket not connected");
+    }
+
+  GOutputVector *vectors = g_new(GOutputVector, count);
+  for (int i = 0; i < count; i++)
+    {
+      vectors[i].buffer = buffers[i].data;
+      vectors[i].size = buffers[i].size;
+    }
+
+  GError *error = NULL;
+  gssize num_written = g_socket_send_message(socket, NULL, vectors, count, NULL, 0, 0, NULL, &error);
+  g_free(vectors);
+
+  check_write_error(error);
+  bytes_written = num_written > 0 ? (int) num_written : 0;
+}
+
+
+//! Throws an exception for all write errors except a full connection.
+void
+GIOSocket::check_write_error(GError *error)
+{
+  if (error != NULL)
+    {
+      bool would_block = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+      string message = error->message;
+      g_error_free(error);
+
+      if (!would_block)
         {
-          throw SocketException(string("socket write error: ") + error->message);
+          throw SocketException(string("socket write error: ") + message);
         }
     }
-  bytes_written = (int) num_written;
+}
+
+
+//! Enables or disables notification that the connection is writable.
+void
+GIOSocket::set_write_notify(bool enabled)
+{
+  if (enabled && write_source == NULL && socket != NULL)
+    {
+      write_source = g_socket_create_source(socket, G_IO_OUT, NULL);
+      g_source_set_callback(write_source, reinterpret_cast<GSourceFunc>(static_write_callback), (void*)this, NULL);
+      g_source_attach(write_source, NULL);
+    }
+  else if (!enabled && write_source != NULL)
+    {
+      g_source_destroy(write_source);
+      g_source_unref(write_source);
+      write_source = NULL;
+    }
 }
 
 
@@ -358,6 +451,7 @@ GIOSocket::close()
 {
   TRACE_ENTER("GIOSocket::close");
   GError *error = NULL;
+  set_write_notify(false);
   if (socket != NULL)
     {
       g_socket_shutdown(socket, TRUE, TRUE, &error);
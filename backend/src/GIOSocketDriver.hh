@@ -65,10 +65,13 @@ public:
   virtual void connect(const std::string &hostname, int port);
   virtual void read(void *buf, int count, int &bytes_read);
   virtual void write(void *buf, int count, int &bytes_written);
+  virtual void writev(const SocketBuffer *buffers, int count, int &bytes_written);
+  virtual void set_write_notify(bool enabled);
   virtual void close();
 
 private:
   void connect(GInetAddress *inet_addr, int port);
+  void check_write_error(GError *error);
 
   static void static_connect_after_resolve(GObject *source_object, GAsyncResult *res, gpointer user_data);
 
@@ -80,11 +83,16 @@ private:
                                    GIOCondition condition,
                                    gpointer user_data);
 
+  static gboolean static_write_callback(GSocket *socket,
+                                        GIOCondition condition,
+                                        gpointer user_data);
+
 private:
   GSocketConnection *connection;
   GSocket *socket;
   GResolver *resolver;
   GSource *source;
+  GSource *write_source;
   int port;
 };
 
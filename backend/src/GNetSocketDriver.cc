@@ -140,6 +140,15 @@ GNetSocket::async_io(GIOChannel *iochannel, GIOCondition condition)
           ret = false;
         }
 
+      // process output first, processing input may delete the socket.
+      if (ret && (condition & G_IO_OUT))
+        {
+          if (listener != NULL)
+            {
+              listener->socket_writable(this, user_data);
+            }
+        }
+
       // process input
       if (ret && (condition & G_IO_IN))
         {
@@ -293,7 +302,7 @@ GNetSocket::write(void *buf, int count, int &bytes_written)
   gsize num_written = 0;
   GIOError error = g_io_channel_write(iochannel, (char *)buf, (gsize)count, &num_written);
 
-  if (error != G_IO_ERROR_NONE)
+  if (error != G_IO_ERROR_NONE && error != G_IO_ERROR_AGAIN)
     {
       throw SocketException("write error");
     }
@@ -302,6 +311,30 @@ GNetSocket::write(void *buf, int count, int &bytes_written)
 }
 
 
+//! Enables or disables notification that the connection is writable.
+void
+GNetSocket::set_write_notify(bool enabled)
+{
+  if (watch != 0)
+    {
+      set_watch_flags(enabled ? (watch_flags | G_IO_OUT) : (watch_flags & ~G_IO_OUT));
+    }
+}
+
+
+//! Changes the I/O events we are monitoring.
+void
+GNetSocket::set_watch_flags(gint flags)
+{
+  if (flags != watch_flags)
+    {
+      g_source_remove(watch);
+      watch_flags = flags;
+      watch = g_io_add_watch(iochannel, (GIOCondition) watch_flags, static_async_io, this);
+    }
+}
+
+
 //! Close the connection.
 void
 GNetSocket::close()
@@ -71,9 +71,12 @@ public:
   virtual void connect(const std::string &hostname, int port);
   virtual void read(void *buf, int count, int &bytes_read);
   virtual void write(void *buf, int count, int &bytes_written);
+  virtual void set_write_notify(bool enabled);
   virtual void close();
 
 private:
+  void set_watch_flags(gint flags);
+
   // GNET callbacks
   bool async_io(GIOChannel* iochannel, GIOCondition condition);
   void async_connected(GTcpSocket *socket, GInetAddr *ia, GTcpSocketConnectAsyncStatus status);
@@ -124,26 +124,26 @@ GSettingsConfigurator::get_value(const std::string &full_path, VariantType type,
 
           if (g_variant_type_equal(G_VARIANT_TYPE_INT32, value_type))
             {
-              out.int_value = g_settings_get_int(child, key.c_str());
+              out.int_value = g_variant_get_int32(value);
               ret = true;
             }
           else if (g_variant_type_equal(G_VARIANT_TYPE_BOOLEAN, value_type))
             {
-              out.bool_value = g_settings_get_boolean(child, key.c_str());
+              out.bool_value = g_variant_get_boolean(value);
               ret = true;
             }
           else if (g_variant_type_equal(G_VARIANT_TYPE_DOUBLE, value_type))
             {
-              out.double_value = g_settings_get_double(child, key.c_str());
+              out.double_value = g_variant_get_double(value);
               ret = true;
             }
           else if (g_variant_type_equal(G_VARIANT_TYPE_STRING, value_type))
             {
-              out.string_value = g_settings_get_string(child, key.c_str());
+              out.string_value = g_variant_get_string(value, NULL);
               ret = true;
             }
 
-          //g_variant_unref(value);
+          g_variant_unref(value);
         }
 
       if (ret)
@@ -34,6 +34,7 @@
 #include <fstream>
 
 #include "GlibIniConfigurator.hh"
+#include "PersistenceWorker.hh"
 #include <glib.h>
 
 using namespace std;
@@ -94,11 +95,8 @@ GlibIniConfigurator::save(string filename)
     }
   else
     {
-      ofstream config_file(filename.c_str());
-
-      config_file << str;
-
-      config_file.close();
+      string data = str;
+      PersistenceWorker::get_instance()->write(filename, data);
     }
 
   if (str != NULL)
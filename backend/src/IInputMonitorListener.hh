@@ -1,6 +1,6 @@
 // IInputMonitorListener.hh
 //
-// Copyright (C) 2001, 2002, 2003, 2005, 2006, 2007, 2010 Rob Caelers & Raymond Penners
+// Copyright (C) 2001, 2002, 2003, 2005, 2006, 2007, 2010, 2013 Rob Caelers & Raymond Penners
 // All rights reserved.
 //
 // This program is free software: you can redistribute it and/or modify
@@ -22,23 +22,16 @@
 
 #include <string>
 
+#include "InputEvent.hh"
+
 //! Listener for events from the input monitor.
 class IInputMonitorListener
 {
 public:
   virtual ~IInputMonitorListener() {}
 
-  //! Generic user activity (if no details info is available)
-  virtual void action_notify() = 0;
-
-  //! Reports mouse movement activity
-  virtual void mouse_notify(int x, int y, int wheel = 0) = 0;
-
-  //! Reports mouse button activity
-  virtual void button_notify(bool is_press) = 0;
-
-  //! Reports keyboard activity
-  virtual void keyboard_notify(bool repeat) = 0;
+  //! Reports a batch of input events, oldest first.
+  virtual void input_events_notify(const InputEvent *events, int count) = 0;
 };
 
 #endif // IINPUTMONITORLISTENER_HH
@@ -0,0 +1,289 @@
+// IdleLog.cc --- Ring buffer of idle intervals
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <assert.h>
+
+#include <algorithm>
+
+#include <glib.h>
+
+#include "IdleLog.hh"
+
+
+//! Constructor
+IdleLog::IdleLog() :
+  capacity(0),
+  head(0),
+  count(0),
+  begin_times(NULL),
+  end_idle_times(NULL),
+  end_times(NULL),
+  active_times(NULL),
+  to_be_saved(NULL)
+{
+}
+
+
+//! Copy constructor
+IdleLog::IdleLog(const IdleLog &other) :
+  capacity(0),
+  head(0),
+  count(0),
+  begin_times(NULL),
+  end_idle_times(NULL),
+  end_times(NULL),
+  active_times(NULL),
+  to_be_saved(NULL)
+{
+  *this = other;
+}
+
+
+//! Destructor
+IdleLog::~IdleLog()
+{
+  g_free(begin_times);
+  g_free(end_idle_times);
+  g_free(end_times);
+  g_free(active_times);
+  g_free(to_be_saved);
+}
+
+
+//! Assignment
+IdleLog &
+IdleLog::operator=(const IdleLog &other)
+{
+  if (this != &other)
+    {
+      clear();
+      if (other.count > capacity)
+        {
+          reserve(other.capacity);
+        }
+
+      for (int i = 0; i < other.count; i++)
+        {
+          push_back(other.get(i));
+        }
+    }
+
+  return *this;
+}
+
+
+//! Returns the interval with the specified index.
+IdleInterval
+IdleLog::get(int index) const
+{
+  assert(index >= 0 && index < count);
+
+  int s = slot(index);
+
+  IdleInterval idle;
+  idle.begin_time = begin_times[s];
+  idle.end_idle_time = end_idle_times[s];
+  idle.end_time = end_times[s];
+  idle.active_time = active_times[s];
+  idle.to_be_saved = to_be_saved[s];
+
+  return idle;
+}
+
+
+//! Returns the newest interval.
+IdleInterval
+IdleLog::front() const
+{
+  return get(0);
+}
+
+
+//! Returns the oldest interval.
+IdleInterval
+IdleLog::back() const
+{
+  return get(count - 1);
+}
+
+
+//! Replaces the interval with the specified index.
+void
+IdleLog::set(int index, const IdleInterval &idle)
+{
+  assert(index >= 0 && index < count);
+
+  int s = slot(index);
+
+  begin_times[s] = idle.begin_time;
+  end_idle_times[s] = idle.end_idle_time;
+  end_times[s] = idle.end_time;
+  active_times[s] = idle.active_time;
+  to_be_saved[s] = idle.to_be_saved;
+}
+
+
+//! Sets the start time of an idle interval.
+void
+IdleLog::set_begin_time(int index, time_t time)
+{
+  assert(index >= 0 && index < count);
+  begin_times[slot(index)] = time;
+}
+
+
+//! Sets whether the interval is yet to be saved.
+void
+IdleLog::set_to_be_saved(int index, bool value)
+{
+  assert(index >= 0 && index < count);
+  to_be_saved[slot(index)] = value;
+}
+
+
+//! Adds a new interval, dropping the oldest one if the log is full.
+void
+IdleLog::push_front(const IdleInterval &idle)
+{
+  if (count == MAX_SIZE)
+    {
+      count--;
+    }
+  else if (count == capacity)
+    {
+      reserve(capacity == 0 ? (int)INITIAL_CAPACITY : capacity * 2);
+    }
+
+  head = (head - 1) & (capacity - 1);
+  count++;
+
+  set(0, idle);
+}
+
+
+//! Adds an old interval, unless the log is full.
+void
+IdleLog::push_back(const IdleInterval &idle)
+{
+  if (count < MAX_SIZE)
+    {
+      if (count == capacity)
+        {
+          reserve(capacity == 0 ? (int)INITIAL_CAPACITY : capacity * 2);
+        }
+
+      count++;
+      set(count - 1, idle);
+    }
+}
+
+
+//! Removes the newest interval.
+void
+IdleLog::pop_front()
+{
+  assert(count > 0);
+
+  head = (head + 1) & (capacity - 1);
+  count--;
+}
+
+
+//! Keeps the specified number of newest intervals.
+void
+IdleLog::resize(int size)
+{
+  if (size < count)
+    {
+      count = size < 0 ? 0 : size;
+    }
+}
+
+
+//! Removes all intervals.
+void
+IdleLog::clear()
+{
+  head = 0;
+  count = 0;
+}
+
+
+//! Exchanges the intervals with another log.
+void
+IdleLog::swap(IdleLog &other)
+{
+  std::swap(capacity, other.capacity);
+  std::swap(head, other.head);
+  std::swap(count, other.count);
+  std::swap(begin_times, other.begin_times);
+  std::swap(end_idle_times, other.end_idle_times);
+  std::swap(end_times, other.end_times);
+  std::swap(active_times, other.active_times);
+  std::swap(to_be_saved, other.to_be_saved);
+}
+
+
+//! Grows the buffer, moving the newest interval to the first slot.
+void
+IdleLog::reserve(int new_capacity)
+{
+  if (new_capacity > MAX_CAPACITY)
+    {
+      new_capacity = MAX_CAPACITY;
+    }
+
+  if (new_capacity > capacity)
+    {
+      time_t *new_begin_times = g_new(time_t, new_capacity);
+      time_t *new_end_idle_times = g_new(time_t, new_capacity);
+      time_t *new_end_times = g_new(time_t, new_capacity);
+      time_t *new_active_times = g_new(time_t, new_capacity);
+      bool *new_to_be_saved = g_new(bool, new_capacity);
+
+      for (int i = 0; i < count; i++)
+        {
+          int s = slot(i);
+          new_begin_times[i] = begin_times[s];
+          new_end_idle_times[i] = end_idle_times[s];
+          new_end_times[i] = end_times[s];
+          new_active_times[i] = active_times[s];
+          new_to_be_saved[i] = to_be_saved[s];
+        }
+
+      g_free(begin_times);
+      g_free(end_idle_times);
+      g_free(end_times);
+      g_free(active_times);
+      g_free(to_be_saved);
+
+      begin_times = new_begin_times;
+      end_idle_times = new_end_idle_times;
+      end_times = new_end_times;
+      active_times = new_active_times;
+      to_be_saved = new_to_be_saved;
+
+      capacity = new_capacity;
+      head = 0;
+    }
+}
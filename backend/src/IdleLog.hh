@@ -0,0 +1,205 @@
+// IdleLog.hh --- Ring buffer of idle intervals
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef IDLELOG_HH
+#define IDLELOG_HH
+
+#include <time.h>
+
+//! A single idle time interval
+struct IdleInterval
+{
+  IdleInterval() :
+    begin_time(0),
+    end_idle_time(0),
+    end_time(0),
+    active_time(0),
+    to_be_saved(false)
+  {
+  }
+
+  IdleInterval(time_t b, time_t e) :
+    begin_time(b),
+    end_idle_time(e),
+    end_time(e),
+    active_time(0),
+    to_be_saved(false)
+  {
+  }
+
+  //! Start time of idle interval
+  time_t begin_time;
+
+  //! End time of idle interval (and start of active part)
+  time_t end_idle_time;
+
+  //! End time of active interval.
+  time_t end_time;
+
+  //! Elapsed active time AFTER the idle interval.
+  time_t active_time;
+
+  //! Yet to be saved
+  bool to_be_saved;
+};
+
+
+//! Idle intervals of a client, newest first.
+/*!
+ *  The intervals are stored in a circular buffer with one array per field,
+ *  so that scanning the times touches contiguous memory. The buffer grows
+ *  up to its maximum capacity and is then reused: pushing an interval to
+ *  the front of a full log drops the oldest one.
+ *
+ *  Intervals are addressed by index, 0 being the newest. Intervals are
+ *  returned by value; use set() or the field setters to modify them.
+ */
+class IdleLog
+{
+public:
+  enum
+    {
+      //! Maximum number of intervals.
+      MAX_SIZE = 4000
+    };
+
+  IdleLog();
+  IdleLog(const IdleLog &other);
+  ~IdleLog();
+
+  IdleLog &operator=(const IdleLog &other);
+
+  int size() const;
+  bool empty() const;
+
+  IdleInterval get(int index) const;
+  IdleInterval front() const;
+  IdleInterval back() const;
+  void set(int index, const IdleInterval &idle);
+
+  time_t get_begin_time(int index) const;
+  time_t get_end_idle_time(int index) const;
+  time_t get_active_time(int index) const;
+  bool is_to_be_saved(int index) const;
+  void set_begin_time(int index, time_t time);
+  void set_to_be_saved(int index, bool to_be_saved);
+
+  void push_front(const IdleInterval &idle);
+  void push_back(const IdleInterval &idle);
+  void pop_front();
+  void resize(int size);
+  void clear();
+  void swap(IdleLog &other);
+
+private:
+  enum
+    {
+      //! Initial capacity of the buffer.
+      INITIAL_CAPACITY = 16,
+
+      //! Maximum capacity of the buffer, a power of two of at least MAX_SIZE.
+      MAX_CAPACITY = 4096
+    };
+
+  int slot(int index) const;
+  void reserve(int new_capacity);
+
+private:
+  //! Number of allocated intervals, a power of two.
+  int capacity;
+
+  //! Slot of the newest interval.
+  int head;
+
+  //! Number of intervals.
+  int count;
+
+  //! Start times of the idle intervals.
+  time_t *begin_times;
+
+  //! End times of the idle intervals.
+  time_t *end_idle_times;
+
+  //! End times of the active intervals.
+  time_t *end_times;
+
+  //! Elapsed active times after the idle intervals.
+  time_t *active_times;
+
+  //! Intervals that are yet to be saved.
+  bool *to_be_saved;
+};
+
+
+//! Returns the slot of the interval with the specified index.
+inline int
+IdleLog::slot(int index) const
+{
+  return (head + index) & (capacity - 1);
+}
+
+
+//! Returns the number of intervals.
+inline int
+IdleLog::size() const
+{
+  return count;
+}
+
+
+//! Is the log empty?
+inline bool
+IdleLog::empty() const
+{
+  return count == 0;
+}
+
+
+//! Returns the start time of an idle interval.
+inline time_t
+IdleLog::get_begin_time(int index) const
+{
+  return begin_times[slot(index)];
+}
+
+
+//! Returns the end time of an idle interval.
+inline time_t
+IdleLog::get_end_idle_time(int index) const
+{
+  return end_idle_times[slot(index)];
+}
+
+
+//! Returns the active time after an idle interval.
+inline time_t
+IdleLog::get_active_time(int index) const
+{
+  return active_times[slot(index)];
+}
+
+
+//! Is the interval yet to be saved?
+inline bool
+IdleLog::is_to_be_saved(int index) const
+{
+  return to_be_saved[slot(index)];
+}
+
+#endif // IDLELOG_HH
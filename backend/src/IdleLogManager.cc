@@ -29,6 +29,7 @@
 #include "debug.hh"
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 #include <assert.h>
 
 #ifdef HAVE_UNISTD_H
@@ -39,12 +40,31 @@
 #include "IdleLogManager.hh"
 #include "TimeSource.hh"
 #include "PacketBuffer.hh"
+#include "PersistenceWorker.hh"
 
-#define IDLELOG_MAXSIZE     (4000)
 #define IDLELOG_MAXAGE    (12 * 60 * 60)
 #define IDLELOG_INTERVAL    (30 * 60)
 #define IDLELOG_VERSION   (3)
 #define IDLELOG_INTERVAL_SIZE (17)
+#define IDLELOG_SYNC_VERSION  (1)
+#define IDLELOG_MAX_CLOCK_DRIFT (5)
+#define IDLELOG_FLUSH_INTERVAL (60)
+
+
+//! Maps a signed difference onto an unsigned value for PacketBuffer::pack_varint.
+static guint32
+zigzag_encode(gint32 value)
+{
+  return ((guint32)value << 1) ^ (guint32)(value >> 31);
+}
+
+
+//! Inverse of zigzag_encode.
+static gint32
+zigzag_decode(guint32 value)
+{
+  return (gint32)(value >> 1) ^ -(gint32)(value & 1);
+}
 
 
 //! Constructs a new idlelog manager.
@@ -53,6 +73,8 @@ IdleLogManager::IdleLogManager(string myid, const TimeSource *time_source)
   this->myid = myid;
   this->time_source = time_source;
   this->last_expiration_time = 0;
+  this->index_dirty = false;
+  this->last_flush_time = 0;
 }
 
 
@@ -94,6 +116,12 @@ IdleLogManager::update_all_idlelogs(string master_id, ActivityState current_stat
 
   expire();
 
+  time_t current_time = time_source->get_time();
+  if (current_time >= last_flush_time + IDLELOG_FLUSH_INTERVAL || current_time < last_flush_time)
+    {
+      flush();
+    }
+
   TRACE_EXIT();
 }
 
@@ -172,37 +200,17 @@ IdleLogManager::expire()
 void
 IdleLogManager::expire(ClientInfo &info)
 {
-  if (info.idlelog.size() > IDLELOG_MAXSIZE)
-    {
-      info.idlelog.resize(IDLELOG_MAXSIZE);
-    }
-
   time_t current_time = time_source->get_time();
-  int count = 0;
-  for (IdleLogRIter i = info.idlelog.rbegin(); i != info.idlelog.rend(); i++)
-    {
-      IdleInterval &idle = info.idlelog.back();
-      if (idle.end_idle_time < current_time - IDLELOG_MAXAGE)
-        {
-          count++;
-        }
-      else
-        {
-          break;
-        }
-    }
 
-  if (count != 0)
+  // The log never exceeds IdleLog::MAX_SIZE; remove the oldest intervals
+  // that are too old.
+  int size = info.idlelog.size();
+  while (size > 0 && info.idlelog.get_end_idle_time(size - 1) < current_time - IDLELOG_MAXAGE)
     {
-      if (info.idlelog.size() > (size_t)count)
-        {
-          info.idlelog.resize(info.idlelog.size() - count);
-        }
-      else
-        {
-          info.idlelog.clear();
-        }
+      size--;
     }
+
+  info.idlelog.resize(size);
 }
 
 
@@ -230,14 +238,10 @@ IdleLogManager::update_idlelog(ClientInfo &info, ActivityState state, bool maste
           info.update_active_time(current_time);
 
           // save front.
-          if (info.idlelog.size() > 0)
+          if (info.idlelog.size() > 0 && info.idlelog.is_to_be_saved(0))
             {
-              IdleInterval *save_interval = &(info.idlelog.front());
-              if (save_interval->to_be_saved)
-                {
-                  update_idlelog(info, *save_interval);
-                  save_interval->to_be_saved = false;
-                }
+              update_idlelog(info, info.idlelog.front());
+              info.idlelog.set_to_be_saved(0, false);
             }
 
           // Push current
@@ -258,12 +262,11 @@ IdleLogManager::update_idlelog(ClientInfo &info, ActivityState state, bool maste
               time_t total_idle = idle->end_idle_time - idle->begin_time;
               if (total_idle >= 10)
                 {
-                  IdleInterval *save_interval = &(info.idlelog.front());
-                  if (save_interval->to_be_saved)
+                  if (info.idlelog.is_to_be_saved(0))
                     {
                       TRACE_MSG("Saving");
-                      update_idlelog(info, *save_interval);
-                      save_interval->to_be_saved = false;
+                      update_idlelog(info, info.idlelog.front());
+                      info.idlelog.set_to_be_saved(0, false);
                     }
                 }
             }
@@ -281,11 +284,9 @@ IdleLogManager::update_idlelog(ClientInfo &info, ActivityState state, bool maste
           if (total_idle < 10 && info.idlelog.size() > 1)
             {
               // Idle period too short. remove it. and reuse previous
-              IdleInterval &oldidle = info.idlelog.front();
-
-              if (oldidle.to_be_saved)
+              if (info.idlelog.is_to_be_saved(0))
                 {
-                  info.current_interval = oldidle;
+                  info.current_interval = info.idlelog.front();
                   info.idlelog.pop_front();
                   idle = &(info.current_interval);
                 }
@@ -330,6 +331,24 @@ IdleLogManager::compute_total_active_time()
 //! Returns the active time since an idle period of a least the specified amount of time.
 time_t
 IdleLogManager::compute_active_time(int length)
+{
+  vector<int> lengths(1, length);
+  vector<time_t> active_times;
+
+  compute_active_time(lengths, active_times);
+  return active_times[0];
+}
+
+
+//! Computes the active time since an idle period of at least each of the specified lengths.
+/*!
+ *  The ends and begins of the idle intervals of all clients are processed
+ *  from new to old in a single pass, merged with a heap. The active time
+ *  for a length is known at the first period in which all clients were
+ *  idle for longer than that length.
+ */
+void
+IdleLogManager::compute_active_time(const vector<int> &lengths, vector<time_t> &active_times)
 {
   TRACE_ENTER("IdleLogManager::compute_active_time");
 
@@ -338,116 +357,106 @@ IdleLogManager::compute_active_time(int length)
   // Number of client.
   int size = clients.size();
 
-  // Data for each client.
-  IdleLogIter *iterators = new IdleLogIter[size];
-  IdleLogIter *end_iterators = new IdleLogIter[size];
-  bool *at_end = new bool[size];
-  time_t *active_time = new time_t[size];
+  // Next event of each client.
+  vector<SweepEvent> events;
+  events.reserve(size);
 
-  // Init data for all clients.
   int count = 0;
   for (ClientMapIter i = clients.begin(); i != clients.end(); i++)
     {
       ClientInfo &info = (*i).second;
-
-      iterators[count] = info.idlelog.begin();
-      end_iterators[count] = info.idlelog.end();
-      active_time[count] = 0;
-      at_end[count] = true;
-
       info.update_active_time(current_time);
+
+      if (!info.idlelog.empty())
+        {
+          events.push_back(SweepEvent(&info.idlelog, count));
+        }
       count++;
     }
 
+  make_heap(events.begin(), events.end());
+
+  int num_lengths = lengths.size();
+  vector<bool> done(num_lengths, false);
+  active_times.assign(num_lengths, 0);
+
+  // Number of lengths for which no common idle period was found yet.
+  int remaining = num_lengths;
 
   // Number of simultaneous idle periods.
   int idle_count = 0;
 
-  // Time of last unprocessed event.
-  time_t last_time = -1;
+  // End time of the last idle period.
+  time_t end_idle_time = -1;
 
-  // Iterator of last unprocessed event.
-  int last_iter = -1;
+  // Total active time after the current event.
+  time_t total_active_time = 0;
 
-  // Stop criterium
-  bool stop = false;
+  while (remaining > 0 && !events.empty())
+    {
+      pop_heap(events.begin(), events.end());
 
-  // Begin and End time of idle perdiod.
-  time_t end_idle_time = -1;
+      SweepEvent &event = events.back();
+      const IdleLog *idlelog = event.idlelog;
 
-  while (!stop)
-    {
-      // Find latest event.
-      last_time = -1;
-      for (int i = 0; i < size; i ++)
+      if (event.at_end)
         {
-          if (iterators[i] != end_iterators[i])
-            {
-              IdleInterval &ii = *(iterators[i]);
-              time_t t = at_end[i] ? ii.end_idle_time : ii.begin_time;
+          TRACE_MSG("End time " << event.time << " active " << idlelog->get_active_time(event.index));
+          idle_count++;
 
-              if (last_time == -1 || t > last_time)
-                {
-                  last_time = t;
-                  last_iter = i;
-                }
-            }
-        }
+          total_active_time += idlelog->get_active_time(event.index);
+          end_idle_time = event.time;
 
-      // Did we found one?
-      if (last_time != -1)
+          event.at_end = false;
+          event.time = idlelog->get_begin_time(event.index);
+          push_heap(events.begin(), events.end());
+        }
+      else
         {
-          IdleInterval &ii = *(iterators[last_iter]);
-          if (at_end[last_iter])
-            {
-              TRACE_MSG("End time " << ii.end_idle_time << " active " << ii.active_time);
-              idle_count++;
+          TRACE_MSG("Begin time " << event.time);
 
-              at_end[last_iter] = false;
-              active_time[last_iter] += ii.active_time;
-              end_idle_time = ii.end_idle_time;
-            }
-          else
+          if (idle_count == size)
             {
-              TRACE_MSG("Begin time " << ii.begin_time);
-
-              at_end[last_iter] = true;
-              iterators[last_iter]++;
+              time_t idle_time = end_idle_time - event.time;
+              TRACE_MSG("Common idle period of " << idle_time);
 
-              if (idle_count == size)
+              for (int i = 0; i < num_lengths; i++)
                 {
-                  TRACE_MSG("Common idle period of " << (end_idle_time - ii.begin_time));
-                  if ((end_idle_time - ii.begin_time) > length)
+                  if (!done[i] && idle_time > lengths[i])
                     {
-                      stop = true;
+                      done[i] = true;
+                      active_times[i] = total_active_time;
+                      remaining--;
                     }
                 }
+            }
 
-              idle_count--;
+          idle_count--;
+
+          event.index++;
+          if (event.index < idlelog->size())
+            {
+              event.at_end = true;
+              event.time = idlelog->get_end_idle_time(event.index);
+              push_heap(events.begin(), events.end());
+            }
+          else
+            {
+              events.pop_back();
             }
-        }
-      else
-        {
-          stop = true;
         }
     }
 
-  time_t total_active_time = 0;
-  for (int i = 0; i < size; i++)
+  for (int i = 0; i < num_lengths; i++)
     {
-      TRACE_MSG("active time of " << i << " = " << active_time[i]);
-      total_active_time += active_time[i];
+      if (!done[i])
+        {
+          active_times[i] = total_active_time;
+        }
     }
 
   TRACE_MSG("total = " << total_active_time);
-
-  delete [] iterators;
-  delete [] end_iterators;
-  delete [] at_end;
-  delete [] active_time;
-
   TRACE_EXIT();
-  return total_active_time;
 }
 
 
@@ -467,7 +476,7 @@ IdleLogManager::compute_idle_time()
       ClientInfo &info = (*i).second;
       info.update_active_time(current_time);
 
-      IdleInterval &idle = info.idlelog.front();
+      IdleInterval idle = info.idlelog.empty() ? IdleInterval() : info.idlelog.front();
       if (idle.active_time == 0)
         {
           count++;
@@ -536,7 +545,8 @@ IdleLogManager::unpack_idle_interval(PacketBuffer &buffer, IdleInterval &idle, t
 
 //! Packs the idlelog header to the buffer.
 void
-IdleLogManager::pack_idlelog(PacketBuffer &buffer, const ClientInfo &ci) const
+IdleLogManager::pack_idlelog(PacketBuffer &buffer, const ClientInfo &ci, int num_intervals,
+                             const SyncHeader *sync) const
 {
   time_t current_time = time_source->get_time();
 
@@ -550,7 +560,13 @@ IdleLogManager::pack_idlelog(PacketBuffer &buffer, const ClientInfo &ci) const
   buffer.pack_ulong((guint32)ci.total_active_time);
   buffer.pack_byte(ci.master);
   buffer.pack_byte(ci.state);
-  buffer.pack_ushort(ci.idlelog.size());
+  buffer.pack_ushort(num_intervals);
+
+  if (sync != NULL)
+    {
+      // Older versions skip this.
+      pack_sync_header(buffer, *sync);
+    }
 
   buffer.update_size(pos);
 }
@@ -559,7 +575,8 @@ IdleLogManager::pack_idlelog(PacketBuffer &buffer, const ClientInfo &ci) const
 //! Unpacks the idlelog header from the buffer.
 void
 IdleLogManager::unpack_idlelog(PacketBuffer &buffer, ClientInfo &ci,
-                               time_t &pack_time, int &num_intervals) const
+                               time_t &pack_time, int &num_intervals,
+                               SyncHeader *sync) const
 {
   int pos = 0;
   int size = buffer.read_size(pos);
@@ -581,6 +598,11 @@ IdleLogManager::unpack_idlelog(PacketBuffer &buffer, ClientInfo &ci,
 
       num_intervals = buffer.unpack_ushort();
 
+      if (sync != NULL && buffer.bytes_read() < pos)
+        {
+          unpack_sync_header(buffer, *sync);
+        }
+
       g_free(id);
 
       buffer.skip_size(pos);
@@ -592,6 +614,116 @@ IdleLogManager::unpack_idlelog(PacketBuffer &buffer, ClientInfo &ci,
 }
 
 
+//! Packs the synchronization information of an idle log message.
+void
+IdleLogManager::pack_sync_header(PacketBuffer &buffer, const SyncHeader &sync) const
+{
+  buffer.pack_byte(sync.version);
+  buffer.pack_byte(sync.format);
+  buffer.pack_ulong((guint32)sync.base_time);
+
+  buffer.pack_ushort(sync.watermarks.size());
+  for (map<string, time_t>::const_iterator i = sync.watermarks.begin(); i != sync.watermarks.end(); i++)
+    {
+      buffer.pack_string(i->first.c_str());
+      buffer.pack_ulong((guint32)i->second);
+    }
+}
+
+
+//! Unpacks the synchronization information of an idle log message.
+void
+IdleLogManager::unpack_sync_header(PacketBuffer &buffer, SyncHeader &sync) const
+{
+  sync.version = buffer.unpack_byte();
+  sync.format = (buffer.unpack_byte() == SYNC_FORMAT_INCREMENTAL) ? SYNC_FORMAT_INCREMENTAL : SYNC_FORMAT_FULL;
+  sync.base_time = buffer.unpack_ulong();
+
+  int num_watermarks = buffer.unpack_ushort();
+  for (int i = 0; i < num_watermarks && buffer.bytes_available() > 0; i++)
+    {
+      char *id = buffer.unpack_string();
+      time_t watermark = buffer.unpack_ulong();
+
+      if (id != NULL)
+        {
+          sync.watermarks[id] = watermark;
+          g_free(id);
+        }
+    }
+}
+
+
+//! Packs the newest intervals of an idle log, oldest first.
+/*!
+ *  The times are packed as varints relative to the start of the previous
+ *  interval, so an interval typically takes 5 to 10 bytes instead of 17.
+ */
+void
+IdleLogManager::pack_idle_intervals(PacketBuffer &buffer, const IdleLog &idlelog,
+                                    int count, time_t base_time) const
+{
+  int pos = 0;
+  buffer.reserve_size(pos);
+  buffer.pack_ushort(count);
+
+  time_t previous_time = base_time;
+  for (int i = count - 1; i >= 0; i--)
+    {
+      IdleInterval idle = idlelog.get(i);
+
+      buffer.pack_varint(zigzag_encode((gint32)(idle.begin_time - previous_time)));
+      buffer.pack_varint(zigzag_encode((gint32)(idle.end_idle_time - idle.begin_time)));
+      buffer.pack_varint(zigzag_encode((gint32)(idle.end_time - idle.end_idle_time)));
+      buffer.pack_varint(zigzag_encode((gint32)idle.active_time));
+
+      previous_time = idle.begin_time;
+    }
+
+  buffer.update_size(pos);
+}
+
+
+//! Unpacks intervals packed by pack_idle_intervals, newest first.
+void
+IdleLogManager::unpack_idle_intervals(PacketBuffer &buffer, IdleLog &idlelog,
+                                      time_t base_time, time_t delta_time) const
+{
+  int pos = 0;
+  int size = buffer.read_size(pos);
+
+  if (size > 0 && buffer.bytes_available() >= size)
+    {
+      int count = buffer.unpack_ushort();
+
+      time_t previous_time = base_time;
+      for (int i = 0; i < count && buffer.bytes_read() < pos; i++)
+        {
+          IdleInterval idle;
+
+          idle.begin_time = previous_time + zigzag_decode(buffer.unpack_varint());
+          idle.end_idle_time = idle.begin_time + zigzag_decode(buffer.unpack_varint());
+          idle.end_time = idle.end_idle_time + zigzag_decode(buffer.unpack_varint());
+          idle.active_time = zigzag_decode(buffer.unpack_varint());
+
+          previous_time = idle.begin_time;
+
+          idle.begin_time -= delta_time;
+          idle.end_idle_time -= delta_time;
+          idle.end_time -= delta_time;
+
+          idlelog.push_front(idle);
+        }
+
+      buffer.skip_size(pos);
+    }
+  else
+    {
+      buffer.clear();
+    }
+}
+
+
 //! Removes the idlelog specified in the buffer.
 void
 IdleLogManager::unlink_idlelog(PacketBuffer &buffer) const
@@ -649,16 +781,13 @@ IdleLogManager::save_index()
       info.update_active_time(time_source->get_time());
       TRACE_MSG("Saving " << i->first << " " << info.client_id);
 
-      pack_idlelog(buffer, info);
+      pack_idlelog(buffer, info, info.idlelog.size());
     }
 
-  stringstream ss;
-  ss << Util::get_home_directory();
-  ss << "idlelog.idx" << ends;
+  string data(buffer.get_buffer(), buffer.bytes_written());
+  PersistenceWorker::get_instance()->write(Util::get_home_directory() + "idlelog.idx", data);
 
-  ofstream file(ss.str().c_str(), ios::binary);
-  file.write(buffer.get_buffer(), buffer.bytes_written());
-  file.close();
+  index_dirty = false;
 
   TRACE_EXIT();
 }
@@ -762,20 +891,16 @@ IdleLogManager::save_idlelog(ClientInfo &info)
   PacketBuffer buffer;
   buffer.create();
 
-  for (IdleLogRIter i = info.idlelog.rbegin(); i != info.idlelog.rend(); i++)
+  for (int i = info.idlelog.size() - 1; i >= 0; i--)
     {
-      IdleInterval &idle = *i;
-
-      pack_idle_interval(buffer, idle);
+      pack_idle_interval(buffer, info.idlelog.get(i));
     }
 
-  stringstream ss;
-  ss << Util::get_home_directory();
-  ss << "idlelog." << info.client_id << ".log" << ends;
+  // The snapshot includes the unsaved intervals.
+  unsaved_intervals.erase(info.client_id);
 
-  ofstream file(ss.str().c_str(), ios::binary);
-  file.write(buffer.get_buffer(), buffer.bytes_written());
-  file.close();
+  string data(buffer.get_buffer(), buffer.bytes_written());
+  PersistenceWorker::get_instance()->write(get_idlelog_filename(info.client_id), data);
 }
 
 
@@ -787,12 +912,8 @@ IdleLogManager::load_idlelog(ClientInfo &info)
 
   time_t current_time = time_source->get_time();
 
-  stringstream ss;
-  ss << Util::get_home_directory();
-  ss << "idlelog." << info.client_id << ".log" << ends;
-
   // Open file
-  ifstream file(ss.str().c_str(), ios::binary);
+  ifstream file(get_idlelog_filename(info.client_id).c_str(), ios::binary);
 
   // get file size using buffer's members
   filebuf *pbuf=file.rdbuf();
@@ -800,16 +921,25 @@ IdleLogManager::load_idlelog(ClientInfo &info)
   pbuf->pubseekpos (0,ios::in);
 
   // Process it.
-  int num_intervals = size / IDLELOG_INTERVAL_SIZE;
-  if (num_intervals * IDLELOG_INTERVAL_SIZE == size)
+  int num_intervals = size > 0 ? size / IDLELOG_INTERVAL_SIZE : 0;
+
+  // An interval that was partially written before a crash is dropped.
+  bool incomplete = size > 0 && num_intervals * IDLELOG_INTERVAL_SIZE != size;
+  if (incomplete)
+    {
+      TRACE_MSG("Dropping incomplete interval");
+      size = num_intervals * IDLELOG_INTERVAL_SIZE;
+    }
+
+  if (num_intervals > 0)
     {
-      if (num_intervals > IDLELOG_MAXSIZE)
+      if (num_intervals > IdleLog::MAX_SIZE)
         {
-          TRACE_MSG("Skipping " << (num_intervals - IDLELOG_MAXSIZE) << " intervals");
-          int skip = (num_intervals - IDLELOG_MAXSIZE) * IDLELOG_INTERVAL_SIZE;
+          TRACE_MSG("Skipping " << (num_intervals - IdleLog::MAX_SIZE) << " intervals");
+          int skip = (num_intervals - IdleLog::MAX_SIZE) * IDLELOG_INTERVAL_SIZE;
           file.seekg(skip);
           size -= skip;
-          num_intervals = IDLELOG_MAXSIZE;
+          num_intervals = IdleLog::MAX_SIZE;
         }
 
       // Create buffer and load data.
@@ -825,6 +955,17 @@ IdleLogManager::load_idlelog(ClientInfo &info)
           IdleInterval idle;
           unpack_idle_interval(buffer, idle, 0);
 
+          if (info.client_id != myid)
+            {
+              // Intervals that were received again replace the ones that
+              // were appended before.
+              while (idle.begin_time > 1 && !info.idlelog.empty() &&
+                     info.idlelog.front().begin_time >= idle.begin_time)
+                {
+                  info.idlelog.pop_front();
+                }
+            }
+
           if (idle.end_idle_time >= current_time - IDLELOG_MAXAGE)
             {
               info.idlelog.push_front(idle);
@@ -833,29 +974,122 @@ IdleLogManager::load_idlelog(ClientInfo &info)
 
 	  if (info.idlelog.size() > 0)
 	    {
-           IdleInterval &idle = info.idlelog.back();
-           idle.begin_time = 1;
+           info.idlelog.set_begin_time(info.idlelog.size() - 1, 1);
 	    }
     }
 
+  if (info.last_update_time != 0)
+    {
+      // Replay the active time of intervals that were saved after the
+      // index, which is only saved periodically.
+      for (int i = 0; i < info.idlelog.size(); i++)
+        {
+          IdleInterval idle = info.idlelog.get(i);
+          if (idle.end_time > info.last_update_time)
+            {
+              info.total_active_time += MIN(idle.active_time, idle.end_time - info.last_update_time);
+            }
+        }
+
+      if (!info.idlelog.empty() && info.idlelog.front().end_time > info.last_update_time)
+        {
+          TRACE_MSG("Replayed intervals after " << info.last_update_time);
+          info.last_update_time = info.idlelog.front().end_time;
+          index_dirty = true;
+        }
+    }
+
   dump_idlelog(info);
   fix_idlelog(info);
   dump_idlelog(info);
+
+  if (incomplete)
+    {
+      // Appending after an incomplete interval would corrupt the log.
+      save_idlelog(info);
+    }
+
   TRACE_EXIT();
 }
 
 
+//! Adds the clients that have an idle log file, but are missing from the index.
+/*!
+ *  This happens after a crash, because the index is only saved periodically.
+ */
+void
+IdleLogManager::find_unindexed_clients(vector<string> &ids)
+{
+  TRACE_ENTER("IdleLogManager::find_unindexed_clients");
+
+  const string prefix = "idlelog.";
+  const string suffix = ".log";
+
+  GDir *dir = g_dir_open(Util::get_home_directory().c_str(), 0, NULL);
+  if (dir != NULL)
+    {
+      const gchar *name;
+      while ((name = g_dir_read_name(dir)) != NULL)
+        {
+          string filename = name;
+          if (filename.size() > prefix.size() + suffix.size() &&
+              filename.compare(0, prefix.size(), prefix) == 0 &&
+              filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0)
+            {
+              string id = filename.substr(prefix.size(), filename.size() - prefix.size() - suffix.size());
+
+              if (clients.find(id) == clients.end())
+                {
+                  TRACE_MSG("Recovering " << id);
+
+                  ClientInfo &info = clients[id];
+                  info.client_id = id;
+                  info.state = ACTIVITY_IDLE;
+
+                  ids.push_back(id);
+                  index_dirty = true;
+                }
+            }
+        }
+
+      g_dir_close(dir);
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Returns the name of the idle log file of the specified client.
+string
+IdleLogManager::get_idlelog_filename(const string &id) const
+{
+  return Util::get_home_directory() + "idlelog." + id + ".log";
+}
+
+
 //! Loads the entire idlelog.
 void
 IdleLogManager::load()
 {
   load_index();
 
+  vector<string> recovered;
+  find_unindexed_clients(recovered);
+
   for (ClientMapIter i = clients.begin(); i != clients.end(); i++)
     {
       ClientInfo &info = (*i).second;
       load_idlelog(info);
     }
+
+  for (vector<string>::iterator i = recovered.begin(); i != recovered.end(); i++)
+    {
+      if (clients[*i].idlelog.size() <= 1)
+        {
+          // Only the interval added by fix_idlelog, all others expired.
+          clients.erase(*i);
+        }
+    }
 }
 
 
@@ -864,6 +1098,8 @@ IdleLogManager::load()
 void
 IdleLogManager::save()
 {
+  last_flush_time = time_source->get_time();
+
   save_index();
 
   for (ClientMapIter i = clients.begin(); i != clients.end(); i++)
@@ -885,72 +1121,449 @@ IdleLogManager::update_idlelog(ClientInfo &info, const IdleInterval &idle)
 
   pack_idle_interval(buffer, idle);
 
-  stringstream ss;
-  ss << Util::get_home_directory();
-  ss << "idlelog." << info.client_id << ".log" << ends;
+  unsaved_intervals[info.client_id].append(buffer.get_buffer(), buffer.bytes_written());
+  index_dirty = true;
+}
 
-  ofstream file(ss.str().c_str(), ios::app | ios::binary);
-  file.write(buffer.get_buffer(), buffer.bytes_written());
-  file.close();
 
-  save_index();
+//! Adds the newest intervals of the specified client to persistent storage.
+void
+IdleLogManager::append_idlelog(ClientInfo &info, int count)
+{
+  PacketBuffer buffer;
+  buffer.create();
+
+  for (int i = count - 1; i >= 0; i--)
+    {
+      pack_idle_interval(buffer, info.idlelog.get(i));
+    }
+
+  unsaved_intervals[info.client_id].append(buffer.get_buffer(), buffer.bytes_written());
+}
+
+
+//! Writes the unsaved intervals, and the index if it changed.
+/*!
+ *  A crash loses at most the intervals since the last flush. The index is
+ *  corrected from the idle log files when it is loaded.
+ */
+void
+IdleLogManager::flush()
+{
+  TRACE_ENTER("IdleLogManager::flush");
+
+  PersistenceWorker *worker = PersistenceWorker::get_instance();
+
+  for (map<string, string>::iterator i = unsaved_intervals.begin(); i != unsaved_intervals.end(); i++)
+    {
+      worker->append(get_idlelog_filename(i->first), i->second);
+    }
+  unsaved_intervals.clear();
+
+  if (index_dirty)
+    {
+      save_index();
+    }
+
+  last_flush_time = time_source->get_time();
+
+  TRACE_EXIT();
 }
 
 
+//! Can my idle log be sent incrementally?
+/*!
+ *  Only if all signed on clients understand incremental updates. A client
+ *  that signs on again is known to do so from its previous session.
+ */
+bool
+IdleLogManager::is_incremental_sync_possible()
+{
+  bool ret = false;
+
+  for (ClientMapIter i = clients.begin(); i != clients.end(); i++)
+    {
+      ClientInfo &info = i->second;
+
+      if (!info.connected)
+        {
+          continue;
+        }
+
+      if (info.sync_mode != SYNC_INCREMENTAL)
+        {
+          ret = false;
+          break;
+        }
 
+      ret = true;
+    }
+
+  return ret;
+}
+
+
+//! Returns the start time of the oldest interval of my idle log that must be sent.
+/*!
+ *  This is the newest interval that all clients have. It is sent again,
+ *  because it may have changed since.
+ */
+time_t
+IdleLogManager::get_sync_base_time()
+{
+  time_t base_time = -1;
+
+  for (ClientMapIter i = clients.begin(); i != clients.end(); i++)
+    {
+      ClientInfo &info = i->second;
+
+      if (info.connected && info.sync_mode == SYNC_INCREMENTAL &&
+          (base_time == -1 || info.acked_time < base_time))
+        {
+          base_time = info.acked_time;
+        }
+    }
+
+  return base_time == -1 ? 0 : base_time;
+}
+
+
+//! Merges the intervals that a client sent incrementally into its idle log.
+/*!
+ *  The intervals replace the ones that start at or after the base time,
+ *  which the client sent again or no longer has. The new intervals are
+ *  appended to the idle log file, unless the file has intervals that they
+ *  do not replace.
+ *
+ *  \retval false if intervals are missing between the idle log and the
+ *  new intervals.
+ */
+bool
+IdleLogManager::merge_idlelog(ClientInfo &info, const SyncHeader &sync, IdleLog &idlelog)
+{
+  TRACE_ENTER_MSG("IdleLogManager::merge_idlelog", info.client_id << " " << idlelog.size());
+
+  if (sync.base_time > info.sync_time)
+    {
+      TRACE_RETURN("Missing intervals since " << info.sync_time);
+      return false;
+    }
+
+  time_t base_time = sync.base_time - info.delta_time;
+  time_t first_time = idlelog.empty() ? 0 : idlelog.back().begin_time;
+
+  // Loading the idle log file only drops an interval if a later
+  // interval starts at or before it.
+  bool appendable = true;
+  while (!info.idlelog.empty() &&
+         (sync.base_time == 0 || info.idlelog.front().begin_time >= base_time))
+    {
+      if (first_time <= 1 || info.idlelog.front().begin_time < first_time)
+        {
+          appendable = false;
+        }
+      info.idlelog.pop_front();
+    }
+
+  int count = idlelog.size();
+  for (int i = count - 1; i >= 0; i--)
+    {
+      info.idlelog.push_front(idlelog.get(i));
+    }
+
+  if (!appendable)
+    {
+      save_idlelog(info);
+    }
+  else if (count > 0)
+    {
+      append_idlelog(info, count);
+    }
+
+  TRACE_EXIT();
+  return true;
+}
+
+
+
+//! Packs my idle log for all signed on clients.
+/*!
+ *  If all clients support it, only the intervals that are new to them are
+ *  sent. The header tells each client up to which interval I have its idle
+ *  log, so that it knows what to send next time.
+ */
 void
 IdleLogManager::get_idlelog(PacketBuffer &buffer)
 {
   TRACE_ENTER("IdleLogManager::get_idlelog");
 
+  bool incremental = is_incremental_sync_possible();
+  time_t base_time = incremental ? get_sync_base_time() : 0;
+
+  pack_sync_idlelog(buffer, incremental, base_time);
+
+  for (ClientMapIter i = clients.begin(); i != clients.end(); i++)
+    {
+      ClientInfo &info = i->second;
+      if (info.connected)
+        {
+          mark_idlelog_sent(info, base_time);
+        }
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Packs my idle log for the specified client.
+/*!
+ *  A client that synchronizes incrementally only gets the intervals that
+ *  are new to it. Other clients get my entire idle log.
+ */
+void
+IdleLogManager::get_idlelog(PacketBuffer &buffer, const string &client_id)
+{
+  TRACE_ENTER_MSG("IdleLogManager::get_idlelog", client_id);
+
+  ClientMapIter i = clients.find(client_id);
+  if (i != clients.end() && i->second.sync_mode == SYNC_INCREMENTAL)
+    {
+      pack_sync_idlelog(buffer, true, i->second.acked_time);
+      mark_idlelog_sent(i->second, i->second.acked_time);
+    }
+  else
+    {
+      pack_sync_idlelog(buffer, false, 0);
+      if (i != clients.end())
+        {
+          mark_idlelog_sent(i->second, 0);
+        }
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Returns the IDs of all signed on clients.
+void
+IdleLogManager::get_connected_clients(list<string> &ids)
+{
+  for (ClientMapIter i = clients.begin(); i != clients.end(); i++)
+    {
+      if (i->second.connected && i->first != myid)
+        {
+          ids.push_back(i->first);
+        }
+    }
+}
+
+
+//! Packs my idle log, with the intervals since the base time if incremental.
+void
+IdleLogManager::pack_sync_idlelog(PacketBuffer &buffer, bool incremental, time_t base_time)
+{
+  TRACE_ENTER_MSG("IdleLogManager::pack_sync_idlelog", incremental << " " << base_time);
+
   // Information about me.
   ClientInfo &myinfo = clients[myid];
 
   // First make sure that all data is up-to-date.
   myinfo.update_active_time(time_source->get_time());
 
-  // Pack header.
-  pack_idlelog(buffer, myinfo);
+  SyncHeader sync;
+  sync.version = IDLELOG_SYNC_VERSION;
 
-  for (IdleLogIter i = myinfo.idlelog.begin(); i != myinfo.idlelog.end(); i++)
+  for (ClientMapIter i = clients.begin(); i != clients.end(); i++)
     {
-      pack_idle_interval(buffer, *i);
+      ClientInfo &info = i->second;
+      if (info.sync_time != 0)
+        {
+          sync.watermarks[i->first] = info.sync_time;
+        }
+    }
+
+  if (incremental)
+    {
+      sync.format = SYNC_FORMAT_INCREMENTAL;
+      sync.base_time = base_time;
+
+      int count = 0;
+      while (count < myinfo.idlelog.size() &&
+             myinfo.idlelog.get_begin_time(count) >= sync.base_time)
+        {
+          count++;
+        }
+
+      TRACE_MSG("Sending " << count << " intervals since " << sync.base_time);
+
+      // The recipients use the incremental intervals. A client that does
+      // not support them only gets the most recent interval, and gets my
+      // entire idle log once it tells how it synchronizes.
+      int num_intervals = myinfo.idlelog.empty() ? 0 : 1;
+
+      pack_idlelog(buffer, myinfo, num_intervals, &sync);
+      if (num_intervals > 0)
+        {
+          pack_idle_interval(buffer, myinfo.idlelog.front());
+        }
+      pack_idle_intervals(buffer, myinfo.idlelog, count, sync.base_time);
+    }
+  else
+    {
+      // Pack header.
+      pack_idlelog(buffer, myinfo, myinfo.idlelog.size(), &sync);
+
+      for (int i = 0; i < myinfo.idlelog.size(); i++)
+        {
+          pack_idle_interval(buffer, myinfo.idlelog.get(i));
+        }
     }
 
   TRACE_EXIT();
 }
 
 
+//! Records that my idle log was sent to the client since the base time.
 void
+IdleLogManager::mark_idlelog_sent(ClientInfo &info, time_t base_time)
+{
+  ClientInfo &myinfo = clients[myid];
+
+  info.sent_base_time = base_time;
+
+  if (!myinfo.idlelog.empty() && info.sync_mode == SYNC_INCREMENTAL)
+    {
+      // Assume that the client receives the intervals. If it misses them,
+      // it reports an older watermark and gets them again.
+      time_t newest_time = myinfo.idlelog.front().begin_time;
+      if (info.acked_time < newest_time)
+        {
+          info.acked_time = newest_time;
+        }
+    }
+}
+
+
+//! Processes the idle log of another client.
+/*!
+ *  \retval true if my idle log must be sent again, because the client
+ *  missed intervals of it, or I missed intervals of its idle log.
+ */
+bool
 IdleLogManager::set_idlelog(PacketBuffer &buffer)
 {
   TRACE_ENTER("IdleLogManager::set_idlelog");
 
-  time_t delta_time = 0;
   time_t pack_time = 0;
   int num_intervals = 0;
 
-  ClientInfo info;
-  unpack_idlelog(buffer, info, pack_time, num_intervals);
+  ClientInfo header;
+  SyncHeader sync;
+  unpack_idlelog(buffer, header, pack_time, num_intervals, &sync);
+
+  if (header.client_id == "" || header.client_id == myid)
+    {
+      TRACE_RETURN("Invalid client");
+      return false;
+    }
 
-  delta_time = pack_time - time_source->get_time();
-  clients[info.client_id] = info;
+  ClientInfo &info = clients[header.client_id];
+  info.client_id = header.client_id;
+  info.total_active_time = header.total_active_time;
+  info.master = header.master;
+  info.state = header.state;
+  info.current_interval = IdleInterval();
+  info.last_active_begin_time = 0;
+  info.last_active_time = 0;
   info.last_update_time = 0;
 
+  time_t delta_time = pack_time - time_source->get_time();
+  if (info.sync_mode != SYNC_UNKNOWN &&
+      delta_time - info.delta_time <= IDLELOG_MAX_CLOCK_DRIFT &&
+      info.delta_time - delta_time <= IDLELOG_MAX_CLOCK_DRIFT)
+    {
+      // Keep converting the times in the same way, so that intervals that
+      // are sent again replace the old ones.
+      delta_time = info.delta_time;
+    }
+  info.delta_time = delta_time;
+
+  IdleLog idlelog;
   for (int i = 0; i < num_intervals; i++)
     {
       IdleInterval idle;
       unpack_idle_interval(buffer, idle, delta_time);
 
       TRACE_MSG(info.client_id << " " << idle.begin_time << " " << idle.end_idle_time << " " << idle.active_time);
-      clients[info.client_id].idlelog.push_back(idle);
+      idlelog.push_back(idle);
     }
 
-  fix_idlelog(info);
-  save_index();
-  save_idlelog(clients[info.client_id]);
+  bool resend = false;
 
-  TRACE_EXIT();
+  if (sync.format == SYNC_FORMAT_INCREMENTAL)
+    {
+      idlelog.clear();
+      unpack_idle_intervals(buffer, idlelog, sync.base_time, delta_time);
+
+      time_t newest_time = idlelog.empty() ? 0 : idlelog.front().begin_time + delta_time;
+
+      if (!merge_idlelog(info, sync, idlelog))
+        {
+          // Send my old watermark of its idle log.
+          resend = true;
+        }
+      else if (newest_time != 0)
+        {
+          info.sync_time = newest_time;
+        }
+    }
+  else
+    {
+      info.idlelog.swap(idlelog);
+      save_idlelog(info);
+
+      info.sync_time = info.idlelog.empty() ? 0 : info.idlelog.front().begin_time + delta_time;
+    }
+
+  if (info.sync_mode != SYNC_UNKNOWN && info.sync_version != sync.version)
+    {
+      // The client now runs another version, so what it has of my idle
+      // log is unknown.
+      TRACE_MSG("Client changed sync version from " << info.sync_version << " to " << sync.version);
+      info.acked_time = 0;
+      info.sent_base_time = 0;
+      resend = true;
+    }
+
+  info.sync_mode = (sync.version > 0) ? SYNC_INCREMENTAL : SYNC_FULL;
+  info.sync_version = sync.version;
+
+  if (sync.version > 0)
+    {
+      time_t watermark = 0;
+
+      map<string, time_t>::const_iterator i = sync.watermarks.find(myid);
+      if (i != sync.watermarks.end())
+        {
+          watermark = i->second;
+        }
+
+      if (watermark < info.sent_base_time)
+        {
+          TRACE_MSG("Client misses intervals since " << watermark);
+          info.acked_time = watermark;
+          resend = true;
+        }
+      else if (watermark > info.acked_time)
+        {
+          info.acked_time = watermark;
+        }
+    }
+
+  index_dirty = true;
+
+  TRACE_RETURN(resend);
+  return resend;
 }
 
 
@@ -965,8 +1578,12 @@ IdleLogManager::signon_remote_client(string client_id)
   ClientInfo &info = clients[client_id];
   info.idlelog.push_front(IdleInterval(1, current_time));
   info.client_id = client_id;
+  info.connected = true;
 
-  save_index();
+  // The client keeps how it synchronizes from its previous session. If it
+  // now runs another version, its next idle log tells so.
+
+  index_dirty = true;
   save_idlelog(info);
 
   TRACE_EXIT();
@@ -981,6 +1598,7 @@ IdleLogManager::signoff_remote_client(string client_id)
 
   clients[client_id].state = ACTIVITY_IDLE;
   clients[client_id].master = false;
+  clients[client_id].connected = false;
 
   TRACE_EXIT();
 }
@@ -1021,10 +1639,9 @@ IdleLogManager::dump_idlelog(ClientInfo &info)
                    );
   }
 
-  IdleLogIter i = info.idlelog.begin();
-  while (i != info.idlelog.end())
+  for (int i = 0; i < info.idlelog.size(); i++)
     {
-      IdleInterval &idle = *i;
+      IdleInterval idle = info.idlelog.get(i);
 
       struct tm begin_time;
       localtime_r(&idle.begin_time, &begin_time);
@@ -1044,7 +1661,6 @@ IdleLogManager::dump_idlelog(ClientInfo &info)
                    << end_time.tm_min << ":"
                    << end_time.tm_sec
                    );
-      i++;
     }
   TRACE_EXIT();
 #endif
@@ -1061,9 +1677,9 @@ IdleLogManager::fix_idlelog(ClientInfo &info)
 
   time_t next_time = -1;
 
-  for (IdleLogRIter i = info.idlelog.rbegin(); i != info.idlelog.rend(); i++)
+  for (int i = info.idlelog.size() - 1; i >= 0; i--)
     {
-      IdleInterval &idle = *i;
+      IdleInterval idle = info.idlelog.get(i);
 
       TRACE_MSG(idle.begin_time << " "
                 << idle.end_time << " "
@@ -1089,6 +1705,8 @@ IdleLogManager::fix_idlelog(ClientInfo &info)
             }
         }
 
+      info.idlelog.set_begin_time(i, idle.begin_time);
+
       if (idle.end_time != 0)
         {
           next_time = idle.end_time;
@@ -37,12 +37,14 @@
 
 #include <iostream>
 #include <string>
-#include <list>
 #include <map>
+#include <list>
+#include <vector>
 
 using namespace std;
 
 #include "ActivityMonitor.hh"
+#include "IdleLog.hh"
 
 class TimeSource;
 class PacketBuffer;
@@ -50,47 +52,51 @@ class PacketBuffer;
 class IdleLogManager
 {
 private:
-  // A Single idle time interval
-  struct IdleInterval
-  {
-    IdleInterval() :
-      begin_time(0),
-      end_idle_time(0),
-      end_time(0),
-      active_time(0),
-      to_be_saved(false)
+  //! How a client synchronizes its idle log.
+  enum SyncMode
     {
-    }
+      //! No idle log received yet.
+      SYNC_UNKNOWN,
 
-    IdleInterval(time_t b, time_t e) :
-      begin_time(b),
-      end_idle_time(e),
-      end_time(e),
-      active_time(0),
-      to_be_saved(false)
-    {
-    }
+      //! The client only sends its entire idle log.
+      SYNC_FULL,
 
-    //! Start time of idle interval
-    time_t begin_time;
+      //! The client sends the intervals that are new to its peers.
+      SYNC_INCREMENTAL
+    };
 
-    //! End time of idle interval (and start of active part)
-    time_t end_idle_time;
+  //! Format of the intervals in an idle log message.
+  enum SyncFormat
+    {
+      //! All intervals, packed like in the idle log file.
+      SYNC_FORMAT_FULL,
 
-    //! End time of active interval.
-    time_t end_time;
+      //! The new intervals, with delta encoded times.
+      SYNC_FORMAT_INCREMENTAL
+    };
 
-    //! Elapsed active time AFTER the idle interval.
-    time_t active_time;
+  //! Synchronization information in the header of an idle log message.
+  struct SyncHeader
+  {
+    SyncHeader() :
+      version(0),
+      format(SYNC_FORMAT_FULL),
+      base_time(0)
+    {
+    }
 
-    //! Yet to be saved
-    bool to_be_saved;
-  };
+    //! Version of the synchronization information, 0 if absent.
+    int version;
+
+    //! Format of the intervals that follow the header.
+    SyncFormat format;
 
+    //! Only the intervals that start at or after this time are sent.
+    time_t base_time;
 
-  typedef list<IdleInterval> IdleLog;
-  typedef IdleLog::iterator IdleLogIter;
-  typedef IdleLog::reverse_iterator IdleLogRIter;
+    //! Start time of the newest interval the sender has of each client.
+    map<string, time_t> watermarks;
+  };
 
   //! Idle information of a single client.
   struct ClientInfo
@@ -101,7 +107,14 @@ private:
       total_active_time(0),
       last_active_begin_time(0),
       last_active_time(0),
-      last_update_time()
+      last_update_time(),
+      connected(false),
+      sync_mode(SYNC_UNKNOWN),
+      sync_version(0),
+      sync_time(0),
+      acked_time(0),
+      sent_base_time(0),
+      delta_time(0)
     {
     }
 
@@ -132,6 +145,27 @@ private:
     //! Last time this idle log was updated.
     time_t last_update_time;
 
+    //! Is the client signed on?
+    bool connected;
+
+    //! How the client sent its idle log, kept while it runs the same version.
+    SyncMode sync_mode;
+
+    //! Version of the synchronization information the client sent.
+    int sync_version;
+
+    //! Start time of the newest interval received from the client (in its clock).
+    time_t sync_time;
+
+    //! Start time of the newest interval of my idle log that the client has.
+    time_t acked_time;
+
+    //! Base time of the last idle log I sent to the client.
+    time_t sent_base_time;
+
+    //! Difference between the clock of the client and mine.
+    time_t delta_time;
+
     //! Update the active time of the most recent idle interval.
     void update_active_time(time_t current_time)
     {
@@ -149,6 +183,40 @@ private:
   typedef map<string, ClientInfo> ClientMap;
   typedef ClientMap::iterator ClientMapIter;
 
+  //! Next begin or end of an idle interval of a client, used by compute_active_time.
+  struct SweepEvent
+  {
+    SweepEvent(const IdleLog *idlelog, int client) :
+      time(idlelog->get_end_idle_time(0)),
+      at_end(true),
+      client(client),
+      index(0),
+      idlelog(idlelog)
+    {
+    }
+
+    //! Time of the event.
+    time_t time;
+
+    //! Is this the end of the idle interval?
+    bool at_end;
+
+    //! Index of the client.
+    int client;
+
+    //! Index of the idle interval.
+    int index;
+
+    //! Idle log of the client.
+    const IdleLog *idlelog;
+
+    //! Orders a max-heap by time, the first client first for equal times.
+    bool operator<(const SweepEvent &other) const
+    {
+      return time < other.time || (time == other.time && client > other.client);
+    }
+  };
+
 private:
   // My ID
   string myid;
@@ -162,6 +230,15 @@ private:
   //! Last time we performed an expiration run.
   time_t last_expiration_time;
 
+  //! Packed intervals that are yet to be appended to the idle log files, by client.
+  map<string, string> unsaved_intervals;
+
+  //! Did the index change since it was saved?
+  bool index_dirty;
+
+  //! Last time the unsaved intervals and the index were written.
+  time_t last_flush_time;
+
 public:
   IdleLogManager(string myid, const TimeSource *control);
 
@@ -174,10 +251,14 @@ public:
   void signoff_remote_client(string client_id);
 
   void get_idlelog(PacketBuffer &buffer);
-  void set_idlelog(PacketBuffer &buffer);
+  void get_idlelog(PacketBuffer &buffer, const string &client_id);
+  bool set_idlelog(PacketBuffer &buffer);
+  bool is_incremental_sync_possible();
+  void get_connected_clients(list<string> &ids);
 
   time_t compute_total_active_time();
   time_t compute_active_time(int length);
+  void compute_active_time(const vector<int> &lengths, vector<time_t> &active_times);
   time_t compute_idle_time();
 
 private:
@@ -188,18 +269,33 @@ private:
   void pack_idle_interval(PacketBuffer &buffer, const IdleInterval &idle) const;
   void unpack_idle_interval(PacketBuffer &buffer, IdleInterval &idle, time_t delta_time) const;
 
-  void pack_idlelog(PacketBuffer &buffer, const ClientInfo &ci) const;
-  void unpack_idlelog(PacketBuffer &buffer, ClientInfo &ci, time_t &pack_time, int &num_intervals) const;
+  void pack_idlelog(PacketBuffer &buffer, const ClientInfo &ci, int num_intervals,
+                    const SyncHeader *sync = NULL) const;
+  void unpack_idlelog(PacketBuffer &buffer, ClientInfo &ci, time_t &pack_time, int &num_intervals,
+                      SyncHeader *sync = NULL) const;
+  void pack_sync_header(PacketBuffer &buffer, const SyncHeader &sync) const;
+  void unpack_sync_header(PacketBuffer &buffer, SyncHeader &sync) const;
+  void pack_idle_intervals(PacketBuffer &buffer, const IdleLog &idlelog, int count, time_t base_time) const;
+  void unpack_idle_intervals(PacketBuffer &buffer, IdleLog &idlelog, time_t base_time, time_t delta_time) const;
   void unlink_idlelog(PacketBuffer &buffer) const;
 
   void save_index();
   void load_index();
   void save_idlelog(ClientInfo &info);
   void load_idlelog(ClientInfo &info);
+  void find_unindexed_clients(vector<string> &ids);
+  string get_idlelog_filename(const string &id) const;
 
   void save();
   void load();
+  void flush();
   void update_idlelog(ClientInfo &info, const IdleInterval &idle);
+  void append_idlelog(ClientInfo &info, int count);
+
+  time_t get_sync_base_time();
+  void pack_sync_idlelog(PacketBuffer &buffer, bool incremental, time_t base_time);
+  void mark_idlelog_sent(ClientInfo &info, time_t base_time);
+  bool merge_idlelog(ClientInfo &info, const SyncHeader &sync, IdleLog &idlelog);
 
   void fix_idlelog(ClientInfo &info);
   void dump_idlelog(ClientInfo &info);
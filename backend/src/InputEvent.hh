@@ -0,0 +1,59 @@
+// InputEvent.hh --- Compact input event
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INPUTEVENT_HH
+#define INPUTEVENT_HH
+
+#include <glib.h>
+
+//! A single user input event, as reported by an input monitor.
+struct InputEvent
+{
+  enum InputEventType
+    {
+      INPUT_EVENT_ACTION,
+      INPUT_EVENT_MOUSE,
+      INPUT_EVENT_BUTTON,
+      INPUT_EVENT_KEYBOARD
+    };
+
+  //! Type of the event (InputEventType)
+  guint8 type;
+
+  //! Button pressed (button events), key repeated (keyboard events) or
+  //! coalesced motion (mouse events).
+  guint8 flag;
+
+  //! Mouse wheel delta.
+  gint16 wheel;
+
+  //! Mouse X coordinate.
+  gint32 x;
+
+  //! Mouse Y coordinate.
+  gint32 y;
+
+  //! Path length of coalesced mouse motion.
+  guint32 distance;
+
+  //! Wall clock time of the event in microseconds.
+  gint64 time;
+};
+
+#endif // INPUTEVENT_HH
@@ -0,0 +1,100 @@
+// InputEventQueue.hh --- Lock-free queue of input events
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef INPUTEVENTQUEUE_HH
+#define INPUTEVENTQUEUE_HH
+
+#include <glib.h>
+
+#include "InputEvent.hh"
+
+//! Single-producer/single-consumer ring buffer of input events.
+/*!
+ *  The input monitor thread is the only producer, the main loop the only
+ *  consumer. Neither side takes a lock: each side only writes its own index
+ *  and publishes it with an atomic store after the event data is in place.
+ *  One slot is always left empty to distinguish a full from an empty queue.
+ */
+class InputEventQueue
+{
+public:
+  enum
+    {
+      CAPACITY = 1024
+    };
+
+  InputEventQueue()
+    : head(0), tail(0)
+  {
+  }
+
+  //! Appends an event. Returns false if the queue is full.
+  bool push(const InputEvent &event)
+  {
+    gint h = g_atomic_int_get(&head);
+    gint next = (h + 1) & (CAPACITY - 1);
+
+    if (next == g_atomic_int_get(&tail))
+      {
+        return false;
+      }
+
+    events[h] = event;
+    g_atomic_int_set(&head, next);
+    return true;
+  }
+
+  //! Removes at most max events from the queue. Returns the number of events.
+  int pop(InputEvent *out, int max)
+  {
+    gint t = g_atomic_int_get(&tail);
+    gint h = g_atomic_int_get(&head);
+    int count = 0;
+
+    while (t != h && count < max)
+      {
+        out[count++] = events[t];
+        t = (t + 1) & (CAPACITY - 1);
+      }
+
+    g_atomic_int_set(&tail, t);
+    return count;
+  }
+
+  //! Is the queue empty?
+  bool is_empty() const
+  {
+    return g_atomic_int_get(&head) == g_atomic_int_get(&tail);
+  }
+
+private:
+  //! Index of the next slot to write. Owned by the producer.
+  volatile gint head;
+
+  //! Keep head and tail on different cache lines.
+  char padding[64 - sizeof(gint)];
+
+  //! Index of the next slot to read. Owned by the consumer.
+  volatile gint tail;
+
+  //! The events.
+  InputEvent events[CAPACITY];
+};
+
+#endif // INPUTEVENTQUEUE_HH
@@ -1,6 +1,6 @@
 // InputMonitor.cc
 //
-// Copyright (C) 2007, 2008 Rob Caelers <robc@krandor.nl>
+// Copyright (C) 2007, 2008, 2013 Rob Caelers <robc@krandor.nl>
 // All rights reserved.
 //
 // This program is free software: you can redistribute it and/or modify
@@ -22,19 +22,43 @@
 #endif
 
 #include <assert.h>
+#include <math.h>
+
+#include "debug.hh"
 
 #include "InputMonitor.hh"
 
+//! Time in milliseconds that input events are collected before being dispatched.
+static const guint DISPATCH_INTERVAL = 20;
+
+//! Maximum number of events passed to a listener at once.
+static const int DISPATCH_BATCH_SIZE = 256;
+
+//! Mouse jumps larger than this are not added to the coalesced path length.
+static const int MAX_MOTION_JUMP = 10000;
+
 
 InputMonitor::InputMonitor()
   : activity_listener(NULL),
-    statistics_listener(NULL)
+    statistics_listener(NULL),
+    dispatch_pending(0),
+    motion_flush_scheduled(false),
+    dropped_events(0),
+    motion_window(0),
+    motion_window_start(0),
+    motion_x(-1),
+    motion_y(-1),
+    motion_distance(0.0),
+    motion_pending(false)
 {
 }
 
 
 InputMonitor::~InputMonitor()
 {
+  while (g_source_remove_by_user_data(this))
+    {
+    }
 }
 
 
@@ -70,3 +94,246 @@ InputMonitor::unsubscribe_statistics(IInputMonitorListener *listener)
   assert(statistics_listener != NULL);
   statistics_listener = NULL;
 }
+
+
+//! Enables coalescing of mouse motion within the specified window.
+/*!
+ *  All motion events within \c millis milliseconds after a reported motion
+ *  event are merged into a single event that carries the last position and
+ *  the total path length. Must be called before the monitor is started.
+ *
+ *  \param millis length of the window in milliseconds, 0 disables coalescing.
+ */
+void
+InputMonitor::set_motion_window(int millis)
+{
+  if (millis < 0)
+    {
+      millis = 0;
+    }
+  else if (millis > 1000)
+    {
+      millis = 1000;
+    }
+
+  motion_window = (gint64) millis * 1000;
+}
+
+
+//! Queues an input event. Called from the monitor thread.
+void
+InputMonitor::post_event(InputEvent::InputEventType type, int flag, int x, int y, int wheel)
+{
+  InputEvent event;
+  event.type = type;
+  event.flag = flag;
+  event.wheel = wheel;
+  event.x = x;
+  event.y = y;
+  event.distance = 0;
+  event.time = g_get_real_time();
+
+  queue_event(event);
+}
+
+
+//! Queues an input event. Called from the monitor thread.
+void
+InputMonitor::queue_event(const InputEvent &event)
+{
+  if (activity_listener == NULL && statistics_listener == NULL)
+    {
+      return;
+    }
+
+  if (!queue.push(event))
+    {
+      g_atomic_int_inc(&dropped_events);
+    }
+
+  // Only the first event after a dispatch schedules a new one, so that
+  // the main loop processes the events in batches.
+  if (g_atomic_int_compare_and_exchange(&dispatch_pending, 0, 1))
+    {
+      g_timeout_add(DISPATCH_INTERVAL, static_dispatch_events, this);
+    }
+}
+
+
+//! Merges a motion event into the current motion window. Called from the main loop.
+/*!
+ *  Events that must be reported are appended to \c events.
+ */
+void
+InputMonitor::coalesce_motion(const InputEvent &event, InputEvent *events, int &count)
+{
+  if (motion_window_start != 0 && event.time - motion_window_start < motion_window)
+    {
+      if (!motion_pending)
+        {
+          pending_motion = event;
+          pending_motion.flag = 1;
+          motion_distance = 0.0;
+          motion_pending = true;
+
+          // Without further input, the motion is reported when the window expires.
+          if (!motion_flush_scheduled)
+            {
+              gint64 remaining = motion_window_start + motion_window - g_get_real_time();
+              motion_flush_scheduled = true;
+              g_timeout_add(remaining > 0 ? (guint)(remaining / 1000) + 1 : 0,
+                            static_flush_expired_motion, this);
+            }
+        }
+
+      int delta_x = event.x - motion_x;
+      int delta_y = event.y - motion_y;
+
+      if (motion_x >= 0 && motion_y >= 0 &&
+          abs(delta_x) < MAX_MOTION_JUMP && abs(delta_y) < MAX_MOTION_JUMP)
+        {
+          motion_distance += sqrt((double)(delta_x * delta_x + delta_y * delta_y));
+        }
+
+      pending_motion.x = event.x;
+      pending_motion.y = event.y;
+      pending_motion.time = event.time;
+    }
+  else
+    {
+      // First motion of a new window is reported immediately.
+      flush_motion(events, count);
+      events[count++] = event;
+      motion_window_start = event.time;
+    }
+
+  motion_x = event.x;
+  motion_y = event.y;
+}
+
+
+//! Appends the coalesced motion event, if any, to \c events. Called from the main loop.
+void
+InputMonitor::flush_motion(InputEvent *events, int &count)
+{
+  if (motion_pending)
+    {
+      pending_motion.distance = (guint32) motion_distance;
+      events[count++] = pending_motion;
+      motion_pending = false;
+    }
+}
+
+
+//! Reports the coalesced motion event if its window expired. Called from the main loop.
+/*!
+ *  \retval true if the window has not expired yet.
+ */
+bool
+InputMonitor::flush_expired_motion()
+{
+  bool ret = false;
+
+  if (motion_pending && g_get_real_time() - motion_window_start < motion_window)
+    {
+      ret = true;
+    }
+  else
+    {
+      // Events still in the queue are newer than the coalesced motion.
+      InputEvent event;
+      int count = 0;
+
+      flush_motion(&event, count);
+      notify_listeners(&event, count);
+      motion_flush_scheduled = false;
+    }
+
+  return ret;
+}
+
+
+//! Passes all queued input events to the listeners. Called from the main loop.
+/*!
+ *  Motion events are coalesced here rather than in the monitor thread, so
+ *  that the monitor thread only writes to the queue and never blocks.
+ */
+void
+InputMonitor::dispatch_events()
+{
+  InputEvent events[DISPATCH_BATCH_SIZE];
+  // One extra slot for a coalesced motion event from a previous batch.
+  InputEvent reported[DISPATCH_BATCH_SIZE + 1];
+
+  // Reset before draining; an event posted while draining schedules a new dispatch.
+  g_atomic_int_set(&dispatch_pending, 0);
+
+  int count;
+  while ((count = queue.pop(events, DISPATCH_BATCH_SIZE)) > 0)
+    {
+      if (motion_window > 0)
+        {
+          int num_reported = 0;
+          for (int i = 0; i < count; i++)
+            {
+              if (events[i].type == InputEvent::INPUT_EVENT_MOUSE && events[i].wheel == 0)
+                {
+                  coalesce_motion(events[i], reported, num_reported);
+                }
+              else
+                {
+                  flush_motion(reported, num_reported);
+                  reported[num_reported++] = events[i];
+                }
+            }
+          notify_listeners(reported, num_reported);
+        }
+      else
+        {
+          notify_listeners(events, count);
+        }
+    }
+
+  gint dropped = g_atomic_int_get(&dropped_events);
+  if (dropped > 0)
+    {
+      TRACE_ENTER_MSG("InputMonitor::dispatch_events", dropped);
+      g_atomic_int_add(&dropped_events, -dropped);
+      TRACE_EXIT();
+    }
+}
+
+
+//! Passes input events to the listeners. Called from the main loop.
+void
+InputMonitor::notify_listeners(const InputEvent *events, int count)
+{
+  if (count > 0)
+    {
+      if (activity_listener != NULL)
+        {
+          activity_listener->input_events_notify(events, count);
+        }
+      if (statistics_listener != NULL)
+        {
+          statistics_listener->input_events_notify(events, count);
+        }
+    }
+}
+
+
+gboolean
+InputMonitor::static_dispatch_events(gpointer data)
+{
+  InputMonitor *monitor = (InputMonitor *) data;
+  monitor->dispatch_events();
+  return FALSE;
+}
+
+
+gboolean
+InputMonitor::static_flush_expired_motion(gpointer data)
+{
+  InputMonitor *monitor = (InputMonitor *) data;
+  return monitor->flush_expired_motion();
+}
@@ -21,8 +21,11 @@
 #define INPUTMONITOR_HH
 
 #include <stdlib.h>
+#include <glib.h>
+
 #include "IInputMonitor.hh"
 #include "IInputMonitorListener.hh"
+#include "InputEventQueue.hh"
 
 // Forward declarion of internal interfaces.
 class IInputMonitorListener;
@@ -40,18 +43,67 @@ public:
   virtual void unsubscribe_activity(IInputMonitorListener *listener);
   virtual void unsubscribe_statistics(IInputMonitorListener *listener);
 
+  void set_motion_window(int millis);
+
 protected:
   void fire_action();
   void fire_mouse(int x, int y, int wheel = 0);
   void fire_button(bool is_press);
   void fire_keyboard(bool repeat);
 
+private:
+  void post_event(InputEvent::InputEventType type, int flag, int x, int y, int wheel);
+  void queue_event(const InputEvent &event);
+  void coalesce_motion(const InputEvent &event, InputEvent *events, int &count);
+  void flush_motion(InputEvent *events, int &count);
+  bool flush_expired_motion();
+  void dispatch_events();
+  void notify_listeners(const InputEvent *events, int count);
+
+  static gboolean static_dispatch_events(gpointer data);
+  static gboolean static_flush_expired_motion(gpointer data);
+
 private:
   //!
   IInputMonitorListener *activity_listener;
 
   //!
   IInputMonitorListener *statistics_listener;
+
+  //! Events from the monitor thread waiting to be dispatched by the main loop.
+  InputEventQueue queue;
+
+  //! Is a dispatch of the queue scheduled in the main loop?
+  volatile gint dispatch_pending;
+
+  //! Is a flush of an expired motion window scheduled in the main loop?
+  bool motion_flush_scheduled;
+
+  //! Number of events dropped because the queue was full.
+  volatile gint dropped_events;
+
+  // The motion state below is only used by the main loop.
+
+  //! Time window in microseconds in which motion events are coalesced, 0 if disabled.
+  gint64 motion_window;
+
+  //! Start of the current motion window.
+  gint64 motion_window_start;
+
+  //! Last reported mouse X coordinate.
+  int motion_x;
+
+  //! Last reported mouse Y coordinate.
+  int motion_y;
+
+  //! Path length of the motion coalesced so far.
+  double motion_distance;
+
+  //! Coalesced motion event that is not yet queued.
+  InputEvent pending_motion;
+
+  //! Is pending_motion valid?
+  bool motion_pending;
 };
 
 #include "InputMonitor.icc"
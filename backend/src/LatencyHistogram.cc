@@ -0,0 +1,180 @@
+// LatencyHistogram.cc --- Histogram of latencies
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "LatencyHistogram.hh"
+
+
+//! Constructor
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+
+//! Records a value.
+void
+LatencyHistogram::record(gint64 usec)
+{
+  if (usec < 0)
+    {
+      usec = 0;
+    }
+
+  counts[get_bucket(usec)]++;
+
+  if (count == 0 || usec < min)
+    {
+      min = usec;
+    }
+  if (usec > max)
+    {
+      max = usec;
+    }
+
+  count++;
+  sum += usec;
+}
+
+
+//! Removes all values.
+void
+LatencyHistogram::reset()
+{
+  memset(counts, 0, sizeof(counts));
+  count = 0;
+  sum = 0;
+  min = 0;
+  max = 0;
+}
+
+
+//! Returns the number of values.
+gint64
+LatencyHistogram::get_count() const
+{
+  return count;
+}
+
+
+//! Returns the smallest value.
+gint64
+LatencyHistogram::get_min() const
+{
+  return min;
+}
+
+
+//! Returns the largest value.
+gint64
+LatencyHistogram::get_max() const
+{
+  return max;
+}
+
+
+//! Returns the average value.
+gint64
+LatencyHistogram::get_mean() const
+{
+  return count > 0 ? sum / count : 0;
+}
+
+
+//! Returns the value below which the specified percentage of values fall.
+/*!
+ *  The result is the upper limit of the bucket that contains the
+ *  percentile, so it never underestimates the latency.
+ */
+gint64
+LatencyHistogram::get_percentile(double percentile) const
+{
+  if (count == 0)
+    {
+      return 0;
+    }
+
+  gint64 target = (gint64)(percentile * count / 100.0 + 0.5);
+  if (target < 1)
+    {
+      target = 1;
+    }
+
+  gint64 seen = 0;
+  for (int i = 0; i < BUCKETS; i++)
+    {
+      seen += counts[i];
+      if (seen >= target)
+        {
+          // The last bucket also counts all values beyond the range.
+          gint64 limit = (i == BUCKETS - 1) ? max : get_bucket_limit(i);
+          return limit < max ? limit : max;
+        }
+    }
+
+  return max;
+}
+
+
+//! Returns the bucket of a value.
+int
+LatencyHistogram::get_bucket(gint64 value)
+{
+  if (value < SUB_BUCKETS)
+    {
+      return (int) value;
+    }
+
+  int magnitude = SUB_BUCKET_BITS;
+  while (magnitude < MAX_MAGNITUDE && (value >> (magnitude + 1)) != 0)
+    {
+      magnitude++;
+    }
+
+  if ((value >> (magnitude + 1)) != 0)
+    {
+      // Beyond the range of the histogram.
+      return BUCKETS - 1;
+    }
+
+  int sub = (int)(value >> (magnitude - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+  return SUB_BUCKETS + (magnitude - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+
+//! Returns the largest value that is counted in a bucket.
+gint64
+LatencyHistogram::get_bucket_limit(int bucket)
+{
+  if (bucket < SUB_BUCKETS)
+    {
+      return bucket;
+    }
+
+  int magnitude = (bucket - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+  int sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+  int shift = magnitude - SUB_BUCKET_BITS;
+
+  return (((gint64)(SUB_BUCKETS + sub + 1)) << shift) - 1;
+}
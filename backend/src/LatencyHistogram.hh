@@ -0,0 +1,81 @@
+// LatencyHistogram.hh --- Histogram of latencies
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef LATENCYHISTOGRAM_HH
+#define LATENCYHISTOGRAM_HH
+
+#include <glib.h>
+
+//! Histogram of latencies in microseconds.
+/*!
+ *  Values are counted in buckets with a fixed relative precision: each
+ *  power of two is divided into 16 linear buckets, so a percentile is
+ *  accurate to within about 6%. Recording a value does not allocate.
+ */
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  void record(gint64 usec);
+  void reset();
+
+  gint64 get_count() const;
+  gint64 get_min() const;
+  gint64 get_max() const;
+  gint64 get_mean() const;
+  gint64 get_percentile(double percentile) const;
+
+private:
+  enum
+    {
+      //! Number of buckets per power of two.
+      SUB_BUCKETS = 16,
+
+      //! log2(SUB_BUCKETS)
+      SUB_BUCKET_BITS = 4,
+
+      //! Largest power of two that is counted separately.
+      MAX_MAGNITUDE = 40,
+
+      //! Total number of buckets.
+      BUCKETS = SUB_BUCKETS + (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKETS
+    };
+
+  static int get_bucket(gint64 value);
+  static gint64 get_bucket_limit(int bucket);
+
+private:
+  //! Number of values per bucket.
+  guint32 counts[BUCKETS];
+
+  //! Total number of values.
+  gint64 count;
+
+  //! Sum of all values.
+  gint64 sum;
+
+  //! Smallest value.
+  gint64 min;
+
+  //! Largest value.
+  gint64 max;
+};
+
+#endif // LATENCYHISTOGRAM_HH
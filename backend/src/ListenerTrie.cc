@@ -0,0 +1,275 @@
+// ListenerTrie.cc --- Configuration listeners by key prefix
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+
+#include "ListenerTrie.hh"
+
+using namespace std;
+
+
+//! Constructor
+ListenerTrie::ListenerTrie()
+{
+  root = new Node("");
+}
+
+
+//! Destructor
+ListenerTrie::~ListenerTrie()
+{
+  destroy(root);
+}
+
+
+//! Adds a listener to a prefix.
+/*!
+ *  \retval false if the listener already listens to the prefix.
+ */
+bool
+ListenerTrie::add(const string &prefix, IConfiguratorListener *listener)
+{
+  Node *node = root;
+  string::size_type pos = 0;
+
+  while (pos < prefix.length())
+    {
+      map<char, Node *>::iterator it = node->children.find(prefix[pos]);
+      if (it == node->children.end())
+        {
+          Node *leaf = new Node(prefix.substr(pos));
+          node->children[prefix[pos]] = leaf;
+
+          node = leaf;
+          pos = prefix.length();
+        }
+      else
+        {
+          Node *child = it->second;
+          string::size_type common = 1;
+
+          while (common < child->label.length() && pos + common < prefix.length() &&
+                 child->label[common] == prefix[pos + common])
+            {
+              common++;
+            }
+
+          if (common < child->label.length())
+            {
+              // The prefix ends or diverges within the label; split it.
+              Node *split = new Node(child->label.substr(0, common));
+              child->label = child->label.substr(common);
+              split->children[child->label[0]] = child;
+              it->second = split;
+              child = split;
+            }
+
+          node = child;
+          pos += common;
+        }
+    }
+
+  bool ret = find(node->listeners.begin(), node->listeners.end(), listener) == node->listeners.end();
+  if (ret)
+    {
+      node->listeners.push_back(listener);
+      prefixes.insert(make_pair(listener, prefix));
+    }
+
+  return ret;
+}
+
+
+//! Removes a listener from a prefix.
+/*!
+ *  \retval false if the listener did not listen to the prefix.
+ */
+bool
+ListenerTrie::remove(const string &prefix, IConfiguratorListener *listener)
+{
+  bool ret = remove(root, prefix, 0, listener);
+
+  if (ret)
+    {
+      pair<Prefixes::iterator, Prefixes::iterator> range = prefixes.equal_range(listener);
+      for (Prefixes::iterator it = range.first; it != range.second; it++)
+        {
+          if (it->second == prefix)
+            {
+              prefixes.erase(it);
+              break;
+            }
+        }
+    }
+
+  return ret;
+}
+
+
+//! Removes a listener from all prefixes.
+/*!
+ *  \retval false if the listener did not listen to any prefix.
+ */
+bool
+ListenerTrie::remove(IConfiguratorListener *listener)
+{
+  pair<Prefixes::iterator, Prefixes::iterator> range = prefixes.equal_range(listener);
+  list<string> listener_prefixes;
+
+  for (Prefixes::iterator it = range.first; it != range.second; it++)
+    {
+      listener_prefixes.push_back(it->second);
+    }
+
+  for (list<string>::iterator it = listener_prefixes.begin(); it != listener_prefixes.end(); it++)
+    {
+      remove(*it, listener);
+    }
+
+  return !listener_prefixes.empty();
+}
+
+
+//! Does the listener listen to any prefix?
+bool
+ListenerTrie::contains(IConfiguratorListener *listener) const
+{
+  return prefixes.find(listener) != prefixes.end();
+}
+
+
+//! Returns the first prefix the listener was added to.
+bool
+ListenerTrie::find_prefix(IConfiguratorListener *listener, string &prefix) const
+{
+  bool ret = false;
+
+  Prefixes::const_iterator it = prefixes.find(listener);
+  if (it != prefixes.end())
+    {
+      prefix = it->second;
+      ret = true;
+    }
+
+  return ret;
+}
+
+
+//! Appends the listeners of all prefixes of the key, shortest prefix first.
+void
+ListenerTrie::find_listeners(const string &key, Listeners &listeners) const
+{
+  const Node *node = root;
+  string::size_type pos = 0;
+
+  while (node != NULL)
+    {
+      listeners.insert(listeners.end(), node->listeners.begin(), node->listeners.end());
+
+      const Node *next = NULL;
+      if (pos < key.length())
+        {
+          map<char, Node *>::const_iterator it = node->children.find(key[pos]);
+          if (it != node->children.end() &&
+              key.compare(pos, it->second->label.length(), it->second->label) == 0)
+            {
+              next = it->second;
+              pos += next->label.length();
+            }
+        }
+
+      node = next;
+    }
+}
+
+
+//! Removes a listener from the prefix below a node and prunes the trie.
+bool
+ListenerTrie::remove(Node *node, const string &prefix, string::size_type pos,
+                     IConfiguratorListener *listener)
+{
+  bool ret = false;
+
+  if (pos == prefix.length())
+    {
+      list<IConfiguratorListener *>::iterator it = find(node->listeners.begin(), node->listeners.end(), listener);
+      if (it != node->listeners.end())
+        {
+          node->listeners.erase(it);
+          ret = true;
+        }
+    }
+  else
+    {
+      map<char, Node *>::iterator it = node->children.find(prefix[pos]);
+      if (it != node->children.end())
+        {
+          Node *child = it->second;
+          if (prefix.compare(pos, child->label.length(), child->label) == 0)
+            {
+              ret = remove(child, prefix, pos + child->label.length(), listener);
+            }
+
+          if (ret && child->listeners.empty() && child->children.empty())
+            {
+              delete child;
+              node->children.erase(it);
+            }
+          else if (ret)
+            {
+              merge(child);
+            }
+        }
+    }
+
+  return ret;
+}
+
+
+//! Merges a node without listeners into its only child.
+void
+ListenerTrie::merge(Node *node)
+{
+  if (node->listeners.empty() && node->children.size() == 1)
+    {
+      Node *child = node->children.begin()->second;
+
+      node->label += child->label;
+      node->children.swap(child->children);
+      node->listeners.swap(child->listeners);
+      delete child;
+    }
+}
+
+
+//! Deletes a node and all nodes below it.
+void
+ListenerTrie::destroy(Node *node)
+{
+  for (map<char, Node *>::iterator it = node->children.begin(); it != node->children.end(); it++)
+    {
+      destroy(it->second);
+    }
+
+  delete node;
+}
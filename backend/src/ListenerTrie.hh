@@ -0,0 +1,90 @@
+// ListenerTrie.hh --- Configuration listeners by key prefix
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef LISTENERTRIE_HH
+#define LISTENERTRIE_HH
+
+#include <string>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace workrave {
+  class IConfiguratorListener;
+}
+
+using namespace workrave;
+
+//! Configuration listeners, indexed by the key prefix they listen to.
+/*!
+ *  The prefixes are stored in a radix trie, so finding the listeners of a
+ *  key takes one walk along the key and visits only the prefixes that
+ *  match. A prefix matches all keys that start with it, including keys
+ *  that continue within the same path component.
+ */
+class ListenerTrie
+{
+public:
+  typedef std::vector<IConfiguratorListener *> Listeners;
+
+  ListenerTrie();
+  ~ListenerTrie();
+
+  bool add(const std::string &prefix, IConfiguratorListener *listener);
+  bool remove(const std::string &prefix, IConfiguratorListener *listener);
+  bool remove(IConfiguratorListener *listener);
+
+  bool contains(IConfiguratorListener *listener) const;
+  bool find_prefix(IConfiguratorListener *listener, std::string &prefix) const;
+  void find_listeners(const std::string &key, Listeners &listeners) const;
+
+private:
+  struct Node
+  {
+    Node(const std::string &label) : label(label) {}
+
+    //! Part of the prefix between the parent and this node.
+    std::string label;
+
+    //! Child nodes, by the first character of their label.
+    std::map<char, Node *> children;
+
+    //! Listeners to the prefix that ends at this node.
+    std::list<IConfiguratorListener *> listeners;
+  };
+
+  typedef std::multimap<IConfiguratorListener *, std::string> Prefixes;
+
+  ListenerTrie(const ListenerTrie &);
+  ListenerTrie &operator=(const ListenerTrie &);
+
+  bool remove(Node *node, const std::string &prefix, std::string::size_type pos,
+              IConfiguratorListener *listener);
+  void merge(Node *node);
+  void destroy(Node *node);
+
+private:
+  //! Node of the empty prefix.
+  Node *root;
+
+  //! Prefixes of each listener, in the order they were added.
+  Prefixes prefixes;
+};
+
+#endif // LISTENERTRIE_HH
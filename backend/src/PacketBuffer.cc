@@ -35,7 +35,8 @@ PacketBuffer::PacketBuffer() :
   write_ptr(NULL),
   buffer_size(0),
   original_buffer(NULL),
-  original_buffer_size(0)
+  original_buffer_size(0),
+  borrowed(false)
 {
 }
 
@@ -43,7 +44,7 @@ PacketBuffer::PacketBuffer() :
 PacketBuffer::~PacketBuffer()
 {
   narrow(0, -1);
-  if (buffer != NULL)
+  if (buffer != NULL && !borrowed)
     {
       g_free(buffer);
     }
@@ -54,7 +55,7 @@ PacketBuffer::create(int size)
 {
   narrow(0, -1);
 
-  if (buffer != NULL)
+  if (buffer != NULL && !borrowed)
     {
       g_free(buffer);
     }
@@ -68,6 +69,30 @@ PacketBuffer::create(int size)
   read_ptr = buffer;
   write_ptr = buffer;
   buffer_size = size;
+  borrowed = false;
+}
+
+
+//! Uses the specified data as packet without copying it.
+/*!
+ *  The data must remain valid for as long as the buffer uses it. The data
+ *  is copied as soon as the buffer needs to grow.
+ */
+void
+PacketBuffer::borrow(guint8 *data, int size)
+{
+  narrow(0, -1);
+
+  if (buffer != NULL && !borrowed)
+    {
+      g_free(buffer);
+    }
+
+  buffer = data;
+  read_ptr = buffer;
+  write_ptr = buffer + size;
+  buffer_size = size;
+  borrowed = true;
 }
 
 
@@ -99,7 +124,17 @@ PacketBuffer::resize(int size)
 
       //TRACE_MSG(read_offset << " " << write_offset);
 
-      buffer = g_renew(guint8, buffer, size);
+      if (borrowed)
+        {
+          guint8 *data = g_new(guint8, size);
+          memcpy(data, buffer, MIN(buffer_size, size));
+          buffer = data;
+          borrowed = false;
+        }
+      else
+        {
+          buffer = g_renew(guint8, buffer, size);
+        }
 
       //TRACE_MSG(buffer);
 
@@ -252,6 +287,23 @@ PacketBuffer::pack_byte(guint8 data)
 }
 
 
+//! Packs a value in as few bytes as possible.
+/*!
+ *  Each byte holds 7 bits of the value, least significant first. The high
+ *  bit is set in all bytes but the last.
+ */
+void
+PacketBuffer::pack_varint(guint32 data)
+{
+  while (data >= 0x80)
+    {
+      pack_byte((guint8)(data | 0x80));
+      data >>= 7;
+    }
+  pack_byte((guint8)data);
+}
+
+
 void
 PacketBuffer::poke_byte(int pos, guint8 data)
 {
@@ -399,6 +451,25 @@ PacketBuffer::unpack_byte()
 }
 
 
+guint32
+PacketBuffer::unpack_varint()
+{
+  guint32 ret = 0;
+
+  for (int shift = 0; shift < 35 && read_ptr < write_ptr; shift += 7)
+    {
+      guint8 data = unpack_byte();
+
+      ret |= (guint32)(data & 0x7f) << shift;
+      if ((data & 0x80) == 0)
+        {
+          break;
+        }
+    }
+  return ret;
+}
+
+
 int
 PacketBuffer::peek(int pos, guint8 **data)
 {
@@ -520,6 +591,11 @@ PacketBuffer::skip_size(int &pos)
 void
 PacketBuffer::insert(int pos, int size)
 {
+  if (write_ptr + size >= buffer + buffer_size)
+    {
+      grow(size);
+    }
+
   if (pos < bytes_written())
     {
       int move = bytes_written() - pos;
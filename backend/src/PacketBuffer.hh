@@ -34,6 +34,7 @@ public:
   ~PacketBuffer();
 
   void create(int size = 0);
+  void borrow(guint8 *data, int size);
   void resize(int size);
   void grow(int size);
   void narrow(int pos, int size);
@@ -50,6 +51,7 @@ public:
   void pack_ushort(guint16 data);
   void pack_ulong(guint32 data);
   void pack_byte(guint8 data);
+  void pack_varint(guint32 data);
 
   void poke_byte(int pos, guint8 data);
   void poke_ushort(int pos, guint16 data);
@@ -61,6 +63,7 @@ public:
   guint32 unpack_ulong();
   guint16 unpack_ushort();
   guint8 unpack_byte();
+  guint32 unpack_varint();
 
   int peek(int pos, guint8 **data);
   gchar *peek_string(int pos);
@@ -89,6 +92,9 @@ public:
 
   guint8 *original_buffer;
   int original_buffer_size;
+
+  //! Is the buffer owned by someone else?
+  bool borrowed;
 };
 
 
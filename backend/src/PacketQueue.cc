@@ -0,0 +1,215 @@
+// PacketQueue.cc --- Queue of outgoing packets
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "PacketQueue.hh"
+#include "SocketDriver.hh"
+
+using namespace std;
+
+
+//! Creates a packet with a copy of the specified data and one reference.
+SharedPacket::SharedPacket(const gchar *data, gsize size) :
+  refcount(1),
+  size(size)
+{
+  this->data = g_new(gchar, size);
+  memcpy(this->data, data, size);
+}
+
+
+//! Creates a packet with a copy of the prefix followed by the data.
+SharedPacket::SharedPacket(const gchar *prefix, gsize prefix_size, const gchar *data, gsize size) :
+  refcount(1),
+  size(prefix_size + size)
+{
+  this->data = g_new(gchar, this->size);
+  memcpy(this->data, prefix, prefix_size);
+  memcpy(this->data + prefix_size, data, size);
+}
+
+
+//! Destructor
+SharedPacket::~SharedPacket()
+{
+  g_free(data);
+}
+
+
+//! Adds a reference.
+void
+SharedPacket::ref()
+{
+  refcount++;
+}
+
+
+//! Removes a reference, deleting the packet after the last one.
+void
+SharedPacket::unref()
+{
+  if (--refcount == 0)
+    {
+      delete this;
+    }
+}
+
+
+//! Returns the serialized packet.
+const gchar *
+SharedPacket::get_data() const
+{
+  return data;
+}
+
+
+//! Returns the size of the packet.
+gsize
+SharedPacket::get_size() const
+{
+  return size;
+}
+
+
+//! Constructor
+PacketQueue::PacketQueue() :
+  offset(0),
+  size(0)
+{
+}
+
+
+//! Destructor
+PacketQueue::~PacketQueue()
+{
+  clear();
+}
+
+
+//! Appends a packet to the queue.
+void
+PacketQueue::push(SharedPacket *packet)
+{
+  packet->ref();
+  packets.push_back(packet);
+  size += packet->get_size();
+}
+
+
+//! Writes as much of the queue as the socket accepts.
+/*!
+ *  \return the number of bytes written.
+ *  \throw SocketException if the socket fails.
+ */
+int
+PacketQueue::flush(ISocket *socket)
+{
+  int total = 0;
+  bool full = false;
+
+  while (!full && !packets.empty())
+    {
+      SocketBuffer buffers[MAX_BUFFERS];
+      int count = 0;
+      int bytes = 0;
+
+      for (deque<SharedPacket *>::iterator i = packets.begin();
+           i != packets.end() && count < MAX_BUFFERS; i++)
+        {
+          gsize skip = (count == 0) ? offset : 0;
+
+          buffers[count].data = (*i)->get_data() + skip;
+          buffers[count].size = (int)((*i)->get_size() - skip);
+          bytes += buffers[count].size;
+          count++;
+        }
+
+      int bytes_written = 0;
+      socket->writev(buffers, count, bytes_written);
+
+      consume(bytes_written);
+      total += bytes_written;
+      full = (bytes_written < bytes);
+    }
+
+  return total;
+}
+
+
+//! Removes all packets.
+void
+PacketQueue::clear()
+{
+  for (deque<SharedPacket *>::iterator i = packets.begin(); i != packets.end(); i++)
+    {
+      (*i)->unref();
+    }
+
+  packets.clear();
+  offset = 0;
+  size = 0;
+}
+
+
+//! Is the queue empty?
+bool
+PacketQueue::empty() const
+{
+  return packets.empty();
+}
+
+
+//! Returns the number of bytes still to be written.
+gsize
+PacketQueue::get_size() const
+{
+  return size;
+}
+
+
+//! Removes the specified number of written bytes from the queue.
+void
+PacketQueue::consume(gsize bytes)
+{
+  size -= bytes;
+
+  while (bytes > 0 && !packets.empty())
+    {
+      SharedPacket *packet = packets.front();
+      gsize left = packet->get_size() - offset;
+
+      if (bytes < left)
+        {
+          offset += bytes;
+          bytes = 0;
+        }
+      else
+        {
+          bytes -= left;
+          offset = 0;
+          packet->unref();
+          packets.pop_front();
+        }
+    }
+}
@@ -0,0 +1,98 @@
+// PacketQueue.hh --- Queue of outgoing packets
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef PACKETQUEUE_HH
+#define PACKETQUEUE_HH
+
+#include <deque>
+
+#include <glib.h>
+
+class ISocket;
+
+//! Serialized packet that is shared by several queues.
+/*!
+ *  The packet is reference counted, so a broadcast packet is serialized
+ *  once and queued for all recipients without copying.
+ */
+class SharedPacket
+{
+public:
+  SharedPacket(const gchar *data, gsize size);
+  SharedPacket(const gchar *prefix, gsize prefix_size, const gchar *data, gsize size);
+
+  void ref();
+  void unref();
+
+  const gchar *get_data() const;
+  gsize get_size() const;
+
+private:
+  ~SharedPacket();
+
+private:
+  //! Number of references.
+  int refcount;
+
+  //! The serialized packet.
+  gchar *data;
+
+  //! Size of the packet.
+  gsize size;
+};
+
+
+//! Queue of packets waiting to be written to a socket.
+class PacketQueue
+{
+public:
+  PacketQueue();
+  ~PacketQueue();
+
+  void push(SharedPacket *packet);
+  int flush(ISocket *socket);
+  void clear();
+
+  bool empty() const;
+  gsize get_size() const;
+
+private:
+  enum
+    {
+      //! Maximum number of packets written at once.
+      MAX_BUFFERS = 16
+    };
+
+  PacketQueue(const PacketQueue &);
+  PacketQueue &operator=(const PacketQueue &);
+
+  void consume(gsize bytes);
+
+private:
+  //! Queued packets.
+  std::deque<SharedPacket *> packets;
+
+  //! Number of bytes of the first packet that were already written.
+  gsize offset;
+
+  //! Number of bytes still to be written.
+  gsize size;
+};
+
+#endif // PACKETQUEUE_HH
@@ -0,0 +1,208 @@
+// PacketReader.cc --- Splits a stream into packets
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "PacketReader.hh"
+#include "PacketBuffer.hh"
+#include "SocketDriver.hh"
+
+
+//! Constructor
+PacketReader::PacketReader() :
+  buffer(NULL),
+  buffer_size(0),
+  start(0),
+  end(0),
+  valid(true),
+  long_packets_enabled(false)
+{
+}
+
+
+//! Destructor
+PacketReader::~PacketReader()
+{
+  g_free(buffer);
+}
+
+
+//! Reads the data that is available from the socket.
+/*!
+ *  \return the number of bytes read, 0 if the connection was closed.
+ *  \throw SocketException if the socket fails.
+ */
+int
+PacketReader::read(ISocket *socket)
+{
+  reserve();
+
+  int bytes_read = 0;
+  socket->read(buffer + end, buffer_size - end, bytes_read);
+
+  end += bytes_read;
+  return bytes_read;
+}
+
+
+//! Takes the next complete packet.
+/*!
+ *  The packet borrows the data, which remains valid until the next read.
+ *
+ *  \retval false if there is no complete packet, or the stream is not
+ *  well-formed.
+ */
+bool
+PacketReader::next(PacketBuffer &packet)
+{
+  int offset = 0;
+  int size = peek_size(offset);
+
+  if (size < 0 || (size != 0 && size - offset < HEADER_SIZE))
+    {
+      valid = false;
+    }
+
+  if (!valid || size == 0 || end - start < size)
+    {
+      return false;
+    }
+
+  packet.borrow(buffer + start + offset, size - offset);
+  start += size;
+
+  if (start == end)
+    {
+      start = end = 0;
+    }
+
+  return true;
+}
+
+
+//! Is the stream well-formed?
+bool
+PacketReader::is_valid() const
+{
+  return valid;
+}
+
+
+//! Discards all data, and disables long packets.
+void
+PacketReader::clear()
+{
+  start = end = 0;
+  valid = true;
+  long_packets_enabled = false;
+}
+
+
+//! Enables or disables long packets.
+void
+PacketReader::set_long_packets_enabled(bool enabled)
+{
+  long_packets_enabled = enabled;
+}
+
+
+//! Returns the size of the first packet, or 0 if it is not yet known.
+/*!
+ *  The size includes the extended header, if any. \a offset is set to the
+ *  start of the packet itself.
+ *
+ *  \return -1 if the packet is a long packet that is not accepted.
+ */
+int
+PacketReader::peek_size(int &offset) const
+{
+  offset = 0;
+
+  if (end - start < 2)
+    {
+      return 0;
+    }
+
+  const guint8 *p = buffer + start;
+  int size = (p[0] << 8) + p[1];
+
+  if (size == 0)
+    {
+      if (!long_packets_enabled)
+        {
+          return -1;
+        }
+
+      if (end - start < EXTENDED_HEADER_SIZE)
+        {
+          return 0;
+        }
+
+      guint32 length = ((guint32) p[2] << 24) + (p[3] << 16) + (p[4] << 8) + p[5];
+      if (length > MAX_PACKET_SIZE)
+        {
+          return -1;
+        }
+
+      offset = EXTENDED_HEADER_SIZE;
+      size = EXTENDED_HEADER_SIZE + (int) length;
+    }
+
+  return size;
+}
+
+
+//! Makes room for the next read.
+/*!
+ *  A buffer that grew for a long packet is shrunk again, so that an idle
+ *  connection does not keep it.
+ */
+void
+PacketReader::reserve()
+{
+  int offset = 0;
+  int size = peek_size(offset);
+  int needed = MIN_READ_SIZE;
+
+  if (size > end - start)
+    {
+      needed = MAX(needed, size - (end - start));
+    }
+
+  bool shrink = buffer_size > MAX_RETAINED_SIZE;
+
+  if ((buffer_size - end < needed || shrink) && start > 0)
+    {
+      // Move the incomplete packet to the front.
+      memmove(buffer, buffer + start, end - start);
+      end -= start;
+      start = 0;
+    }
+
+  int wanted = MAX(INITIAL_SIZE, end + needed);
+  if (buffer_size - end < needed || (shrink && wanted < buffer_size))
+    {
+      buffer_size = wanted;
+      buffer = g_renew(guint8, buffer, buffer_size);
+    }
+}
@@ -0,0 +1,110 @@
+// PacketReader.hh --- Splits a stream into packets
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef PACKETREADER_HH
+#define PACKETREADER_HH
+
+#include <glib.h>
+
+class ISocket;
+class PacketBuffer;
+
+//! Splits the data received from a socket into packets.
+/*!
+ *  Each read takes all data the socket has available, up to the free space
+ *  in the buffer. All complete packets in the buffer can then be taken
+ *  with next(), which lets a PacketBuffer borrow the packet instead of
+ *  copying it. The buffer is reused; only an incomplete packet at its end
+ *  is moved to the front to make room.
+ *
+ *  A packet normally starts with its 16 bit length. A long packet is
+ *  preceded by an extended header: a zero 16 bit length followed by the
+ *  32 bit length of the packet. Long packets are only accepted once they
+ *  are enabled, i.e. after the peer is authenticated and negotiated a
+ *  protocol version that supports them.
+ *
+ *  The buffer grows to hold a long packet, and shrinks again once the
+ *  packet is taken.
+ */
+class PacketReader
+{
+public:
+  PacketReader();
+  ~PacketReader();
+
+  int read(ISocket *socket);
+  bool next(PacketBuffer &packet);
+  bool is_valid() const;
+  void clear();
+  void set_long_packets_enabled(bool enabled);
+
+private:
+  enum
+    {
+      //! Size of the packet header: length, version, flags and command.
+      HEADER_SIZE = 6,
+
+      //! Size of the extended header of a long packet.
+      EXTENDED_HEADER_SIZE = 6,
+
+      //! Maximum size of a long packet.
+      /*!
+       *  The largest packet that is sent is a client message packet, with
+       *  an entry of at most 64 KiB for each message type. Larger entries
+       *  are sent in chunks.
+       */
+      MAX_PACKET_SIZE = 1024 * 1024,
+
+      //! Initial size of the buffer.
+      INITIAL_SIZE = 16384,
+
+      //! Larger buffers are released once they are no longer needed.
+      MAX_RETAINED_SIZE = 128 * 1024,
+
+      //! Minimum free space for a read.
+      MIN_READ_SIZE = 4096
+    };
+
+  PacketReader(const PacketReader &);
+  PacketReader &operator=(const PacketReader &);
+
+  int peek_size(int &offset) const;
+  void reserve();
+
+private:
+  //! The received data.
+  guint8 *buffer;
+
+  //! Size of the buffer.
+  int buffer_size;
+
+  //! Start of the first packet that was not taken.
+  int start;
+
+  //! End of the received data.
+  int end;
+
+  //! Is the stream well-formed?
+  bool valid;
+
+  //! Are long packets accepted?
+  bool long_packets_enabled;
+};
+
+#endif // PACKETREADER_HH
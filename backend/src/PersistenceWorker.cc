@@ -0,0 +1,467 @@
+// PersistenceWorker.cc --- Writes files in a background thread
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef PLATFORM_OS_WIN32
+# include <io.h>
+#endif
+
+#include <glib/gstdio.h>
+
+#include "debug.hh"
+
+#include "PersistenceWorker.hh"
+#include "Thread.hh"
+
+using namespace std;
+
+PersistenceWorker *PersistenceWorker::instance = NULL;
+
+
+//! Constructor
+PersistenceWorker::PersistenceWorker() :
+  queue(NULL),
+  thread(NULL),
+  running(false)
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+
+//! Destructor
+PersistenceWorker::~PersistenceWorker()
+{
+  terminate();
+
+  if (instance == this)
+    {
+      instance = NULL;
+    }
+}
+
+
+//! Starts the worker thread.
+void
+PersistenceWorker::start()
+{
+  TRACE_ENTER("PersistenceWorker::start");
+
+  if (thread == NULL)
+    {
+      queue = g_async_queue_new();
+      thread = new Thread(this);
+
+      lock.lock();
+      running = true;
+      lock.unlock();
+
+      thread->start();
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Writes all pending snapshots and stops the worker thread.
+void
+PersistenceWorker::terminate()
+{
+  TRACE_ENTER("PersistenceWorker::terminate");
+
+  if (thread != NULL)
+    {
+      lock.lock();
+      running = false;
+      lock.unlock();
+
+      g_async_queue_push(queue, GINT_TO_POINTER(1));
+      thread->wait();
+
+      delete thread;
+      thread = NULL;
+
+      g_async_queue_unref(queue);
+      queue = NULL;
+
+      TRACE_MSG("queued " << stats.queued << " coalesced " << stats.coalesced
+                << " written " << stats.written << " bytes " << stats.written_bytes
+                << " failed " << stats.failed);
+    }
+
+  files_lock.lock();
+  close_append_files();
+  files_lock.unlock();
+
+  TRACE_EXIT();
+}
+
+
+//! Queues a snapshot of a file.
+/*!
+ *  The data is taken over by swapping; \a data is empty on return.
+ */
+void
+PersistenceWorker::write(const string &filename, string &data)
+{
+  Snapshot snapshot;
+  snapshot.data.swap(data);
+  data.clear();
+
+  queue_snapshot(filename, snapshot);
+}
+
+
+//! Queues data to be appended to a file.
+/*!
+ *  \param sync if true, the file is forced to disk after appending.
+ */
+void
+PersistenceWorker::append(const string &filename, const string &data, bool sync)
+{
+  Snapshot snapshot;
+  snapshot.data = data;
+  snapshot.append = true;
+  snapshot.sync = sync;
+
+  queue_snapshot(filename, snapshot);
+}
+
+
+//! Queues a snapshot or an append, merging it with the pending one.
+void
+PersistenceWorker::queue_snapshot(const string &filename, Snapshot &snapshot)
+{
+  lock.lock();
+
+  stats.queued++;
+
+  if (!snapshot.append)
+    {
+      snapshot.serial = ++results[filename].queued;
+    }
+
+  if (running)
+    {
+      Snapshots::iterator i = pending.find(filename);
+      bool wakeup = (i == pending.end());
+
+      if (wakeup)
+        {
+          i = pending.insert(Snapshots::value_type(filename, Snapshot())).first;
+          i->second.data.swap(snapshot.data);
+          i->second.append = snapshot.append;
+          i->second.sync = snapshot.sync;
+          i->second.serial = snapshot.serial;
+        }
+      else if (snapshot.append)
+        {
+          i->second.data += snapshot.data;
+          i->second.sync = i->second.sync || snapshot.sync;
+        }
+      else
+        {
+          stats.coalesced++;
+          i->second.data.swap(snapshot.data);
+          i->second.append = false;
+          i->second.sync = false;
+          i->second.serial = snapshot.serial;
+        }
+
+      lock.unlock();
+
+      if (wakeup)
+        {
+          g_async_queue_push(queue, GINT_TO_POINTER(1));
+        }
+    }
+  else
+    {
+      lock.unlock();
+
+      Snapshots snapshots;
+      snapshots[filename] = snapshot;
+      write_snapshots(snapshots);
+    }
+}
+
+
+//! Returns the counters of the worker.
+void
+PersistenceWorker::get_stats(Stats &result)
+{
+  lock.lock();
+  result = stats;
+  lock.unlock();
+}
+
+
+//! Returns the outcome of the snapshots of a file.
+/*!
+ *  The last queued snapshot is on disk if \a result.written equals
+ *  \a result.queued and \a result.ok is true.
+ *
+ *  \retval false if no snapshot of the file was queued.
+ */
+bool
+PersistenceWorker::get_result(const string &filename, Result &result)
+{
+  lock.lock();
+
+  Results::const_iterator i = results.find(filename);
+  bool ret = (i != results.end());
+  if (ret)
+    {
+      result = i->second;
+    }
+
+  lock.unlock();
+  return ret;
+}
+
+
+//! Atomically replaces the content of a file.
+/*!
+ *  \param result if not NULL, receives the size, modification time and
+ *  inode of the new file.
+ */
+bool
+PersistenceWorker::write_file(const string &filename, const string &data, Result *result)
+{
+  TRACE_ENTER_MSG("PersistenceWorker::write_file", filename << " " << data.size());
+
+  string tmp_filename = filename + ".tmp";
+  FILE *file = g_fopen(tmp_filename.c_str(), "wb");
+
+  bool ok = file != NULL;
+  if (ok)
+    {
+      ok = (data.empty() || fwrite(data.data(), data.size(), 1, file) == 1);
+      ok = ok && fflush(file) == 0;
+      if (ok)
+        {
+          // The new content must be on disk before it replaces the file.
+          sync_file(file);
+        }
+      ok = (fclose(file) == 0) && ok;
+    }
+
+  if (ok && result != NULL)
+    {
+      // Renaming keeps the status, and nobody else changed the file yet.
+      struct stat st;
+      ok = g_stat(tmp_filename.c_str(), &st) == 0;
+      if (ok)
+        {
+          result->size = st.st_size;
+          result->mtime = st.st_mtime;
+          result->inode = st.st_ino;
+        }
+    }
+
+  if (ok)
+    {
+      ok = g_rename(tmp_filename.c_str(), filename.c_str()) == 0;
+    }
+
+  if (!ok)
+    {
+      g_unlink(tmp_filename.c_str());
+    }
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Forces the file to disk.
+void
+PersistenceWorker::sync_file(FILE *f)
+{
+#if defined(HAVE_FSYNC)
+  fsync(fileno(f));
+#elif defined(PLATFORM_OS_WIN32)
+  _commit(_fileno(f));
+#else
+  (void) f;
+#endif
+}
+
+
+//! Appends data to a file, creating it if needed.
+/*!
+ *  The file is kept open for the next append. The data is flushed to the
+ *  operating system before returning, and forced to disk if \c sync is set.
+ */
+bool
+PersistenceWorker::append_file(const string &filename, const string &data, bool sync)
+{
+  TRACE_ENTER_MSG("PersistenceWorker::append_file", filename << " " << data.size());
+
+  FILE *file = NULL;
+
+  AppendFiles::iterator i = append_files.find(filename);
+  if (i != append_files.end())
+    {
+      file = i->second;
+    }
+  else
+    {
+      if (append_files.size() >= MAX_APPEND_FILES)
+        {
+          close_append_files();
+        }
+
+      file = g_fopen(filename.c_str(), "ab");
+      if (file != NULL)
+        {
+          append_files[filename] = file;
+        }
+    }
+
+  bool ok = file != NULL;
+  if (ok)
+    {
+      ok = (data.empty() || fwrite(data.data(), data.size(), 1, file) == 1);
+      ok = (fflush(file) == 0) && ok;
+
+      if (ok && sync)
+        {
+          sync_file(file);
+        }
+
+      if (!ok)
+        {
+          // Reopen the file next time.
+          close_append_file(filename);
+        }
+    }
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Closes a file that is open for appending.
+void
+PersistenceWorker::close_append_file(const string &filename)
+{
+  AppendFiles::iterator i = append_files.find(filename);
+  if (i != append_files.end())
+    {
+      fclose(i->second);
+      append_files.erase(i);
+    }
+}
+
+
+//! Closes all files that are open for appending.
+void
+PersistenceWorker::close_append_files()
+{
+  for (AppendFiles::iterator i = append_files.begin(); i != append_files.end(); i++)
+    {
+      fclose(i->second);
+    }
+
+  append_files.clear();
+}
+
+
+//! Worker thread.
+void
+PersistenceWorker::run()
+{
+  TRACE_ENTER("PersistenceWorker::run");
+
+  bool stop = false;
+  while (!stop)
+    {
+      g_async_queue_pop(queue);
+
+      Snapshots snapshots;
+
+      lock.lock();
+      snapshots.swap(pending);
+      stop = !running;
+      lock.unlock();
+
+      write_snapshots(snapshots);
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Writes the specified snapshots and appends.
+void
+PersistenceWorker::write_snapshots(Snapshots &snapshots)
+{
+  files_lock.lock();
+
+  for (Snapshots::iterator i = snapshots.begin(); i != snapshots.end(); i++)
+    {
+      Snapshot &snapshot = i->second;
+      Result result;
+      bool ok = false;
+
+      if (snapshot.append)
+        {
+          ok = append_file(i->first, snapshot.data, snapshot.sync);
+        }
+      else
+        {
+          // The file is replaced, and cannot be renamed while open on Windows.
+          close_append_file(i->first);
+          ok = write_file(i->first, snapshot.data, &result);
+        }
+
+      lock.lock();
+      if (snapshot.serial != 0)
+        {
+          Result &r = results[i->first];
+          r.written = snapshot.serial;
+          r.ok = ok;
+          r.size = result.size;
+          r.mtime = result.mtime;
+          r.inode = result.inode;
+        }
+      if (ok)
+        {
+          stats.written++;
+          stats.written_bytes += snapshot.data.size();
+        }
+      else
+        {
+          stats.failed++;
+        }
+      lock.unlock();
+    }
+
+  files_lock.unlock();
+}
@@ -0,0 +1,197 @@
+// PersistenceWorker.hh --- Writes files in a background thread
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef PERSISTENCEWORKER_HH
+#define PERSISTENCEWORKER_HH
+
+#include <stdio.h>
+
+#include <string>
+#include <map>
+
+#include <glib.h>
+
+#include "Runnable.hh"
+#include "Mutex.hh"
+
+class Thread;
+
+//! Writes snapshots of files in a background thread.
+/*!
+ *  A snapshot is the complete new content of a file. Each file is written
+ *  to a temporary file that is renamed over the original, so a file is
+ *  either completely old or completely new. If a snapshot of a file is
+ *  still pending when a newer one arrives, only the newer one is written.
+ *
+ *  Data can also be appended to a file. Appends and snapshots of the same
+ *  file are written in the order in which they were queued; an append to
+ *  a pending snapshot is added to the snapshot. Files that are appended to
+ *  are kept open until a snapshot replaces them or the worker terminates.
+ *
+ *  When the worker is not running, snapshots are written immediately.
+ *
+ *  The outcome of the last snapshot of each file is kept, so that a caller
+ *  can tell when its snapshot is on disk and which file it became.
+ */
+class PersistenceWorker : public Runnable
+{
+public:
+  //! Counters of the worker.
+  struct Stats
+  {
+    //! Number of snapshots received.
+    gint64 queued;
+
+    //! Number of snapshots replaced by a newer one before being written.
+    gint64 coalesced;
+
+    //! Number of files written.
+    gint64 written;
+
+    //! Number of bytes written.
+    gint64 written_bytes;
+
+    //! Number of files that could not be written.
+    gint64 failed;
+  };
+
+  //! Outcome of the snapshots of a file.
+  struct Result
+  {
+    Result() : queued(0), written(0), ok(false), size(0), mtime(0), inode(0) {}
+
+    //! Number of snapshots of the file that were queued.
+    guint64 queued;
+
+    //! Number of the last snapshot that was written, or failed to be.
+    guint64 written;
+
+    //! Was the last snapshot written?
+    bool ok;
+
+    //! Size of the written file.
+    guint64 size;
+
+    //! Modification time of the written file.
+    gint64 mtime;
+
+    //! Inode of the written file.
+    guint64 inode;
+  };
+
+  PersistenceWorker();
+  virtual ~PersistenceWorker();
+
+  static PersistenceWorker *get_instance();
+
+  void start();
+  void terminate();
+
+  void write(const std::string &filename, std::string &data);
+  void append(const std::string &filename, const std::string &data, bool sync = false);
+  void get_stats(Stats &stats);
+  bool get_result(const std::string &filename, Result &result);
+
+  static bool write_file(const std::string &filename, const std::string &data, Result *result = NULL);
+
+private:
+  enum
+    {
+      //! Maximum number of files kept open for appending.
+      MAX_APPEND_FILES = 32
+    };
+
+  //! Pending data of a file.
+  struct Snapshot
+  {
+    Snapshot() : append(false), sync(false), serial(0) {}
+
+    //! The data.
+    std::string data;
+
+    //! Is the data appended to the file instead of replacing it?
+    bool append;
+
+    //! Must appended data be forced to disk?
+    bool sync;
+
+    //! Number of the snapshot of the file, 0 for an append.
+    guint64 serial;
+  };
+
+  typedef std::map<std::string, Snapshot> Snapshots;
+  typedef std::map<std::string, Result> Results;
+  typedef std::map<std::string, FILE *> AppendFiles;
+
+  void queue_snapshot(const std::string &filename, Snapshot &snapshot);
+
+  void run();
+  void write_snapshots(Snapshots &snapshots);
+  bool append_file(const std::string &filename, const std::string &data, bool sync);
+  void close_append_file(const std::string &filename);
+  void close_append_files();
+
+  static void sync_file(FILE *file);
+
+private:
+  //! The one and only instance.
+  static PersistenceWorker *instance;
+
+  //! Internal locking.
+  Mutex lock;
+
+  //! Snapshots waiting to be written, by filename.
+  Snapshots pending;
+
+  //! Serializes writing the snapshots.
+  Mutex files_lock;
+
+  //! Files that are open for appending, by filename.
+  AppendFiles append_files;
+
+  //! Wakes up the worker thread.
+  GAsyncQueue *queue;
+
+  //! The worker thread.
+  Thread *thread;
+
+  //! Is the worker thread accepting snapshots?
+  bool running;
+
+  //! Counters.
+  Stats stats;
+
+  //! Outcome of the snapshots, by filename.
+  Results results;
+};
+
+
+//! Returns the singleton PersistenceWorker instance.
+inline PersistenceWorker *
+PersistenceWorker::get_instance()
+{
+  if (instance == NULL)
+    {
+      instance = new PersistenceWorker();
+    }
+
+  return instance;
+}
+
+#endif // PERSISTENCEWORKER_HH
@@ -34,6 +34,30 @@ static const char rcsid[] = "$Id: GNetSocketDriver.cc 1184 2007-05-12 09:16:31Z
 #include "GNetSocketDriver.hh"
 #endif
 
+//! Write data from several buffers to the connection.
+/*!
+ *  The default implementation writes the buffers one by one and stops at
+ *  the first short write.
+ */
+void
+ISocket::writev(const SocketBuffer *buffers, int count, int &bytes_written)
+{
+  bytes_written = 0;
+
+  for (int i = 0; i < count; i++)
+    {
+      int written = 0;
+      write(const_cast<void *>(buffers[i].data), buffers[i].size, written);
+      bytes_written += written;
+
+      if (written < buffers[i].size)
+        {
+          break;
+        }
+    }
+}
+
+
 //! Create a new socket
 SocketDriver *
 SocketDriver::create()
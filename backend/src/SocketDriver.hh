@@ -42,6 +42,20 @@ public:
 
   //! The specified socket closed its connection.
   virtual void socket_closed(ISocket *con, void *data) = 0;
+
+  //! The specified socket can accept more data.
+  virtual void socket_writable(ISocket *con, void *data) = 0;
+};
+
+
+//! Buffer for gathered writes.
+struct SocketBuffer
+{
+  //! Start of the data.
+  const void *data;
+
+  //! Number of bytes.
+  int size;
 };
 
 
@@ -75,8 +89,16 @@ public:
   virtual void read(void *buf, int count, int &bytes_read) = 0;
 
   //! Write data to the connection
+  /*! A full connection results in a short write, not in an exception.
+   */
   virtual void write(void *buf, int count, int &bytes_written) = 0;
 
+  //! Write data from several buffers to the connection.
+  virtual void writev(const SocketBuffer *buffers, int count, int &bytes_written);
+
+  //! Enables or disables notification that the connection is writable.
+  virtual void set_write_notify(bool enabled) = 0;
+
   //! Close the connection.
   virtual void close() = 0;
 
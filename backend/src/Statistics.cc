@@ -1,6 +1,6 @@
 // Statistics.cc
 //
-// Copyright (C) 2002 - 2008, 2010 Rob Caelers & Raymond Penners
+// Copyright (C) 2002 - 2008, 2010, 2013 Rob Caelers & Raymond Penners
 // All rights reserved.
 //
 // This program is free software: you can redistribute it and/or modify
@@ -29,16 +29,22 @@
 #include <sstream>
 #include <assert.h>
 #include <math.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
 
 #include "debug.hh"
 
 #include "Statistics.hh"
+#include "StatisticsHistory.hh"
+#include "StatisticsJournal.hh"
 
 #include "Core.hh"
 #include "Util.hh"
 #include "Timer.hh"
 #include "TimePred.hh"
 #include "InputMonitorFactory.hh"
+#include "PersistenceWorker.hh"
 #include "IInputMonitor.hh"
 #include "timeutil.h"
 
@@ -55,7 +61,10 @@ const int STATSVERSION = 4;
 Statistics::Statistics() :
   core(NULL),
   current_day(NULL),
+  journal(NULL),
+  today_generation(-1),
   been_active(false),
+  history(NULL),
   prev_x(-1),
   prev_y(-1),
   click_x(-1),
@@ -71,12 +80,17 @@ Statistics::~Statistics()
 {
   update();
 
-  for (vector<DailyStatsImpl *>::iterator i = history.begin(); i != history.end(); i++)
+  // Keep the text version up to date for older versions and external tools.
+  if (current_day != NULL)
     {
-      delete *i;
+      save_day(current_day);
     }
 
+  clear_history_cache();
+
   delete current_day;
+  delete journal;
+  delete history;
 
   if (input_monitor != NULL)
     {
@@ -101,6 +115,9 @@ Statistics::init(Core *control)
   init_distribution_manager();
 #endif
 
+  journal = new StatisticsJournal(Util::get_home_directory() + "todaystats.journal");
+  history = new StatisticsHistory(Util::get_home_directory() + "historystats.idx");
+
   current_day = NULL;
   bool ok = load_current_day();
   if (!ok)
@@ -133,7 +150,7 @@ Statistics::update()
     }
 
   update_current_day(state == ACTIVITY_ACTIVE);
-  save_day(current_day);
+  journal->append(*current_day);
   TRACE_EXIT();
 }
 
@@ -150,10 +167,11 @@ Statistics::delete_all_history()
     }
     else
     {
-        for( vector<DailyStatsImpl *>::iterator i = history.begin(); ( i != history.end() ); delete *i++ )
-            ;
-
-        history.clear();
+        clear_history_cache();
+        if( !history->remove() )
+        {
+            return false;
+        }
     }
 
     string todayfile = Util::get_home_directory() + "todaystats";
@@ -161,6 +179,13 @@ Statistics::delete_all_history()
     {
         return false;
     }
+
+    journal->close();
+    string journalfile = journal->get_filename();
+    if( Util::file_exists( journalfile.c_str() ) && std::remove( journalfile.c_str() ) )
+    {
+        return false;
+    }
     else
     {
         if( current_day )
@@ -195,6 +220,7 @@ Statistics::start_new_day()
           TRACE_MSG("Save old day");
           day_to_history(current_day);
           day_to_remote_history(current_day);
+          delete current_day;
         }
 
       current_day = new DailyStatsImpl();
@@ -202,10 +228,12 @@ Statistics::start_new_day()
 
       current_day->start = *tmnow;
       current_day->stop = *tmnow;
+
+      journal->reset(*current_day);
     }
 
   update_current_day(false);
-  save_day(current_day);
+  journal->append(*current_day);
 
   TRACE_EXIT();
 }
@@ -214,8 +242,6 @@ Statistics::start_new_day()
 void
 Statistics::day_to_history(DailyStatsImpl *stats)
 {
-  add_history(stats);
-
   stringstream ss;
   ss << Util::get_home_directory();
   ss << "historystats" << ends;
@@ -231,6 +257,9 @@ Statistics::day_to_history(DailyStatsImpl *stats)
   save_day(stats, stats_file);
   stats_file.close();
 
+  // Update the index after the text version, so that it is not older.
+  clear_history_cache();
+  history->add(*stats);
 }
 
 
@@ -260,7 +289,7 @@ Statistics::day_to_remote_history(DailyStatsImpl *stats)
 
 //! Saves the current day to the specified stream.
 void
-Statistics::save_day(DailyStatsImpl *stats, ofstream &stats_file)
+Statistics::save_day(DailyStatsImpl *stats, ostream &stats_file)
 {
   stats_file << "D "
              << stats->start.tm_mday << " "
@@ -292,8 +321,6 @@ Statistics::save_day(DailyStatsImpl *stats, ofstream &stats_file)
       stats_file << stats->misc_stats[j] << " ";
     }
   stats_file << endl;
-
-  stats_file.close();
 }
 
 
@@ -301,85 +328,79 @@ Statistics::save_day(DailyStatsImpl *stats, ofstream &stats_file)
 void
 Statistics::save_day(DailyStatsImpl *stats)
 {
-  stringstream ss;
-  ss << Util::get_home_directory();
-  ss << "todaystats" << ends;
-
-  ofstream stats_file(ss.str().c_str());
+  stringstream stats_file;
 
   stats_file << WORKRAVESTATS << " " << STATSVERSION  << endl;
 
   save_day(stats, stats_file);
+
+  // Lets the next load find out whether the journal is at least as recent.
+  // Older versions ignore this line.
+  stats_file << "J " << journal->get_generation() << endl;
+
+  string data = stats_file.str();
+  PersistenceWorker::get_instance()->write(Util::get_home_directory() + "todaystats", data);
 }
 
 
-//! Add the stats the the history list.
-void
-Statistics::add_history(DailyStatsImpl *stats)
+//! Load the statistics of the current day.
+bool
+Statistics::load_current_day()
 {
-  if (history.size() == 0)
+  TRACE_ENTER("Statistics::load_current_day");
+
+  DailyStatsImpl *stats = new DailyStatsImpl();
+  bool have_journal = journal->load(*stats);
+  bool have_today = load_today_text();
+
+  // Prefer the text version if it is more recent than the journal, or if it
+  // was written by an older version of Workrave, which does not store the
+  // generation of the journal.
+  bool ok = have_journal || have_today;
+  if (have_journal && !(have_today && (today_generation < 0 ||
+                                       today_generation > journal->get_generation())))
     {
-      history.push_back(stats);
+      delete current_day;
+      current_day = stats;
     }
   else
     {
-      bool found = false;
-      HistoryRIter i = history.rbegin();
-      while (i != history.rend())
-        {
-          DailyStatsImpl *ref = *i;
+      delete stats;
 
-          if (stats->start.tm_year == ref->start.tm_year  &&
-              stats->start.tm_mon == ref->start.tm_mon &&
-              stats->start.tm_mday == ref->start.tm_mday)
+      if (have_today)
+        {
+          // Convert the text version into a new journal, and store the new
+          // generation in the text version right away.
+          TRACE_MSG("Converting today " << today_generation);
+          if (today_generation > journal->get_generation())
             {
-              delete *i;
-              *i = stats;
-              found = true;
-              break;
+              journal->set_generation(today_generation);
             }
-
-          else if ( stats->start.tm_year > ref->start.tm_year
-                    || (stats->start.tm_year == ref->start.tm_year
-                        && (stats->start.tm_mon > ref->start.tm_mon
-                            || (stats->start.tm_mon == ref->start.tm_mon
-                                && stats->start.tm_mday > ref->start.tm_mday))))
-          {
-            if (i == history.rbegin())
-              {
-                history.push_back(stats);
-              }
-            else
-              {
-                history.insert(i.base(), stats);
-              }
-            found = true;
-            break;
-          }
-          i++;
-        }
-
-      if (!found)
-        {
-          history.insert(history.begin(), stats);
+          journal->reset(*current_day);
+          save_day(current_day);
         }
     }
+
+  been_active = true;
+
+  TRACE_EXIT();
+  return ok;
 }
 
-//! Load the statistics of the current day.
+
+//! Load the statistics of the current day from the text file.
 bool
-Statistics::load_current_day()
+Statistics::load_today_text()
 {
-  TRACE_ENTER("Statistics::load_current_day");
+  TRACE_ENTER("Statistics::load_today_text");
   stringstream ss;
   ss << Util::get_home_directory();
   ss << "todaystats" << ends;
 
   ifstream stats_file(ss.str().c_str());
 
-  load(stats_file, false);
-
-  been_active = true;
+  today_generation = -1;
+  load(stats_file, NULL);
 
   TRACE_EXIT();
   return current_day != NULL;
@@ -392,20 +413,43 @@ Statistics::load_history()
 {
   TRACE_ENTER("Statistics::load_history");
 
-  stringstream ss;
-  ss << Util::get_home_directory();
-  ss << "historystats" << ends;
+  string histfile = Util::get_home_directory() + "historystats";
+  string indexfile = history->get_filename();
 
-  ifstream stats_file(ss.str().c_str());
+  // Rebuild the index if the text version was written after it, e.g. by
+  // an older version of Workrave.
+  struct stat hist_stat, index_stat;
+  bool have_hist = g_stat(histfile.c_str(), &hist_stat) == 0;
+  bool have_index = g_stat(indexfile.c_str(), &index_stat) == 0;
+
+  bool ok = false;
+  if (have_index && !(have_hist && hist_stat.st_mtime > index_stat.st_mtime))
+    {
+      ok = history->open();
+    }
 
-  load(stats_file, true);
+  if (!ok && have_hist)
+    {
+      TRACE_MSG("Converting history");
+      History days;
+
+      ifstream stats_file(histfile.c_str());
+      load(stats_file, &days);
+
+      history->import(vector<DailyStats *>(days.begin(), days.end()));
+
+      for (HistoryIter i = days.begin(); i != days.end(); i++)
+        {
+          delete *i;
+        }
+    }
   TRACE_EXIT();
 }
 
 
 //! Loads the statistics.
 void
-Statistics::load(ifstream &infile, bool history)
+Statistics::load(ifstream &infile, History *history)
 {
   TRACE_ENTER("Statistics::load");
 
@@ -445,12 +489,12 @@ Statistics::load(ifstream &infile, bool history)
 
           if (cmd == 'D')
             {
-              if (history && stats != NULL)
+              if (history != NULL && stats != NULL)
                 {
-                  add_history(stats);
+                  history->push_back(stats);
                   stats = NULL;
                 }
-              else if (!history && stats != NULL)
+              else if (history == NULL && stats != NULL)
                 {
                   /* Corrupt today stats */
                   return;
@@ -469,7 +513,7 @@ Statistics::load(ifstream &infile, bool history)
                  >> stats->stop.tm_hour
                  >> stats->stop.tm_min;
 
-              if (!history)
+              if (history == NULL)
                 {
                   current_day = stats;
                 }
@@ -530,13 +574,17 @@ Statistics::load(ifstream &infile, bool history)
 
                   stats->misc_stats[STATS_VALUE_TOTAL_ACTIVE_TIME] = total_active;
                 }
+              else if (cmd == 'J' && history == NULL)
+                {
+                  ss >> today_generation;
+                }
             }
         }
     }
 
-  if (history && stats != NULL)
+  if (history != NULL && stats != NULL)
     {
-      add_history(stats);
+      history->push_back(stats);
     }
 
   TRACE_EXIT();
@@ -647,9 +695,10 @@ Statistics::get_day(int day) const
     }
   else
     {
+      int size = history->size();
       if (day > 0)
         {
-          day = history.size() - day;
+          day = size - day;
         }
       else
         {
@@ -657,9 +706,19 @@ Statistics::get_day(int day) const
           day--;
         }
 
-      if (day < int(history.size()) && day >= 0)
+      if (day < size && day >= 0)
         {
-          ret = history[day];
+          HistoryCache::iterator i = history_cache.find(day);
+          if (i != history_cache.end())
+            {
+              ret = i->second;
+            }
+          else
+            {
+              ret = new DailyStatsImpl();
+              history->get(day, *ret);
+              history_cache[day] = ret;
+            }
         }
     }
 
@@ -672,30 +731,35 @@ Statistics::get_day_index_by_date(int y, int m, int d,
 {
   TRACE_ENTER_MSG("Statistics::get_day_by_date", y << "/" << m << "/" << d);
   idx = next = prev = -1;
-  for (int i = 0; i <= int(history.size()); i++)
+
+  int size = history->size();
+  bool found = false;
+  int pos = history->find(y, m, d, found);
+
+  // Positions in the history are ordered by date, indices are reversed.
+  int after = found ? pos + 1 : pos;
+  if (found)
     {
-      int j = history.size() - i;
-      DailyStatsImpl *stats = j == 0 ? current_day : history[i];
-      if (idx < 0 && stats->starts_at_date(y, m, d))
-        {
-          idx = j;
-        }
-      else if (stats->starts_before_date(y, m, d))
-        {
-          prev = j;
-        }
-      else if (next < 0)
-        {
-          next = j;
-        }
+      idx = size - pos;
+    }
+  if (pos > 0)
+    {
+      prev = size - (pos - 1);
+    }
+  if (after < size)
+    {
+      next = size - after;
     }
 
-  if (prev < 0 && current_day->starts_before_date(y, m, d))
+  if (idx < 0 && current_day->starts_at_date(y, m, d))
+    {
+      idx = 0;
+    }
+  else if (current_day->starts_before_date(y, m, d))
     {
       prev = 0;
     }
-  if (next < 0 && !current_day->starts_at_date(y, m, d)
-      && !current_day->starts_before_date(y, m, d))
+  else if (next < 0 && !current_day->starts_at_date(y, m, d))
     {
       next = 0;
     }
@@ -706,7 +770,19 @@ Statistics::get_day_index_by_date(int y, int m, int d,
 int
 Statistics::get_history_size() const
 {
-  return history.size();
+  return history->size();
+}
+
+
+//! Releases the days returned by get_day.
+void
+Statistics::clear_history_cache()
+{
+  for (HistoryCache::iterator i = history_cache.begin(); i != history_cache.end(); i++)
+    {
+      delete i->second;
+    }
+  history_cache.clear();
 }
 
 
@@ -936,6 +1012,8 @@ Statistics::client_message(DistributionClientMessageID id, bool master, const ch
             {
               TRACE_MSG("Save to history");
               day_to_history(stats);
+              delete stats;
+              stats = NULL;
               stats_to_history = false;
             }
           break;
@@ -955,6 +1033,7 @@ Statistics::client_message(DistributionClientMessageID id, bool master, const ch
       // this should not happend. but just to avoid a potential memory leak...
       TRACE_MSG("Save to history");
       day_to_history(stats);
+      delete stats;
       stats_to_history = false;
     }
 
@@ -985,21 +1064,58 @@ Statistics::DailyStatsImpl::starts_before_date(int y, int m, int d)
 }
 
 
-//! Activity is reported by the input monitor.
+//! A batch of input events is reported by the input monitor.
 void
-Statistics::action_notify()
+Statistics::input_events_notify(const InputEvent *events, int count)
 {
+  lock.lock();
+
+  for (int i = 0; i < count; i++)
+    {
+      const InputEvent &event = events[i];
+
+      switch (event.type)
+        {
+        case InputEvent::INPUT_EVENT_MOUSE:
+          {
+            GTimeVal now;
+            now.tv_sec = event.time / G_USEC_PER_SEC;
+            now.tv_usec = event.time % G_USEC_PER_SEC;
+
+            if (event.flag)
+              {
+                mouse_path_notify(event.x, event.y, event.distance, now);
+              }
+            else
+              {
+                mouse_notify(event.x, event.y, event.wheel, now);
+              }
+          }
+          break;
+
+        case InputEvent::INPUT_EVENT_BUTTON:
+          button_notify(event.flag != 0);
+          break;
+
+        case InputEvent::INPUT_EVENT_KEYBOARD:
+          keyboard_notify(event.flag != 0);
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  lock.unlock();
 }
 
 
 //! Mouse activity is reported by the input monitor.
 void
-Statistics::mouse_notify(int x, int y, int wheel_delta)
+Statistics::mouse_notify(int x, int y, int wheel_delta, const GTimeVal &now)
 {
   static const int sensitivity = 3;
 
-  lock.lock();
-
   if (current_day != NULL && x >=0 && y >= 0)
     {
       int delta_x = sensitivity;
@@ -1018,33 +1134,55 @@ Statistics::mouse_notify(int x, int y, int wheel_delta)
       if ( delta_x < MAX_JUMP && delta_y < MAX_JUMP &&
           (delta_x >= sensitivity || delta_y >= sensitivity || wheel_delta != 0 ))
         {
-          int64_t movement = current_day->misc_stats[STATS_VALUE_TOTAL_MOUSE_MOVEMENT];
           int distance = int(sqrt((double)(delta_x * delta_x + delta_y * delta_y)));
+          add_mouse_movement(distance, now);
+        }
+    }
+}
 
-          movement += distance;
-          if (movement > 0)
-            {
-              current_day->misc_stats[STATS_VALUE_TOTAL_MOUSE_MOVEMENT] = movement;
-            }
 
-          GTimeVal now, tv;
+//! Coalesced mouse motion is reported by the input monitor.
+void
+Statistics::mouse_path_notify(int x, int y, int distance, const GTimeVal &now)
+{
+  if (current_day != NULL && x >=0 && y >= 0)
+    {
+      prev_x = x;
+      prev_y = y;
+
+      if (distance > 0)
+        {
+          add_mouse_movement(distance, now);
+        }
+    }
+}
+
 
-          g_get_current_time(&now);
-          tvSUBTIME(tv, now, last_mouse_time);
+//! Adds mouse movement to the statistics of the current day.
+void
+Statistics::add_mouse_movement(int distance, const GTimeVal &now)
+{
+  int64_t movement = current_day->misc_stats[STATS_VALUE_TOTAL_MOUSE_MOVEMENT];
 
-          if (!tvTIMEEQ0(last_mouse_time) && tv.tv_sec < 1 && tv.tv_sec >= 0 && tv.tv_usec >= 0)
-            {
-              tvADDTIME(current_day->total_mouse_time, current_day->total_mouse_time, tv);
+  movement += distance;
+  if (movement > 0)
+    {
+      current_day->misc_stats[STATS_VALUE_TOTAL_MOUSE_MOVEMENT] = movement;
+    }
 
-              current_day->misc_stats[STATS_VALUE_TOTAL_MOVEMENT_TIME] =
-                current_day->total_mouse_time.tv_sec;
-            }
+  GTimeVal tv;
 
-          last_mouse_time = now;
-        }
+  tvSUBTIME(tv, now, last_mouse_time);
+
+  if (!tvTIMEEQ0(last_mouse_time) && tv.tv_sec < 1 && tv.tv_sec >= 0 && tv.tv_usec >= 0)
+    {
+      tvADDTIME(current_day->total_mouse_time, current_day->total_mouse_time, tv);
+
+      current_day->misc_stats[STATS_VALUE_TOTAL_MOVEMENT_TIME] =
+        current_day->total_mouse_time.tv_sec;
     }
 
-  lock.unlock();
+  last_mouse_time = now;
 }
 
 
@@ -1052,7 +1190,6 @@ Statistics::mouse_notify(int x, int y, int wheel_delta)
 void
 Statistics::button_notify(bool is_press)
 {
-  lock.lock();
   if (current_day != NULL)
     {
       if (click_x != -1 && click_y != -1 &&
@@ -1079,7 +1216,6 @@ Statistics::button_notify(bool is_press)
           current_day->misc_stats[STATS_VALUE_TOTAL_CLICKS]++;
         }
     }
-  lock.unlock();
 }
 
 
@@ -1090,10 +1226,8 @@ Statistics::keyboard_notify(bool repeat)
   if (repeat)
     return;
 
-  lock.lock();
   if (current_day != NULL)
     {
       current_day->misc_stats[STATS_VALUE_TOTAL_KEYSTROKES]++;
     }
-  lock.unlock();
 }
@@ -23,6 +23,7 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <map>
 #include <time.h>
 #include <string.h>
 
@@ -37,6 +38,8 @@ namespace workrave {
 
 class TimePred;
 class PacketBuffer;
+class StatisticsJournal;
+class StatisticsHistory;
 class Core;
 class IInputMonitor;
 
@@ -109,7 +112,7 @@ private:
 
   typedef std::vector<DailyStatsImpl *> History;
   typedef std::vector<DailyStatsImpl *>::iterator HistoryIter;
-  typedef std::vector<DailyStatsImpl *>::reverse_iterator HistoryRIter;
+  typedef std::map<int, DailyStatsImpl *> HistoryCache;
 
 public:
   //! Constructor.
@@ -139,24 +142,27 @@ public:
   int64_t get_counter(StatsValueType t);
 
 private:
-  void action_notify();
-  void mouse_notify(int x, int y, int wheel = 0);
+  void input_events_notify(const InputEvent *events, int count);
+  void mouse_notify(int x, int y, int wheel, const GTimeVal &now);
+  void mouse_path_notify(int x, int y, int distance, const GTimeVal &now);
+  void add_mouse_movement(int distance, const GTimeVal &now);
   void button_notify(bool is_press);
   void keyboard_notify(bool repeat);
 
   bool load_current_day();
+  bool load_today_text();
   void update_current_day(bool active);
   void load_history();
 
 private:
   void save_day(DailyStatsImpl *stats);
-  void save_day(DailyStatsImpl *stats, std::ofstream &stats_file);
-  void load(std::ifstream &infile, bool history);
+  void save_day(DailyStatsImpl *stats, std::ostream &stats_file);
+  void load(std::ifstream &infile, History *history);
 
   void day_to_history(DailyStatsImpl *stats);
   void day_to_remote_history(DailyStatsImpl *stats);
 
-  void add_history(DailyStatsImpl *stats);
+  void clear_history_cache();
 
 #ifdef HAVE_DISTRIBUTION
   void init_distribution_manager();
@@ -179,11 +185,20 @@ private:
   //! Statistics of current day.
   DailyStatsImpl *current_day;
 
+  //! Journal of the statistics of the current day.
+  StatisticsJournal *journal;
+
+  //! Journal generation stored in the text version of the current day, or -1.
+  gint64 today_generation;
+
   //! Has the user been active on the current day?
   bool been_active;
 
   //! History
-  History history;
+  StatisticsHistory *history;
+
+  //! Days of the history returned by get_day, by position in the history.
+  mutable HistoryCache history_cache;
 
   //! Internal locking
   Mutex lock;
@@ -0,0 +1,492 @@
+// StatisticsHistory.cc --- Indexed binary history of daily statistics
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <algorithm>
+
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef PLATFORM_OS_WIN32
+# include <io.h>
+#endif
+
+#include <glib/gstdio.h>
+
+#include "debug.hh"
+
+#include "StatisticsHistory.hh"
+
+using namespace std;
+
+//! Magic number of the history file ("WRSH").
+static const guint32 HISTORY_MAGIC = 0x48535257;
+
+//! Version of the history format.
+static const int HISTORY_VERSION = 1;
+
+
+//! Constructor
+StatisticsHistory::StatisticsHistory(const string &filename) :
+  filename(filename),
+  mapped(NULL),
+  records(NULL),
+  count(0)
+{
+}
+
+
+//! Destructor
+StatisticsHistory::~StatisticsHistory()
+{
+  close();
+}
+
+
+//! Returns the name of the history file.
+const string &
+StatisticsHistory::get_filename() const
+{
+  return filename;
+}
+
+
+//! Maps the history file into memory.
+/*!
+ *  \retval false if the file does not exist or is not a valid history.
+ */
+bool
+StatisticsHistory::open()
+{
+  TRACE_ENTER_MSG("StatisticsHistory::open", filename);
+
+  close();
+
+  GError *error = NULL;
+  mapped = g_mapped_file_new(filename.c_str(), FALSE, &error);
+  if (mapped == NULL)
+    {
+      if (error != NULL)
+        {
+          g_error_free(error);
+        }
+      TRACE_RETURN(false);
+      return false;
+    }
+
+  const gchar *contents = g_mapped_file_get_contents(mapped);
+  gsize length = g_mapped_file_get_length(mapped);
+  const Header *header = (const Header *) contents;
+
+  bool ok = (contents != NULL &&
+             length >= sizeof(Header) &&
+             header->magic == HISTORY_MAGIC &&
+             header->version == HISTORY_VERSION &&
+             header->record_size == sizeof(Record) &&
+             length >= sizeof(Header) + (gsize)header->count * sizeof(Record));
+
+  if (ok)
+    {
+      // Records beyond the count in the header are an interrupted append.
+      records = (const Record *) (contents + sizeof(Header));
+      count = header->count;
+    }
+  else
+    {
+      TRACE_MSG("invalid history");
+      close();
+    }
+
+  TRACE_MSG("count " << count);
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Unmaps the history file.
+void
+StatisticsHistory::close()
+{
+  if (mapped != NULL)
+    {
+#if GLIB_CHECK_VERSION(2, 22, 0)
+      g_mapped_file_unref(mapped);
+#else
+      g_mapped_file_free(mapped);
+#endif
+      mapped = NULL;
+    }
+
+  records = NULL;
+  count = 0;
+}
+
+
+//! Replaces the history by the specified days.
+/*!
+ *  The days do not need to be sorted. If a date occurs more than once,
+ *  the last occurrence is kept.
+ */
+bool
+StatisticsHistory::import(const vector<IStatistics::DailyStats *> &days)
+{
+  TRACE_ENTER_MSG("StatisticsHistory::import", days.size());
+
+  vector<Record> sorted(days.size());
+  for (size_t i = 0; i < days.size(); i++)
+    {
+      to_record(*days[i], sorted[i]);
+    }
+
+  stable_sort(sorted.begin(), sorted.end(), date_less);
+
+  vector<Record> unique;
+  unique.reserve(sorted.size());
+  for (size_t i = 0; i < sorted.size(); i++)
+    {
+      if (i + 1 < sorted.size() && sorted[i + 1].date == sorted[i].date)
+        {
+          continue;
+        }
+      unique.push_back(sorted[i]);
+    }
+
+  bool ok = rewrite(unique.empty() ? NULL : &unique[0], (int)unique.size(), NULL, 0, false);
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Adds a day to the history, replacing a day with the same date.
+bool
+StatisticsHistory::add(const IStatistics::DailyStats &stats)
+{
+  TRACE_ENTER("StatisticsHistory::add");
+
+  Record record;
+  to_record(stats, record);
+
+  bool found = false;
+  int pos = find(stats.start.tm_year + 1900, stats.start.tm_mon + 1, stats.start.tm_mday, found);
+
+  bool ok;
+  if (pos == count && mapped != NULL)
+    {
+      ok = append_record(record);
+    }
+  else
+    {
+      ok = rewrite(records, count, &record, pos, found);
+    }
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Removes the history file.
+bool
+StatisticsHistory::remove()
+{
+  close();
+  return g_unlink(filename.c_str()) == 0 || !g_file_test(filename.c_str(), G_FILE_TEST_EXISTS);
+}
+
+
+//! Returns the number of days in the history.
+int
+StatisticsHistory::size() const
+{
+  return count;
+}
+
+
+//! Returns the statistics of a day. Position 0 is the oldest day.
+bool
+StatisticsHistory::get(int pos, IStatistics::DailyStats &stats) const
+{
+  const Record *record = get_record(pos);
+  if (record != NULL)
+    {
+      from_record(*record, stats);
+    }
+  return record != NULL;
+}
+
+
+//! Returns the position of the first day on or after the specified date.
+int
+StatisticsHistory::find(int y, int m, int d, bool &found) const
+{
+  gint32 date = make_date(y, m, d);
+
+  int low = 0;
+  int high = count;
+  while (low < high)
+    {
+      int mid = low + (high - low) / 2;
+      if (records[mid].date < date)
+        {
+          low = mid + 1;
+        }
+      else
+        {
+          high = mid;
+        }
+    }
+
+  found = low < count && records[low].date == date;
+  return low;
+}
+
+
+//! Returns the record at the specified position, or NULL.
+const StatisticsHistory::Record *
+StatisticsHistory::get_record(int pos) const
+{
+  return (pos >= 0 && pos < count) ? &records[pos] : NULL;
+}
+
+
+//! Appends a record in place.
+/*!
+ *  The record is written before the count in the header is updated. An
+ *  interrupted append therefore leaves the history unchanged.
+ */
+bool
+StatisticsHistory::append_record(const Record &record)
+{
+  TRACE_ENTER("StatisticsHistory::append_record");
+
+  guint32 new_count = count + 1;
+  long offset = sizeof(Header) + count * sizeof(Record);
+
+  close();
+
+  FILE *file = g_fopen(filename.c_str(), "r+b");
+  bool ok = file != NULL;
+  if (ok)
+    {
+      ok = (fseek(file, offset, SEEK_SET) == 0 &&
+            fwrite(&record, sizeof(record), 1, file) == 1 &&
+            fflush(file) == 0);
+
+      if (ok)
+        {
+          sync_file(file);
+          ok = write_header(file, new_count) && fflush(file) == 0;
+        }
+      if (ok)
+        {
+          sync_file(file);
+        }
+      fclose(file);
+    }
+
+  ok = open() && ok;
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Atomically replaces the history file.
+/*!
+ *  The new history consists of the specified records, with \a insert
+ *  inserted at \a pos or, if \a replace is set, replacing the record at
+ *  \a pos.
+ */
+bool
+StatisticsHistory::rewrite(const Record *old_records, int old_count, const Record *insert, int pos, bool replace)
+{
+  TRACE_ENTER("StatisticsHistory::rewrite");
+
+  int skip = (insert != NULL && replace) ? 1 : 0;
+  guint32 new_count = old_count + (insert != NULL ? 1 : 0) - skip;
+
+  string tmp_filename = filename + ".tmp";
+  FILE *file = g_fopen(tmp_filename.c_str(), "wb");
+
+  bool ok = file != NULL;
+  if (ok)
+    {
+      ok = write_header(file, new_count);
+
+      if (ok && pos > 0)
+        {
+          ok = fwrite(old_records, sizeof(Record), pos, file) == (size_t)pos;
+        }
+      if (ok && insert != NULL)
+        {
+          ok = fwrite(insert, sizeof(Record), 1, file) == 1;
+        }
+      if (ok && old_count - pos - skip > 0)
+        {
+          size_t tail = old_count - pos - skip;
+          ok = fwrite(old_records + pos + skip, sizeof(Record), tail, file) == tail;
+        }
+
+      ok = ok && fflush(file) == 0;
+      if (ok)
+        {
+          sync_file(file);
+        }
+      fclose(file);
+    }
+
+  // The old records may live in the mapping, which must be released
+  // before the file can be replaced.
+  close();
+
+  if (ok)
+    {
+      ok = g_rename(tmp_filename.c_str(), filename.c_str()) == 0;
+    }
+  if (!ok)
+    {
+      TRACE_MSG("rewrite failed");
+      g_unlink(tmp_filename.c_str());
+    }
+
+  ok = open() && ok;
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Writes the header at the start of the file.
+bool
+StatisticsHistory::write_header(FILE *file, guint32 new_count)
+{
+  Header header;
+  memset(&header, 0, sizeof(header));
+
+  header.magic = HISTORY_MAGIC;
+  header.version = HISTORY_VERSION;
+  header.record_size = sizeof(Record);
+  header.count = new_count;
+
+  return (fseek(file, 0, SEEK_SET) == 0 &&
+          fwrite(&header, sizeof(header), 1, file) == 1);
+}
+
+
+//! Forces the file to disk.
+void
+StatisticsHistory::sync_file(FILE *f)
+{
+#if defined(HAVE_FSYNC)
+  fsync(fileno(f));
+#elif defined(PLATFORM_OS_WIN32)
+  _commit(_fileno(f));
+#else
+  (void) f;
+#endif
+}
+
+
+//! Returns the sort key of a date.
+gint32
+StatisticsHistory::make_date(int y, int m, int d)
+{
+  return y * 10000 + m * 100 + d;
+}
+
+
+//! Converts statistics into a record.
+void
+StatisticsHistory::to_record(const IStatistics::DailyStats &stats, Record &record)
+{
+  memset(&record, 0, sizeof(record));
+
+  record.date = make_date(stats.start.tm_year + 1900, stats.start.tm_mon + 1, stats.start.tm_mday);
+
+  record.start[0] = stats.start.tm_year;
+  record.start[1] = stats.start.tm_mon;
+  record.start[2] = stats.start.tm_mday;
+  record.start[3] = stats.start.tm_hour;
+  record.start[4] = stats.start.tm_min;
+
+  record.stop[0] = stats.stop.tm_year;
+  record.stop[1] = stats.stop.tm_mon;
+  record.stop[2] = stats.stop.tm_mday;
+  record.stop[3] = stats.stop.tm_hour;
+  record.stop[4] = stats.stop.tm_min;
+
+  for (int i = 0; i < BREAK_ID_SIZEOF; i++)
+    {
+      for (int j = 0; j < IStatistics::STATS_BREAKVALUE_SIZEOF; j++)
+        {
+          record.break_stats[i][j] = stats.break_stats[i][j];
+        }
+    }
+
+  for (int j = 0; j < IStatistics::STATS_VALUE_SIZEOF; j++)
+    {
+      record.misc_stats[j] = stats.misc_stats[j];
+    }
+}
+
+
+//! Converts a record into statistics.
+void
+StatisticsHistory::from_record(const Record &record, IStatistics::DailyStats &stats)
+{
+  memset((void *)&stats.start, 0, sizeof(stats.start));
+  memset((void *)&stats.stop, 0, sizeof(stats.stop));
+
+  stats.start.tm_year = record.start[0];
+  stats.start.tm_mon = record.start[1];
+  stats.start.tm_mday = record.start[2];
+  stats.start.tm_hour = record.start[3];
+  stats.start.tm_min = record.start[4];
+
+  stats.stop.tm_year = record.stop[0];
+  stats.stop.tm_mon = record.stop[1];
+  stats.stop.tm_mday = record.stop[2];
+  stats.stop.tm_hour = record.stop[3];
+  stats.stop.tm_min = record.stop[4];
+
+  for (int i = 0; i < BREAK_ID_SIZEOF; i++)
+    {
+      for (int j = 0; j < IStatistics::STATS_BREAKVALUE_SIZEOF; j++)
+        {
+          stats.break_stats[i][j] = record.break_stats[i][j];
+        }
+    }
+
+  for (int j = 0; j < IStatistics::STATS_VALUE_SIZEOF; j++)
+    {
+      stats.misc_stats[j] = record.misc_stats[j];
+    }
+}
+
+
+//! Orders records by date.
+bool
+StatisticsHistory::date_less(const Record &a, const Record &b)
+{
+  return a.date < b.date;
+}
@@ -0,0 +1,106 @@
+// StatisticsHistory.hh --- Indexed binary history of daily statistics
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef STATISTICSHISTORY_HH
+#define STATISTICSHISTORY_HH
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "IStatistics.hh"
+
+using namespace workrave;
+
+//! Memory mapped history of daily statistics.
+/*!
+ *  The history file is a small header followed by fixed size records, one
+ *  per day, sorted by date. The file is mapped into memory as a whole, so
+ *  opening it does not depend on the number of days, and days are located
+ *  by a binary search on their date.
+ *
+ *  A day that is newer than all others is appended in place. Any other
+ *  change rewrites the file into a temporary file that replaces the
+ *  history atomically.
+ */
+class StatisticsHistory
+{
+public:
+  StatisticsHistory(const std::string &filename);
+  virtual ~StatisticsHistory();
+
+  bool open();
+  void close();
+  bool import(const std::vector<IStatistics::DailyStats *> &days);
+  bool add(const IStatistics::DailyStats &stats);
+  bool remove();
+
+  int size() const;
+  bool get(int pos, IStatistics::DailyStats &stats) const;
+  int find(int y, int m, int d, bool &found) const;
+
+  const std::string &get_filename() const;
+
+private:
+  struct Header
+  {
+    guint32 magic;
+    guint16 version;
+    guint16 record_size;
+    guint32 count;
+    guint32 reserved;
+  };
+
+  struct Record
+  {
+    gint64 misc_stats[IStatistics::STATS_VALUE_SIZEOF];
+    gint32 date;
+    gint32 start[5];
+    gint32 stop[5];
+    gint32 break_stats[BREAK_ID_SIZEOF][IStatistics::STATS_BREAKVALUE_SIZEOF];
+  };
+
+  const Record *get_record(int pos) const;
+  bool append_record(const Record &record);
+  bool rewrite(const Record *records, int count, const Record *insert, int pos, bool replace);
+  bool write_header(FILE *file, guint32 count);
+  void sync_file(FILE *file);
+
+  static gint32 make_date(int y, int m, int d);
+  static void to_record(const IStatistics::DailyStats &stats, Record &record);
+  static void from_record(const Record &record, IStatistics::DailyStats &stats);
+  static bool date_less(const Record &a, const Record &b);
+
+private:
+  //! Name of the history file.
+  std::string filename;
+
+  //! Mapping of the history file, or NULL.
+  GMappedFile *mapped;
+
+  //! First record in the mapping.
+  const Record *records;
+
+  //! Number of records.
+  int count;
+};
+
+#endif // STATISTICSHISTORY_HH
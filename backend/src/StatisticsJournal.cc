@@ -0,0 +1,458 @@
+// StatisticsJournal.cc --- Append-only journal of daily statistics
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "debug.hh"
+
+#include "StatisticsJournal.hh"
+#include "PersistenceWorker.hh"
+
+using namespace std;
+
+//! Magic number of each record ("WRSJ").
+static const guint32 JOURNAL_MAGIC = 0x4a535257;
+
+//! Version of the journal format.
+static const int JOURNAL_VERSION = 1;
+
+//! Number of appended batches after which the journal is synced to disk.
+static const int JOURNAL_SYNC_INTERVAL = 10;
+
+//! Number of records after which the journal is compacted.
+static const int JOURNAL_COMPACT_RECORDS = 4096;
+
+
+//! Constructor
+StatisticsJournal::StatisticsJournal(const string &filename) :
+  filename(filename),
+  sequence(0),
+  record_count(0),
+  unsynced_count(0),
+  generation(0)
+{
+  clear(journaled);
+}
+
+
+//! Destructor
+StatisticsJournal::~StatisticsJournal()
+{
+  close();
+}
+
+
+//! Returns the name of the journal file.
+const string &
+StatisticsJournal::get_filename() const
+{
+  return filename;
+}
+
+
+//! Returns the generation of the last committed batch.
+gint64
+StatisticsJournal::get_generation() const
+{
+  return generation;
+}
+
+
+//! Sets the generation of the last committed batch.
+/*!
+ *  The next batch or snapshot gets a higher generation.
+ */
+void
+StatisticsJournal::set_generation(gint64 generation)
+{
+  this->generation = generation;
+}
+
+
+//! Loads the last committed statistics from the journal.
+/*!
+ *  \retval true if the journal contained statistics.
+ */
+bool
+StatisticsJournal::load(IStatistics::DailyStats &stats)
+{
+  TRACE_ENTER_MSG("StatisticsJournal::load", filename);
+
+  close();
+  clear(stats);
+
+  FILE *in = g_fopen(filename.c_str(), "rb");
+  if (in == NULL)
+    {
+      TRACE_RETURN(false);
+      return false;
+    }
+
+  IStatistics::DailyStats pending;
+  clear(pending);
+
+  bool have_header = false;
+  guint32 expected = 0;
+  guint32 committed = 0;
+  gint64 committed_generation = 0;
+  Record record;
+
+  while (read_record(in, record))
+    {
+      if (record.magic != JOURNAL_MAGIC ||
+          record.checksum != compute_checksum(record) ||
+          record.sequence != expected)
+        {
+          TRACE_MSG("corrupt record " << expected);
+          break;
+        }
+      expected++;
+
+      if (record.type == RECORD_HEADER)
+        {
+          if (have_header || record.index != JOURNAL_VERSION)
+            {
+              break;
+            }
+          have_header = true;
+        }
+      else if (!have_header)
+        {
+          break;
+        }
+      else if (record.type == RECORD_COMMIT)
+        {
+          stats = pending;
+          committed = expected;
+          committed_generation = record.value;
+        }
+      else if (!apply_record(record, pending))
+        {
+          break;
+        }
+    }
+
+  fseek(in, 0, SEEK_END);
+  long size = ftell(in);
+  fclose(in);
+
+  bool ok = committed > 0 && stats.start.tm_year != 0;
+  if (ok)
+    {
+      journaled = stats;
+      sequence = committed;
+      record_count = committed;
+      generation = committed_generation;
+
+      if (size != (long)(committed * sizeof(Record)))
+        {
+          // Torn or corrupt tail. Rewrite the committed state.
+          TRACE_MSG("recovering " << size << " " << committed);
+          reset(stats);
+        }
+    }
+  else
+    {
+      clear(stats);
+    }
+
+  TRACE_RETURN(ok);
+  return ok;
+}
+
+
+//! Appends the changes since the previous append.
+void
+StatisticsJournal::append(const IStatistics::DailyStats &stats)
+{
+  TRACE_ENTER("StatisticsJournal::append");
+
+  if (record_count == 0)
+    {
+      // No usable journal, start a new one.
+      reset(stats);
+      TRACE_EXIT();
+      return;
+    }
+
+  string out;
+
+  if (pack_time(stats.start) != pack_time(journaled.start))
+    {
+      write_record(out, RECORD_START, 0, pack_time(stats.start));
+    }
+
+  if (pack_time(stats.stop) != pack_time(journaled.stop))
+    {
+      write_record(out, RECORD_STOP, 0, pack_time(stats.stop));
+    }
+
+  for (int i = 0; i < BREAK_ID_SIZEOF; i++)
+    {
+      for (int j = 0; j < IStatistics::STATS_BREAKVALUE_SIZEOF; j++)
+        {
+          gint64 delta = stats.break_stats[i][j] - journaled.break_stats[i][j];
+          if (delta != 0)
+            {
+              write_record(out, RECORD_BREAK, i * IStatistics::STATS_BREAKVALUE_SIZEOF + j, delta);
+            }
+        }
+    }
+
+  for (int j = 0; j < IStatistics::STATS_VALUE_SIZEOF; j++)
+    {
+      gint64 delta = stats.misc_stats[j] - journaled.misc_stats[j];
+      if (delta != 0)
+        {
+          write_record(out, RECORD_MISC, j, delta);
+        }
+    }
+
+  if (!out.empty())
+    {
+      generation++;
+      write_record(out, RECORD_COMMIT, 0, generation);
+
+      journaled = stats;
+      unsynced_count++;
+
+      if (record_count >= JOURNAL_COMPACT_RECORDS)
+        {
+          reset(stats);
+        }
+      else
+        {
+          // A failed write leaves a gap in the sequence numbers; loading
+          // stops at the gap.
+          bool sync = unsynced_count >= JOURNAL_SYNC_INTERVAL;
+          PersistenceWorker::get_instance()->append(filename, out, sync);
+          if (sync)
+            {
+              unsynced_count = 0;
+            }
+        }
+    }
+
+  TRACE_EXIT();
+}
+
+
+//! Replaces the journal by a snapshot of the specified statistics.
+void
+StatisticsJournal::reset(const IStatistics::DailyStats &stats)
+{
+  TRACE_ENTER("StatisticsJournal::reset");
+
+  sequence = 0;
+  record_count = 0;
+  generation++;
+
+  string out;
+  write_snapshot(out, stats);
+
+  // The snapshot replaces the file atomically, after any pending appends.
+  PersistenceWorker::get_instance()->write(filename, out);
+
+  journaled = stats;
+  unsynced_count = 0;
+
+  TRACE_EXIT();
+}
+
+
+//! Forces all appended changes to disk.
+void
+StatisticsJournal::sync()
+{
+  if (unsynced_count > 0)
+    {
+      PersistenceWorker::get_instance()->append(filename, "", true);
+      unsynced_count = 0;
+    }
+}
+
+
+//! Forces all appended changes to disk and forgets the journal.
+/*!
+ *  The next append starts a new journal.
+ */
+void
+StatisticsJournal::close()
+{
+  sync();
+  record_count = 0;
+}
+
+
+//! Writes a complete snapshot of the statistics.
+void
+StatisticsJournal::write_snapshot(string &out, const IStatistics::DailyStats &stats)
+{
+  write_record(out, RECORD_HEADER, JOURNAL_VERSION, 0);
+  write_record(out, RECORD_START, 0, pack_time(stats.start));
+  write_record(out, RECORD_STOP, 0, pack_time(stats.stop));
+
+  for (int i = 0; i < BREAK_ID_SIZEOF; i++)
+    {
+      for (int j = 0; j < IStatistics::STATS_BREAKVALUE_SIZEOF; j++)
+        {
+          if (stats.break_stats[i][j] != 0)
+            {
+              write_record(out, RECORD_BREAK, i * IStatistics::STATS_BREAKVALUE_SIZEOF + j,
+                           stats.break_stats[i][j]);
+            }
+        }
+    }
+
+  for (int j = 0; j < IStatistics::STATS_VALUE_SIZEOF; j++)
+    {
+      if (stats.misc_stats[j] != 0)
+        {
+          write_record(out, RECORD_MISC, j, stats.misc_stats[j]);
+        }
+    }
+
+  write_record(out, RECORD_COMMIT, 0, generation);
+}
+
+
+//! Adds a single record to the specified buffer.
+void
+StatisticsJournal::write_record(string &out, RecordType type, int index, gint64 value)
+{
+  Record record;
+  memset(&record, 0, sizeof(record));
+
+  record.magic = JOURNAL_MAGIC;
+  record.type = type;
+  record.index = index;
+  record.value = value;
+  record.sequence = sequence;
+  record.checksum = compute_checksum(record);
+
+  out.append((const char *) &record, sizeof(record));
+  sequence++;
+  record_count++;
+}
+
+
+//! Reads a single record.
+bool
+StatisticsJournal::read_record(FILE *in, Record &record)
+{
+  return fread(&record, sizeof(record), 1, in) == 1;
+}
+
+
+//! Applies a counter or time record to the statistics.
+bool
+StatisticsJournal::apply_record(const Record &record, IStatistics::DailyStats &stats)
+{
+  bool ok = true;
+
+  switch (record.type)
+    {
+    case RECORD_START:
+      unpack_time(record.value, stats.start);
+      break;
+
+    case RECORD_STOP:
+      unpack_time(record.value, stats.stop);
+      break;
+
+    case RECORD_BREAK:
+      if (record.index < BREAK_ID_SIZEOF * IStatistics::STATS_BREAKVALUE_SIZEOF)
+        {
+          int i = record.index / IStatistics::STATS_BREAKVALUE_SIZEOF;
+          int j = record.index % IStatistics::STATS_BREAKVALUE_SIZEOF;
+          stats.break_stats[i][j] += (int)record.value;
+        }
+      break;
+
+    case RECORD_MISC:
+      if (record.index < IStatistics::STATS_VALUE_SIZEOF)
+        {
+          stats.misc_stats[record.index] += record.value;
+        }
+      break;
+
+    default:
+      ok = false;
+      break;
+    }
+
+  return ok;
+}
+
+
+//! Computes the FNV-1a checksum of a record, excluding the checksum itself.
+guint32
+StatisticsJournal::compute_checksum(const Record &record)
+{
+  const guint8 *data = (const guint8 *) &record;
+  guint32 hash = 2166136261U;
+
+  for (size_t i = 0; i < sizeof(Record) - sizeof(record.checksum); i++)
+    {
+      hash ^= data[i];
+      hash *= 16777619U;
+    }
+
+  return hash;
+}
+
+
+//! Packs the fields of a time as stored in the statistics.
+gint64
+StatisticsJournal::pack_time(const struct tm &t)
+{
+  return (((gint64) t.tm_year) << 32) |
+    (((gint64) (t.tm_mon & 0xff)) << 24) |
+    (((gint64) (t.tm_mday & 0xff)) << 16) |
+    (((gint64) (t.tm_hour & 0xff)) << 8) |
+    ((gint64) (t.tm_min & 0xff));
+}
+
+
+//! Unpacks a time packed by pack_time.
+void
+StatisticsJournal::unpack_time(gint64 value, struct tm &t)
+{
+  memset(&t, 0, sizeof(t));
+
+  t.tm_year = (int)(value >> 32);
+  t.tm_mon = (int)((value >> 24) & 0xff);
+  t.tm_mday = (int)((value >> 16) & 0xff);
+  t.tm_hour = (int)((value >> 8) & 0xff);
+  t.tm_min = (int)(value & 0xff);
+}
+
+
+//! Clears all statistics.
+void
+StatisticsJournal::clear(IStatistics::DailyStats &stats)
+{
+  memset((void *)&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,114 @@
+// StatisticsJournal.hh --- Append-only journal of daily statistics
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef STATISTICSJOURNAL_HH
+#define STATISTICSJOURNAL_HH
+
+#include <stdio.h>
+#include <string>
+
+#include <glib.h>
+
+#include "IStatistics.hh"
+
+using namespace workrave;
+
+//! Append-only binary journal of the statistics of the current day.
+/*!
+ *  The journal is a sequence of fixed size, checksummed records. A batch
+ *  of records holds the changes since the previous batch, and ends with a
+ *  commit record. When loading, a torn or corrupt tail is discarded and
+ *  the journal is rewritten from the last committed state.
+ *
+ *  Appending only writes the counters that changed. The records are written
+ *  by the PersistenceWorker; the file is synced to disk every few batches,
+ *  and compacted into a snapshot when it grows.
+ *
+ *  Each batch is numbered by a generation that keeps increasing across
+ *  snapshots, so that other copies of the statistics can be compared with
+ *  the journal.
+ */
+class StatisticsJournal
+{
+public:
+  StatisticsJournal(const std::string &filename);
+  virtual ~StatisticsJournal();
+
+  bool load(IStatistics::DailyStats &stats);
+  void append(const IStatistics::DailyStats &stats);
+  void reset(const IStatistics::DailyStats &stats);
+  void sync();
+  void close();
+
+  const std::string &get_filename() const;
+  gint64 get_generation() const;
+  void set_generation(gint64 generation);
+
+private:
+  enum RecordType
+    {
+      RECORD_HEADER = 1,
+      RECORD_START,
+      RECORD_STOP,
+      RECORD_BREAK,
+      RECORD_MISC,
+      RECORD_COMMIT,
+    };
+
+  struct Record
+  {
+    guint32 magic;
+    guint16 type;
+    guint16 index;
+    gint64 value;
+    guint32 sequence;
+    guint32 checksum;
+  };
+
+  void write_record(std::string &out, RecordType type, int index, gint64 value);
+  void write_snapshot(std::string &out, const IStatistics::DailyStats &stats);
+  bool read_record(FILE *file, Record &record);
+  bool apply_record(const Record &record, IStatistics::DailyStats &stats);
+
+  static guint32 compute_checksum(const Record &record);
+  static gint64 pack_time(const struct tm &t);
+  static void unpack_time(gint64 value, struct tm &t);
+  static void clear(IStatistics::DailyStats &stats);
+
+private:
+  //! Name of the journal file.
+  std::string filename;
+
+  //! Statistics as stored in the journal.
+  IStatistics::DailyStats journaled;
+
+  //! Sequence number of the next record.
+  guint32 sequence;
+
+  //! Number of records in the journal.
+  int record_count;
+
+  //! Number of batches appended since the last sync.
+  int unsynced_count;
+
+  //! Generation of the last committed batch.
+  gint64 generation;
+};
+
+#endif // STATISTICSJOURNAL_HH
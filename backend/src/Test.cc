@@ -34,6 +34,10 @@
 #include "Core.hh"
 #include "IApp.hh"
 
+#if defined(HAVE_DISTRIBUTION) && !defined(NDEBUG)
+#include "FakeActivityMonitor.hh"
+#endif
+
 Test *Test::instance = NULL;
 
 void
@@ -44,4 +48,39 @@ Test::quit()
   core->application->terminate();
 }
 
+
+//! Sets the state of the fake activity monitor.
+void
+Test::set_activity(bool active)
+{
+#if defined(HAVE_DISTRIBUTION) && !defined(NDEBUG)
+  Core *core = Core::get_instance();
+
+  if (core->fake_monitor != NULL)
+    {
+      core->fake_monitor->set_state(active ? ACTIVITY_ACTIVE : ACTIVITY_IDLE);
+    }
+#else
+  (void) active;
+#endif
+}
+
+
+//! Is this client the master?
+bool
+Test::is_master()
+{
+  Core *core = Core::get_instance();
+
+  return core->is_master();
+}
+
+
+//! Returns the counters of the persistence worker.
+void
+Test::get_persistence_stats(PersistenceWorker::Stats &stats)
+{
+  PersistenceWorker::get_instance()->get_stats(stats);
+}
+
 #endif
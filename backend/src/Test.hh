@@ -20,12 +20,17 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include "PersistenceWorker.hh"
+
 class Test
 {
 public:
   static Test *get_instance();
 
   void quit();
+  void set_activity(bool active);
+  bool is_master();
+  void get_persistence_stats(PersistenceWorker::Stats &stats);
 private:
   //! The one and only instance
   static Test *instance;
@@ -36,6 +36,7 @@
 #include "ICore.hh"
 
 #include "Timer.hh"
+#include "DeadlineQueue.hh"
 #include "TimePredFactory.hh"
 #include "TimePred.hh"
 #include "TimeSource.hh"
@@ -83,7 +84,9 @@ Timer::Timer() :
   total_overdue_time(0),
   activity_monitor(NULL),
   activity_sensitive(true),
-  insensitive_mode(INSENSITIVE_MODE_IDLE_ON_LIMIT_REACHED)
+  insensitive_mode(INSENSITIVE_MODE_IDLE_ON_LIMIT_REACHED),
+  deadline_queue(NULL),
+  deadline_id(0)
 {
   core = CoreFactory::get_core();
 }
@@ -125,6 +128,7 @@ Timer::enable()
         }
 
       compute_next_predicate_reset_time();
+      request_process();
     }
 
   TRACE_EXIT();
@@ -149,6 +153,7 @@ Timer::disable()
       next_reset_time = 0;
 
       timer_state = STATE_INVALID;
+      update_deadline();
     }
   TRACE_EXIT();
 }
@@ -271,6 +276,8 @@ Timer::set_activity_sensitive(bool a)
           activity_state = ACTIVITY_ACTIVE;
         }
     }
+
+  request_process();
   TRACE_EXIT();
 }
 
@@ -278,7 +285,11 @@ Timer::set_activity_sensitive(bool a)
 void
 Timer::set_insensitive_mode(InsensitiveMode mode)
 {
-  insensitive_mode = mode;
+  if (insensitive_mode != mode)
+    {
+      insensitive_mode = mode;
+      request_process();
+    }
 }
 
 
@@ -291,6 +302,7 @@ Timer::force_idle()
     {
       TRACE_MSG("Forcing idle");
       activity_state = ACTIVITY_IDLE;
+      request_process();
     }
   TRACE_EXIT();
 }
@@ -303,6 +315,7 @@ Timer::force_active()
   if (!activity_sensitive)
     {
       activity_state = ACTIVITY_ACTIVE;
+      request_process();
     }
 }
 
@@ -353,6 +366,8 @@ Timer::compute_next_limit_time()
             }
         }
     }
+
+  update_deadline();
 }
 
 
@@ -378,6 +393,8 @@ Timer::compute_next_reset_time()
           next_reset_time = 0;
         }
     }
+
+  update_deadline();
 }
 
 
@@ -398,6 +415,69 @@ Timer::compute_next_predicate_reset_time()
       autoreset_interval_predicate->set_last(last_pred_reset_time);
       next_pred_reset_time = autoreset_interval_predicate->get_next();
     }
+
+  update_deadline();
+}
+
+
+//! Returns the earliest time at which process() can generate an event.
+/*!
+ *  \retval 0 if no event is scheduled.
+ */
+time_t
+Timer::get_next_event_time() const
+{
+  time_t ret = next_limit_time;
+
+  if (next_reset_time != 0 && (ret == 0 || next_reset_time < ret))
+    {
+      ret = next_reset_time;
+    }
+
+  if (autoreset_interval_predicate != NULL &&
+      next_pred_reset_time != 0 && (ret == 0 || next_pred_reset_time < ret))
+    {
+      ret = next_pred_reset_time;
+    }
+
+  return ret;
+}
+
+
+//! Sets the queue in which the next event time of this timer is scheduled.
+/*!
+ *  \param queue deadline queue owned by the Core.
+ *  \param id ID of this timer in the queue.
+ */
+void
+Timer::set_deadline_queue(DeadlineQueue *queue, int id)
+{
+  deadline_queue = queue;
+  deadline_id = id;
+  update_deadline();
+  request_process();
+}
+
+
+//! Reschedules the next event time of this timer.
+void
+Timer::update_deadline()
+{
+  if (deadline_queue != NULL)
+    {
+      deadline_queue->schedule(deadline_id, get_next_event_time());
+    }
+}
+
+
+//! Requests processing on the next heartbeat, regardless of the next event time.
+void
+Timer::request_process()
+{
+  if (deadline_queue != NULL)
+    {
+      deadline_queue->wakeup(deadline_id, core->get_time());
+    }
 }
 
 
@@ -563,6 +643,7 @@ Timer::snooze_timer()
         {
           // Start the clock in case of insensitive timer.
           activity_state = ACTIVITY_ACTIVE;
+          request_process();
         }
     }
 }
@@ -859,6 +940,9 @@ Timer::process(ActivityState new_activity_state, TimerInfo &info)
           activity_state = ACTIVITY_IDLE;
         }
     }
+
+  // Reschedule, also when a due event was not handled in this run.
+  update_deadline();
   TRACE_EXIT();
 }
 
@@ -39,6 +39,7 @@
 class TimeSource;
 class TimePred;
 class DataNode;
+class DeadlineQueue;
 
 namespace workrave
 {
@@ -152,6 +153,10 @@ public:
   time_t get_limit() const;
   time_t get_next_limit_time() const;
 
+  // Scheduling.
+  time_t get_next_event_time() const;
+  void set_deadline_queue(DeadlineQueue *queue, int id);
+
   // Timer ID
   void set_id(std::string id);
   std::string get_id() const;
@@ -276,10 +281,18 @@ private:
   //!
   InsensitiveMode insensitive_mode;
 
+  //! Queue in which the next event time is scheduled.
+  DeadlineQueue *deadline_queue;
+
+  //! ID of this timer in the deadline queue.
+  int deadline_id;
+
 private:
   void compute_next_limit_time();
   void compute_next_reset_time();
   void compute_next_predicate_reset_time();
+  void update_deadline();
+  void request_process();
 };
 
 #include "Timer.icc"
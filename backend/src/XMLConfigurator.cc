@@ -1,6 +1,6 @@
 // XMLConfigurator.cc --- Configuration Access
 //
-// Copyright (C) 2002, 2003, 2006, 2007, 2009, 2011, 2012 Rob Caelers <robc@krandor.nl>
+// Copyright (C) 2002, 2003, 2006, 2007, 2009, 2011, 2012, 2013 Rob Caelers <robc@krandor.nl>
 // All rights reserved.
 //
 // This program is free software: you can redistribute it and/or modify
@@ -23,27 +23,31 @@
 
 #include "debug.hh"
 #include <sstream>
-#include <iostream>
+#include <algorithm>
+#include <vector>
 #include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
 
-#include "Util.hh"
 #include "XMLConfigurator.hh"
+#include "PersistenceWorker.hh"
 
 using namespace std;
 
-//! Constructor
-XMLConfigurator::XMLConfigurator()
-  : parent(NULL)
+//! State of the parser while loading.
+struct XMLConfigurator::ParseState
 {
-}
+  //! Values read so far.
+  Values values;
+
+  //! Path of each open element.
+  vector<string> paths;
+};
 
 
 //! Constructor
-/*!
- *  \param parent pointer to the parent XML node.
- */
-XMLConfigurator::XMLConfigurator(XMLConfigurator *p)
-  : parent(p)
+XMLConfigurator::XMLConfigurator()
 {
 }
 
@@ -51,56 +55,58 @@ XMLConfigurator::XMLConfigurator(XMLConfigurator *p)
 //! Destructor
 XMLConfigurator::~XMLConfigurator()
 {
-  Children::const_iterator i;
-  for (i = node_children.begin(); i != node_children.end(); i++)
-    {
-      delete i->second;
-    }
 }
 
 
 bool
 XMLConfigurator::load(string filename)
 {
-  TRACE_ENTER("XMLConfigurator::load");
+  TRACE_ENTER_MSG("XMLConfigurator::load", filename);
+  bool ret = false;
 
   last_file_name = filename;
 
-  GdomeElement *root = NULL;
-  GdomeException exc;
-
-  // Create URI from filename
-  string uri = "file:///" + filename;
+  FILE *file = g_fopen(filename.c_str(), "rb");
+  if (file != NULL)
+    {
+      GMarkupParser parser = { on_start_element, on_end_element, NULL, NULL, NULL };
+      ParseState state;
+      GError *error = NULL;
 
-  if (Util::file_exists(filename)) {
-    // First get a DOMImplementation reference
-    GdomeDOMImplementation *domImpl = NULL;
-    domImpl = gdome_di_mkref();
+      GMarkupParseContext *context = g_markup_parse_context_new(&parser, (GMarkupParseFlags) 0, &state, NULL);
 
-    // Load XML from file.
-    GdomeDocument *doc = gdome_di_createDocFromURI(domImpl, uri.c_str(), GDOME_LOAD_PARSING, &exc);
+      char buffer[READ_SIZE];
+      size_t size;
 
-    if (doc != NULL)
-      {
-        // Get root element
-        root = gdome_doc_documentElement(doc, &exc);
+      ret = true;
+      while (ret && (size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+          ret = g_markup_parse_context_parse(context, buffer, size, &error);
+        }
 
-        if (root != NULL)
-          {
-            GdomeNode *node = GDOME_N(root);
-            init(node);
+      if (ret)
+        {
+          ret = !ferror(file) && g_markup_parse_context_end_parse(context, &error);
+        }
 
-            gdome_el_unref(root, &exc);
-          }
+      if (error != NULL)
+        {
+          TRACE_MSG("error: " << error->message);
+          g_error_free(error);
+        }
 
-        gdome_di_freeDoc(domImpl, doc, &exc);
-      }
+      g_markup_parse_context_free(context);
+      fclose(file);
 
-    gdome_di_unref(domImpl, &exc);
-  }
+      if (ret)
+        {
+          sort_values(state.values);
+          values.swap(state.values);
+        }
+    }
 
-  TRACE_EXIT();
-  return root != NULL;
+  TRACE_RETURN(ret);
+  return ret;
 }
 
 
@@ -108,28 +114,11 @@ bool
 XMLConfigurator::save(string filename)
 {
   TRACE_ENTER_MSG("XMLConfigurator::save", filename);
-  string saveStr;
-
-  GdomeException exc;
 
-  // First get a DOMImplementation reference
-  GdomeDOMImplementation *domImpl = NULL;
-  domImpl = gdome_di_mkref();
-
-  // Create Doc
-  GdomeDocument *doc = NULL;
-  GdomeElement *root = NULL;
-
-  save_to(domImpl, &doc, root);
-
-  if (doc != NULL)
-    {
-      /* Save the created document */
-      gdome_di_saveDocToFile(domImpl, doc, filename.c_str(), GDOME_SAVE_STANDARD, &exc);
-      gdome_di_freeDoc(domImpl, doc, &exc);
-    }
+  string data = "<?xml version=\"1.0\"?>\n";
+  write_node(data, "workrave", values.begin(), values.end(), 0, 0);
 
-  gdome_di_unref(domImpl, &exc);
+  PersistenceWorker::get_instance()->write(filename, data);
 
   TRACE_EXIT();
   return true;
@@ -146,35 +135,30 @@ XMLConfigurator::save()
 bool
 XMLConfigurator::remove_key(const std::string &key)
 {
-  (void) key;
-  return false;
+  bool ret = false;
+
+  ValueIter i = find_value(key);
+  if (i != values.end())
+    {
+      values.erase(i);
+      ret = true;
+    }
+
+  return ret;
 }
 
+
 bool
 XMLConfigurator::get_config_value(const string &key, string &out) const
 {
   TRACE_ENTER_MSG("XMLConfigurator::get_config_value", key);
   bool ret = false;
-  string stripped_key = key;
 
-  string path = strip_path(stripped_key);
-  if (path != "")
-    {
-      XMLConfigurator *child = get_child(path);
-      if (child != NULL)
-        {
-          ret = child->get_config_value(stripped_key, out);
-        }
-    }
-  else
+  ValueCIter i = find_value(key);
+  if (i != values.end())
     {
-      Attributes::const_iterator i = node_attributes.find(stripped_key);
-
-      if (i != node_attributes.end())
-        {
-          out = (*i).second;
-          ret = true;
-        }
+      out = i->second;
+      ret = true;
     }
 
   TRACE_RETURN(out);
@@ -245,35 +229,19 @@ bool
 XMLConfigurator::set_config_value(const string &key, string v)
 {
   TRACE_ENTER_MSG("XMLConfigurator::set_config_value", key  << " " << v);
-  bool ret = false;
-
-  string stripped_key = key;
-  string path = strip_path(stripped_key);
 
-  if (path != "")
+  ValueIter i = lower_bound(values.begin(), values.end(), key, KeyLess());
+  if (i != values.end() && i->first == key)
     {
-      XMLConfigurator *child = get_child(path);
-      if (child != NULL)
-        {
-          ret = child->set_config_value(stripped_key, v);
-        }
-      else if (create_child(path))
-        {
-          child = get_child(path);
-          if (child != NULL)
-            {
-              ret = child->set_config_value(stripped_key, v);
-            }
-        }
+      i->second = v;
     }
   else
     {
-      node_attributes[stripped_key] = v;
-      ret = true;
+      values.insert(i, Value(key, v));
     }
 
   TRACE_EXIT();
-  return ret;
+  return true;
 }
 
 
@@ -328,346 +296,178 @@ XMLConfigurator::set_config_value(const string &key, double v)
 }
 
 
-//! Initialize this node.
+//! Parser callback: an element starts.
 /*!
- *  \param node the Gdome XML node.
+ *  The attributes of the element are stored as values under the path of
+ *  the element.
  */
 void
-XMLConfigurator::init(GdomeNode *node)
+XMLConfigurator::on_start_element(GMarkupParseContext *context, const gchar *element_name,
+                                  const gchar **attribute_names, const gchar **attribute_values,
+                                  gpointer user_data, GError **error)
 {
-  TRACE_ENTER("XMLConfigurator::init");
-  GdomeException exc;
+  (void) context;
+  (void) error;
 
-  GdomeDOMString *nodeName = gdome_n_nodeName(node, &exc);
-  GdomeDOMString *nodeValue = gdome_n_nodeValue(node, &exc);
+  ParseState *state = (ParseState *) user_data;
+  string path;
 
-  if (nodeName != NULL)
+  // The root element is the top of the configuration.
+  if (!state->paths.empty())
     {
-      setName(nodeName->str);
-      xml_node_name = nodeName->str;
-  }
+      const gchar *name = element_name;
+      for (int i = 0; attribute_names[i] != NULL; i++)
+        {
+          if (strcmp(attribute_names[i], "id") == 0)
+            {
+              name = attribute_values[i];
+            }
+        }
 
-  GdomeNodeType nodeType = (GdomeNodeType) gdome_n_nodeType(node, &exc);
-  switch (nodeType)
-    {
-    case GDOME_TEXT_NODE:
-      {
-        break;
-      }
-
-    case GDOME_DOCUMENT_NODE:
-      {
-        GdomeNode *child = gdome_n_firstChild(node, &exc);
-
-        while (child != NULL)
-          {
-            if (gdome_n_nodeType(child, &exc) == GDOME_ELEMENT_NODE)
-              {
-                XMLConfigurator *n = new XMLConfigurator(this);
-                n->init(child);
-
-                node_children[n->getName()] = n;
-              }
-
-            child = gdome_n_nextSibling(child, &exc);
-          }
-      }
-      break;
-
-    case GDOME_ELEMENT_NODE:
-      {
-        GdomeNamedNodeMap *attributes = gdome_n_attributes(node, &exc);
-
-        int attrCount = gdome_nnm_length(attributes, &exc);
-        for (int i = 0; i < attrCount; i++)
-          {
-            GdomeNode *attribute = gdome_nnm_item(attributes, i, &exc);
-
-            GdomeDOMString *k = gdome_n_nodeName(attribute, &exc);
-            GdomeDOMString *v = gdome_n_nodeValue(attribute, &exc);
-
-            if (k != NULL && v != NULL)
-              {
-                string key = k->str;
-                string value = v->str;
-
-                node_attributes[key] = value;
-
-                if (key == "id")
-                  {
-                    setName(value);
-                    xml_node_name = value;
-                  }
-              }
-
-            if (k != NULL)
-              gdome_str_unref(k);
-
-            if (v != NULL)
-              gdome_str_unref(v);
-
-          }
-
-        GdomeNode *child = gdome_n_firstChild(node, &exc);
-
-        while (child != NULL)
-          {
-            if (gdome_n_nodeType(child, &exc) == GDOME_ELEMENT_NODE)
-              {
-                XMLConfigurator *n = new XMLConfigurator(this);
-                n->init(child);
-
-                node_children[n->getName()] = n;
-              }
-
-            child = gdome_n_nextSibling(child, &exc);
-          }
-      }
-      break;
-    default:
-      cerr << "Unrecognized node type = "
-           << nodeType << endl;
+      const string &parent = state->paths.back();
+      path = parent.empty() ? string(name) : parent + "/" + name;
     }
 
-  if (nodeName != NULL)
-    gdome_str_unref(nodeName);
-
-  if (nodeValue != NULL)
-    gdome_str_unref(nodeValue);
+  for (int i = 0; attribute_names[i] != NULL; i++)
+    {
+      string key = path.empty() ? string(attribute_names[i]) : path + "/" + attribute_names[i];
+      state->values.push_back(Value(key, attribute_values[i]));
+    }
 
-  TRACE_EXIT();
+  state->paths.push_back(path);
 }
 
 
+//! Parser callback: an element ends.
 void
-XMLConfigurator::save_to(GdomeDOMImplementation *impl, GdomeDocument **doc, GdomeElement *node)
+XMLConfigurator::on_end_element(GMarkupParseContext *context, const gchar *element_name,
+                                gpointer user_data, GError **error)
 {
-  TRACE_ENTER_MSG("XMLConfigurator::save_to", node_name);
-
-  GdomeException exc;
-  GdomeElement *elem = NULL;
+  (void) context;
+  (void) element_name;
+  (void) error;
 
-  /* Create a new element */
-  GdomeDOMString *name = NULL;
+  ParseState *state = (ParseState *) user_data;
+  state->paths.pop_back();
+}
 
-  if (node_name == "")
-    {
-      name = gdome_str_mkref("workrave");
-    }
-  else if (xml_node_name != "")
-    {
-      name = gdome_str_mkref(xml_node_name.c_str());
-    }
-  else
-    {
-      GdomeDOMString *node_name = gdome_n_nodeName((GdomeNode *)node, &exc);
 
-      if (node_name != NULL)
-        {
-          xml_node_name = node_name->str;
-          gdome_str_unref(node_name);
-        }
-    }
+//! Sorts values that were read in file order.
+/*!
+ *  Of several values with the same key, the last one is kept.
+ */
+void
+XMLConfigurator::sort_values(Values &values)
+{
+  stable_sort(values.begin(), values.end(), KeyLess());
 
-  if (node == NULL || *doc == NULL)
+  ValueIter out = values.begin();
+  for (ValueIter it = values.begin(); it != values.end(); it++)
     {
-      // Top level node -> Create Doc
-      *doc = gdome_di_createDocument(impl, NULL, name, NULL, &exc);
-
-      if (doc != NULL)
+      ValueIter next = it + 1;
+      if (next == values.end() || next->first != it->first)
         {
-          // Get root element
-          elem = gdome_doc_documentElement(*doc, &exc);
+          if (out != it)
+            {
+              out->first.swap(it->first);
+              out->second.swap(it->second);
+            }
+          out++;
         }
     }
-  else
-    {
-      elem = gdome_doc_createElement(*doc, name, &exc);
-
-      /* append the element to the childs list of the root element */
-      gdome_el_appendChild(node, (GdomeNode *)elem, &exc);
-    }
-
-  gdome_str_unref (name);
-
-  // Add Text Node.
-  // if (m_text != "")
-  //   {
-  //     GdomeDOMString *value = NULL;
-  //     value = gdome_str_mkref(m_text.c_str());
-  //
-  //     GdomeText *textNode = gdome_doc_createTextNode(*doc, value, &exc);
-  //     gdome_str_unref(value);
-  //
-  //     gdome_el_appendChild (elem, (GdomeNode *)textNode, &exc);
-  //     gdome_t_unref(textNode, &exc);
-  //   }
-
-  Attributes::iterator i = node_attributes.begin();
-  while (i != node_attributes.end())
-    {
-      GdomeDOMString *name = NULL;
-      GdomeDOMString *value = NULL;
 
-      name = gdome_str_mkref((*i).first.c_str());
-      value = gdome_str_mkref((*i).second.c_str());
-
-      gdome_el_setAttribute(elem, name, value, &exc);
-
-      gdome_str_unref(name);
-      gdome_str_unref(value);
-
-      i++;
-    }
-
-  Children::iterator ic = node_children.begin();
-  while (ic != node_children.end())
-    {
-      ic->second->save_to(impl, doc, elem);
-      ic++;
-    }
-
-  gdome_el_unref(elem, &exc);
-  TRACE_EXIT();
+  values.erase(out, values.end());
 }
 
 
-string
-XMLConfigurator::strip_path(string &key) const
+//! Returns the value of a key, or the end of the table.
+XMLConfigurator::ValueIter
+XMLConfigurator::find_value(const string &key)
 {
-  TRACE_ENTER("XMLConfigurator::strip_path")
-  std::string::size_type pos = key.rfind('/');
-
-  string path;
-
-  if (pos != std::string::npos)
-    {
-      path = key.substr(0, pos);
-      key = key.substr(pos + 1);
-    }
-
-  TRACE_EXIT();
-  return path;
+  ValueIter i = lower_bound(values.begin(), values.end(), key, KeyLess());
+  return (i != values.end() && i->first == key) ? i : values.end();
 }
 
 
-XMLConfigurator *
-XMLConfigurator::get_child(const string &key) const
+//! Returns the value of a key, or the end of the table.
+XMLConfigurator::ValueCIter
+XMLConfigurator::find_value(const string &key) const
 {
-  TRACE_ENTER_MSG("XMLConfigurator::get_config_value_child", key << "(" << node_name << ")");
-
-  XMLConfigurator *ret = NULL;
-
-  std::string::size_type pos = key.find('/');
-
-  string prefix;
-  string newKey;
-
-  if (pos != std::string::npos)
-    {
-      prefix = key.substr(0, pos);
-      newKey = key.substr(pos + 1);
-    }
-  else
-    {
-      prefix = key;
-      newKey = "";
-    }
-
-  TRACE_MSG("new = |" << prefix << "|" << newKey << "|");
-
-  Children::const_iterator i = node_children.find(prefix);
-  if (i != node_children.end())
-    {
-      TRACE_MSG("found");
-
-      if (newKey != "")
-        {
-          TRACE_MSG("recursing");
-          ret = i->second->get_child(newKey);
-        }
-      else
-        {
-          TRACE_MSG("this");
-          ret = i->second;
-        }
-    }
-  else
-    {
-      TRACE_MSG("not found");
-    }
-
-  TRACE_RETURN(" " << (ret != NULL));
-  return ret;
+  ValueCIter i = lower_bound(values.begin(), values.end(), key, KeyLess());
+  return (i != values.end() && i->first == key) ? i : values.end();
 }
 
 
-
-bool
-XMLConfigurator::create_child(const string &key)
+//! Writes the element of a node.
+/*!
+ *  \param begin first value of the node.
+ *  \param end value after the last value of the node.
+ *  \param prefix_length length of the path of the node, including the
+ *  trailing '/'.
+ */
+void
+XMLConfigurator::write_node(string &out, const string &name, ValueCIter begin, ValueCIter end,
+                            string::size_type prefix_length, int depth) const
 {
-  TRACE_ENTER_MSG("XMLConfigurator::create_child", "|" << key << "|");
-
-  bool ret = true;
+  string indent(depth * 2, ' ');
+  out += indent + "<" + name;
 
-  if (key != "")
+  // Values of this node
+  for (ValueCIter it = begin; it != end; it++)
     {
-      std:: string::size_type pos = key.find('/');
-
-      string prefix;
-      string newKey;
-
-      if (pos != std::string::npos)
-        {
-          prefix = key.substr(0, pos);
-          newKey = key.substr(pos + 1);
-        }
-      else
+      const string &key = it->first;
+      if (key.find('/', prefix_length) == string::npos)
         {
-          prefix = key;
-          newKey = "";
+          gchar *escaped = g_markup_escape_text(it->second.c_str(), -1);
+          out += " ";
+          out.append(key, prefix_length, string::npos);
+          out += "=\"";
+          out += escaped;
+          out += "\"";
+          g_free(escaped);
         }
+    }
 
+  // Child nodes. The values of each child are adjacent, as they share a
+  // prefix.
+  bool has_children = false;
+  ValueCIter it = begin;
+  while (it != end)
+    {
+      const string &key = it->first;
+      string::size_type slash = key.find('/', prefix_length);
 
-      TRACE_MSG("new = " << prefix << " " << newKey);
-
-      Children::const_iterator i = node_children.find(prefix);
-
-      if (i != node_children.end())
+      if (slash == string::npos)
         {
-          TRACE_MSG("found " << newKey);
-          i->second->create_child(newKey);
+          it++;
         }
       else
         {
-          XMLConfigurator *n = new XMLConfigurator(this);
+          if (!has_children)
+            {
+              out += ">\n";
+              has_children = true;
+            }
 
-          n->setName(prefix);
-          n->xml_node_name = prefix;
-          node_children[prefix] = n;
+          string::size_type child_length = slash + 1 - prefix_length;
+          ValueCIter child_begin = it;
 
-          TRACE_MSG("|" << node_path << "|" << prefix << "|" << newKey << "|");
+          while (it != end && it->first.compare(prefix_length, child_length, key, prefix_length, child_length) == 0)
+            {
+              it++;
+            }
 
-          n->create_child(newKey);
+          write_node(out, key.substr(prefix_length, child_length - 1), child_begin, it,
+                     slash + 1, depth + 1);
         }
     }
 
-  TRACE_EXIT();
-  return ret;
-}
-
-
-//! Returns all children.
-list<XMLConfigurator *>
-XMLConfigurator::get_all_children() const
-{
-  list<XMLConfigurator *> ret;
-
-  Children::const_iterator i;
-  for (i = node_children.begin(); i != node_children.end(); i++)
+  if (has_children)
     {
-      ret.push_back(i->second);
+      out += indent + "</" + name + ">\n";
+    }
+  else
+    {
+      out += "/>\n";
     }
-
-  return ret;
 }
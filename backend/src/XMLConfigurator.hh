@@ -1,6 +1,6 @@
 // XMLConfigurator.hh
 //
-// Copyright (C) 2001, 2002, 2006, 2007, 2012 Rob Caelers <robc@krandor.nl>
+// Copyright (C) 2001, 2002, 2006, 2007, 2012, 2013 Rob Caelers <robc@krandor.nl>
 // All rights reserved.
 //
 // This program is free software: you can redistribute it and/or modify
@@ -20,24 +20,32 @@
 #ifndef XMLCONFIGURATOR_HH
 #define XMLCONFIGURATOR_HH
 
+#include <stdio.h>
+
 #include <string>
-#include <list>
-#include <map>
+#include <utility>
+#include <vector>
 
-#undef interface
-#include <gdome.h>
+#include <glib.h>
 
 #include "IConfigBackend.hh"
 #include "ConfigBackendAdapter.hh"
 
+//! Configuration backend that stores the configuration in an XML file.
+/*!
+ *  Each element of the file is a node of the configuration, named by its
+ *  id attribute or, without one, by its tag. Each attribute is a value.
+ *
+ *  The file is parsed by a streaming parser directly into a flat, sorted
+ *  table of full keys, and saved by writing the table. No document tree is
+ *  built.
+ */
 class XMLConfigurator : public virtual IConfigBackend, public virtual ConfigBackendAdapter
 {
 public:
   XMLConfigurator();
-  XMLConfigurator(XMLConfigurator *parent);
   virtual ~XMLConfigurator();
 
-
   // Pure virtuals from Configurator
   virtual bool load(std::string filename);
   virtual bool save(std::string filename);
@@ -58,57 +66,57 @@ public:
   virtual bool set_config_value(const std::string &key, double v);
 
 private:
-  void init(GdomeNode *node);
-  void save_to(GdomeDOMImplementation *impl, GdomeDocument **doc, GdomeElement *node);
-  std::string strip_path(std::string &key) const;
-  XMLConfigurator *get_child(const std::string &key) const;
-  std::list<XMLConfigurator *> get_all_children() const;
-  virtual bool create_child(const std::string &key);
-
-  std::string getName() const
+  enum
+    {
+      //! Number of bytes read from the file at once.
+      READ_SIZE = 16384
+    };
+
+  typedef std::pair<std::string, std::string> Value;
+  typedef std::vector<Value> Values;
+  typedef Values::iterator ValueIter;
+  typedef Values::const_iterator ValueCIter;
+
+  //! Orders values by key.
+  struct KeyLess
   {
-    return node_name;
-  }
+    bool operator()(const Value &a, const Value &b) const
+    {
+      return a.first < b.first;
+    }
 
-  void setName(std::string name)
-  {
-    node_name = name;
+    bool operator()(const Value &a, const std::string &b) const
+    {
+      return a.first < b;
+    }
 
-    if (parent != NULL)
-      {
-        node_path = parent->getPath() + node_name + "/";
-      }
-  }
+    bool operator()(const std::string &a, const Value &b) const
+    {
+      return a < b.first;
+    }
+  };
 
-  std::string getPath() const
-  {
-    return node_path;
-  }
+  struct ParseState;
 
-private:
-  typedef std::map<std::string, std::string> Attributes;
-  typedef std::map<std::string, XMLConfigurator *> Children;
+  static void on_start_element(GMarkupParseContext *context, const gchar *element_name,
+                               const gchar **attribute_names, const gchar **attribute_values,
+                               gpointer user_data, GError **error);
+  static void on_end_element(GMarkupParseContext *context, const gchar *element_name,
+                             gpointer user_data, GError **error);
+
+  static void sort_values(Values &values);
+  ValueIter find_value(const std::string &key);
+  ValueCIter find_value(const std::string &key) const;
 
-  //! Parent
-  XMLConfigurator *parent;
+  void write_node(std::string &out, const std::string &name, ValueCIter begin, ValueCIter end,
+                  std::string::size_type prefix_length, int depth) const;
 
+private:
   //! File name of the last 'load'.
   std::string last_file_name;
 
-  //! Name in XML file.
-  std::string xml_node_name;
-
-  //! My name (relative to parent)
-  std::string node_name;
-
-  //! My path (absolute name);
-  std::string node_path;
-
-  //! All child nodes.
-  Children node_children;
-
-  //! All attributes
-  Attributes node_attributes;
+  //! All values, sorted by full key.
+  Values values;
 };
 
 #endif // XMLCONFIGURATOR_HH
@@ -37,6 +37,9 @@
 #include "X11InputMonitor.hh"
 #include "XScreenSaverMonitor.hh"
 #include "MutterInputMonitor.hh"
+#ifdef HAVE_XI2
+#include "XI2InputMonitor.hh"
+#endif
 
 UnixInputMonitorFactory::UnixInputMonitorFactory()
   : error_reported(false)
@@ -62,6 +65,7 @@ UnixInputMonitorFactory::get_monitor(IInputMonitorFactory::MonitorCapability cap
     {
       bool initialized = false;
       string configure_monitor_method;
+      int motion_window;
 
       vector<string> available_monitors;
       StringUtil::split(HAVE_MONITORS, ',', available_monitors);
@@ -72,6 +76,10 @@ UnixInputMonitorFactory::get_monitor(IInputMonitorFactory::MonitorCapability cap
                                                               configure_monitor_method,
                                                               "default");
 
+      CoreFactory::get_configurator()->get_value_with_default("advanced/monitor_motion_window",
+                                                              motion_window,
+                                                              50);
+
       vector<string>::const_iterator start = available_monitors.end();
 
       if (configure_monitor_method != "default")
@@ -94,15 +102,27 @@ UnixInputMonitorFactory::get_monitor(IInputMonitorFactory::MonitorCapability cap
 
           if (actual_monitor_method == "record")
             {
-              monitor = new RecordInputMonitor(display);
+              RecordInputMonitor *record_monitor = new RecordInputMonitor(display);
+              record_monitor->set_motion_window(motion_window);
+              monitor = record_monitor;
             }
+#ifdef HAVE_XI2
+          else if (actual_monitor_method == "xi2")
+            {
+              XI2InputMonitor *xi2_monitor = new XI2InputMonitor(display);
+              xi2_monitor->set_motion_window(motion_window);
+              monitor = xi2_monitor;
+            }
+#endif
           else if (actual_monitor_method == "screensaver")
             {
               monitor = new XScreenSaverMonitor();
             }
           else if (actual_monitor_method == "x11events")
             {
-              monitor = new X11InputMonitor(display);
+              X11InputMonitor *x11_monitor = new X11InputMonitor(display);
+              x11_monitor->set_motion_window(motion_window);
+              monitor = x11_monitor;
             }
           else if (actual_monitor_method == "mutter")
             {
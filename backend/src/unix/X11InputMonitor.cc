@@ -82,6 +82,12 @@
 using namespace std;
 using namespace workrave;
 
+//! Pointer poll interval in milliseconds while the user is active.
+static const long MIN_POLL_INTERVAL = 100;
+
+//! Maximum pointer poll interval in milliseconds while the user is idle.
+static const long MAX_POLL_INTERVAL = 1600;
+
 #ifndef HAVE_APP_GTK
 static int (*old_handler)(Display *dpy, XErrorEvent *error);
 #endif
@@ -207,10 +213,16 @@ X11InputMonitor::run()
 
   error_trap_exit();
 
+  // Poll interval of the pointer position. Doubles while the pointer does
+  // not move, and returns to the minimum on any input.
+  long poll_interval = MIN_POLL_INTERVAL;
+  int last_x = -1;
+  int last_y = -1;
+
   while (1)
     {
       XEvent event;
-      bool gotEvent = XNextEventTimed(x11_display, &event, 100);
+      bool gotEvent = XNextEventTimed(x11_display, &event, poll_interval);
 
       if (abort)
         {
@@ -253,7 +265,26 @@ X11InputMonitor::run()
 
       error_trap_exit();
 
-      fire_mouse(root_x, root_y);
+      if (root_x != last_x || root_y != last_y)
+        {
+          last_x = root_x;
+          last_y = root_y;
+          fire_mouse(root_x, root_y);
+
+          poll_interval = MIN_POLL_INTERVAL;
+        }
+      else if (gotEvent)
+        {
+          poll_interval = MIN_POLL_INTERVAL;
+        }
+      else if (poll_interval < MAX_POLL_INTERVAL)
+        {
+          poll_interval *= 2;
+          if (poll_interval > MAX_POLL_INTERVAL)
+            {
+              poll_interval = MAX_POLL_INTERVAL;
+            }
+        }
     }
 
   TRACE_EXIT();
@@ -0,0 +1,338 @@
+// XI2InputMonitor.cc --- ActivityMonitor for X11 using XInput2 raw events
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "debug.hh"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include <X11/X.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XInput2.h>
+
+#include "XI2InputMonitor.hh"
+
+#ifdef HAVE_APP_GTK
+#include <gdk/gdkx.h>
+#endif
+
+#include "Thread.hh"
+
+using namespace std;
+
+#ifndef HAVE_APP_GTK
+static int (*old_handler)(Display *dpy, XErrorEvent *error);
+#endif
+
+#ifndef HAVE_APP_GTK
+//! Intercepts X11 protocol errors.
+static int
+errorHandler(Display *dpy, XErrorEvent *error)
+{
+  (void)dpy;
+  (void)error;
+  return 0;
+}
+#endif
+
+XI2InputMonitor::XI2InputMonitor(const string &display_name) :
+  x11_display(NULL),
+  root_window(None),
+  xi_opcode(0),
+  last_key(0),
+  abort(false)
+{
+  x11_display_name = display_name;
+  wakeup_pipe[0] = -1;
+  wakeup_pipe[1] = -1;
+  monitor_thread = new Thread(this);
+}
+
+
+XI2InputMonitor::~XI2InputMonitor()
+{
+  TRACE_ENTER("XI2InputMonitor::~XI2InputMonitor");
+  if (monitor_thread != NULL)
+    {
+      monitor_thread->wait();
+      delete monitor_thread;
+    }
+
+  if (wakeup_pipe[0] != -1)
+    {
+      close(wakeup_pipe[0]);
+      close(wakeup_pipe[1]);
+    }
+
+  if (x11_display != NULL)
+    {
+      XCloseDisplay(x11_display);
+    }
+  TRACE_EXIT();
+}
+
+
+bool
+XI2InputMonitor::init()
+{
+  bool ok = init_xi2();
+  if (ok)
+    {
+      monitor_thread->start();
+    }
+  return ok;
+}
+
+
+void
+XI2InputMonitor::terminate()
+{
+  TRACE_ENTER("XI2InputMonitor::terminate");
+
+  abort = true;
+  if (wakeup_pipe[1] != -1)
+    {
+      char c = 0;
+      if (write(wakeup_pipe[1], &c, 1) != 1)
+        {
+          TRACE_MSG("Failed to wake up monitor thread");
+        }
+    }
+  monitor_thread->wait();
+
+  TRACE_EXIT();
+}
+
+
+//! Initializes XInput2 raw event monitoring.
+bool
+XI2InputMonitor::init_xi2()
+{
+  TRACE_ENTER("XI2InputMonitor::init_xi2");
+
+  if ((x11_display = XOpenDisplay(x11_display_name.c_str())) == NULL)
+    {
+      TRACE_RETURN(false);
+      return false;
+    }
+
+  int event_base, error_base;
+  if (!XQueryExtension(x11_display, "XInputExtension", &xi_opcode, &event_base, &error_base))
+    {
+      TRACE_MSG("No XInputExtension");
+      XCloseDisplay(x11_display);
+      x11_display = NULL;
+      TRACE_RETURN(false);
+      return false;
+    }
+
+  // Raw events are delivered to the root window regardless of grabs since 2.1.
+  int major = 2;
+  int minor = 1;
+  if (XIQueryVersion(x11_display, &major, &minor) != Success || major < 2 || (major == 2 && minor < 1))
+    {
+      TRACE_MSG("XInput2 version " << major << "." << minor << " too old");
+      XCloseDisplay(x11_display);
+      x11_display = NULL;
+      TRACE_RETURN(false);
+      return false;
+    }
+
+  if (pipe(wakeup_pipe) != 0)
+    {
+      wakeup_pipe[0] = wakeup_pipe[1] = -1;
+      XCloseDisplay(x11_display);
+      x11_display = NULL;
+      TRACE_RETURN(false);
+      return false;
+    }
+
+  root_window = DefaultRootWindow(x11_display);
+
+  unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)];
+  memset(mask_bits, 0, sizeof(mask_bits));
+
+  XIEventMask mask;
+  mask.deviceid = XIAllMasterDevices;
+  mask.mask_len = sizeof(mask_bits);
+  mask.mask = mask_bits;
+
+  XISetMask(mask_bits, XI_RawMotion);
+  XISetMask(mask_bits, XI_RawKeyPress);
+  XISetMask(mask_bits, XI_RawKeyRelease);
+  XISetMask(mask_bits, XI_RawButtonPress);
+  XISetMask(mask_bits, XI_RawButtonRelease);
+
+  error_trap_enter();
+  XISelectEvents(x11_display, root_window, &mask, 1);
+  XSync(x11_display, False);
+  error_trap_exit();
+
+  TRACE_EXIT();
+  return true;
+}
+
+
+void
+XI2InputMonitor::run()
+{
+  TRACE_ENTER("XI2InputMonitor::run");
+
+  int x11_fd = ConnectionNumber(x11_display);
+  int max_fd = x11_fd > wakeup_pipe[0] ? x11_fd : wakeup_pipe[0];
+
+  while (!abort)
+    {
+      bool motion = false;
+
+      while (XPending(x11_display))
+        {
+          XEvent event;
+          XNextEvent(x11_display, &event);
+
+          XGenericEventCookie *cookie = &event.xcookie;
+          if (cookie->type == GenericEvent && cookie->extension == xi_opcode &&
+              XGetEventData(x11_display, cookie))
+            {
+              handle_xi2_event(cookie, motion);
+              XFreeEventData(x11_display, cookie);
+            }
+        }
+
+      // All queued motion is reported with a single pointer query.
+      if (motion)
+        {
+          report_pointer();
+        }
+
+      // The pointer query may have queued new events.
+      if (XEventsQueued(x11_display, QueuedAlready) > 0)
+        {
+          continue;
+        }
+
+      fd_set readset;
+      FD_ZERO(&readset);
+      FD_SET(x11_fd, &readset);
+      FD_SET(wakeup_pipe[0], &readset);
+
+      // Block until there is input or we are terminated.
+      if (select(max_fd + 1, &readset, NULL, NULL, NULL) < 0 && errno != EINTR)
+        {
+          TRACE_MSG("select failed " << errno);
+          break;
+        }
+    }
+
+  TRACE_EXIT();
+}
+
+
+void
+XI2InputMonitor::handle_xi2_event(XGenericEventCookie *cookie, bool &motion)
+{
+  XIRawEvent *event = (XIRawEvent *) cookie->data;
+
+  switch (cookie->evtype)
+    {
+    case XI_RawMotion:
+      motion = true;
+      break;
+
+    case XI_RawKeyPress:
+      fire_keyboard(event->detail == last_key);
+      last_key = event->detail;
+      break;
+
+    case XI_RawKeyRelease:
+      last_key = 0;
+      break;
+
+    case XI_RawButtonPress:
+    case XI_RawButtonRelease:
+      // Buttons 4-7 are scroll wheel events.
+      if (event->detail >= 4 && event->detail <= 7)
+        {
+          if (cookie->evtype == XI_RawButtonPress)
+            {
+              report_pointer(event->detail % 2 == 0 ? 1 : -1);
+            }
+        }
+      else
+        {
+          fire_button(cookie->evtype == XI_RawButtonPress);
+        }
+      break;
+    }
+}
+
+
+void
+XI2InputMonitor::report_pointer(int wheel)
+{
+  Window root, child;
+  int root_x, root_y, win_x, win_y;
+  unsigned mask;
+
+  error_trap_enter();
+  Bool ok = XQueryPointer(x11_display, root_window, &root, &child,
+                          &root_x, &root_y, &win_x, &win_y, &mask);
+  error_trap_exit();
+
+  if (ok)
+    {
+      fire_mouse(root_x, root_y, wheel);
+    }
+}
+
+
+void
+XI2InputMonitor::error_trap_enter()
+{
+#ifdef HAVE_APP_GTK
+  gdk_x11_display_error_trap_push(gdk_display_get_default());
+#else
+  old_handler = XSetErrorHandler(&errorHandler);
+#endif
+}
+
+
+void
+XI2InputMonitor::error_trap_exit()
+{
+#ifdef HAVE_APP_GTK
+  gdk_display_flush(gdk_display_get_default());
+  gdk_x11_display_error_trap_pop_ignored(gdk_display_get_default());
+#else
+  XSetErrorHandler(old_handler);
+#endif
+}
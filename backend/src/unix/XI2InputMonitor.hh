@@ -0,0 +1,97 @@
+// XI2InputMonitor.hh --- ActivityMonitor for X11 using XInput2 raw events
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef XI2INPUTMONITOR_HH
+#define XI2INPUTMONITOR_HH
+
+#include <string>
+
+#include <X11/X.h>
+#include <X11/Xlib.h>
+
+#include "InputMonitor.hh"
+
+#include "Runnable.hh"
+#include "Thread.hh"
+
+//! Activity monitor for a local X server based on XInput2 raw events.
+/*!
+ *  The monitor thread blocks until the X server reports input, or until
+ *  the monitor is terminated. It never wakes up while the user is idle.
+ */
+class XI2InputMonitor :
+  public InputMonitor,
+  public Runnable
+{
+public:
+  //! Constructor.
+  XI2InputMonitor(const std::string &display_name);
+
+  //! Destructor.
+  virtual ~XI2InputMonitor();
+
+  //! Initialize
+  virtual bool init();
+
+  //! Terminate the monitor.
+  virtual void terminate();
+
+private:
+  //! The monitor's execution thread.
+  virtual void run();
+
+  void error_trap_enter();
+  void error_trap_exit();
+
+  //! Initialize XInput2.
+  bool init_xi2();
+
+  //! Handle a single XInput2 event.
+  void handle_xi2_event(XGenericEventCookie *cookie, bool &motion);
+
+  //! Reports the current pointer position.
+  void report_pointer(int wheel = 0);
+
+private:
+  //! The X11 display name.
+  std::string x11_display_name;
+
+  //! The X11 display handle.
+  Display *x11_display;
+
+  //! The X11 root window handle.
+  Window root_window;
+
+  //! Major opcode of the XInputExtension.
+  int xi_opcode;
+
+  //! Key code of the last key press, 0 after a release.
+  int last_key;
+
+  //! Pipe used to wake up the monitor thread on termination.
+  int wakeup_pipe[2];
+
+  //! Abort the main loop
+  bool abort;
+
+  //! The activity monitor thread.
+  Thread *monitor_thread;
+};
+
+#endif // XI2INPUTMONITOR_HH
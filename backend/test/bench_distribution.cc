@@ -0,0 +1,426 @@
+// bench_distribution.cc --- Signon traffic of many in-process links over loopback
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "Configurator.hh"
+#include "CoreConfig.hh"
+#include "DistributionListener.hh"
+#include "DistributionManager.hh"
+#include "DistributionSocketLink.hh"
+#include "IConfigBackend.hh"
+#include "Util.hh"
+
+using namespace std;
+
+//! Number of clients, including the one that joins last.
+static const int DEFAULT_NUM_CLIENTS = 20;
+
+//! Listen port of the first client.
+static const int DEFAULT_BASE_PORT = 27270;
+
+//! Seconds within which all clients must know each other.
+static const int CONVERGE_TIMEOUT = 120;
+
+
+//! Configuration backend that keeps the values in memory.
+/*!
+ *  It claims to monitor changes, so that the configurator neither saves
+ *  it nor needs a core for its timers.
+ */
+class MemoryBackend : public IConfigBackend, public IConfigBackendMonitoring
+{
+public:
+  bool load(std::string filename)
+  {
+    (void) filename;
+    return true;
+  }
+
+  bool save(std::string filename)
+  {
+    (void) filename;
+    return true;
+  }
+
+  bool save()
+  {
+    return true;
+  }
+
+  bool remove_key(const std::string &key)
+  {
+    return values.erase(key) > 0;
+  }
+
+  bool get_value(const std::string &key, VariantType type, Variant &value) const
+  {
+    (void) type;
+
+    map<string, Variant>::const_iterator i = values.find(key);
+    bool ret = (i != values.end());
+    if (ret)
+      {
+        value = i->second;
+      }
+    return ret;
+  }
+
+  bool set_value(const std::string &key, Variant &value)
+  {
+    values[key] = value;
+    return true;
+  }
+
+  void set_listener(IConfiguratorListener *listener)
+  {
+    (void) listener;
+  }
+
+  bool add_listener(const std::string &key_prefix)
+  {
+    (void) key_prefix;
+    return true;
+  }
+
+  bool remove_listener(const std::string &key_prefix)
+  {
+    (void) key_prefix;
+    return true;
+  }
+
+private:
+  map<string, Variant> values;
+};
+
+
+//! A client with its own configuration, identity and link.
+class Client : public DistributionListener
+{
+public:
+  Client(const string &home, int port)
+    : home(home), port(port)
+  {
+    // The link reads its ID from the home directory when it is created.
+    Util::set_home_directory(home);
+
+    configurator = new Configurator(new MemoryBackend);
+    configurator->set_value(CoreConfig::CFG_KEY_DISTRIBUTION_ENABLED, true);
+    configurator->set_value(CoreConfig::CFG_KEY_DISTRIBUTION_LISTENING, true);
+    configurator->set_value(CoreConfig::CFG_KEY_DISTRIBUTION_TCP_PORT, port);
+
+    manager = new DistributionManager();
+    manager->init(configurator);
+    manager->add_listener(this);
+  }
+
+  ~Client()
+  {
+    delete manager;
+    delete configurator;
+
+    g_unlink((home + "/id").c_str());
+    g_rmdir(home.c_str());
+  }
+
+  void connect(const Client *other)
+  {
+    char url[64];
+    g_snprintf(url, sizeof(url), "tcp://127.0.0.1:%d", other->port);
+    manager->connect(url);
+  }
+
+  void heartbeat()
+  {
+    manager->heartbeart();
+  }
+
+  int get_num_known_clients() const
+  {
+    return remote_clients.size();
+  }
+
+  void get_send_stats(DistributionSocketLink::SendStats &stats) const
+  {
+    DistributionSocketLink *link = dynamic_cast<DistributionSocketLink *>(manager->get_link());
+    link->get_send_stats(stats);
+  }
+
+  void signon_remote_client(string client_id)
+  {
+    remote_clients.insert(client_id);
+  }
+
+  void signoff_remote_client(string client_id)
+  {
+    remote_clients.erase(client_id);
+  }
+
+private:
+  string home;
+  int port;
+  Configurator *configurator;
+  DistributionManager *manager;
+
+  //! Remote clients that are signed on.
+  set<string> remote_clients;
+};
+
+
+//! Wakes up the main loop, so that the heartbeats keep running.
+static gboolean
+on_wakeup(gpointer data)
+{
+  (void) data;
+  return TRUE;
+}
+
+
+//! Returns whether every client knows the specified number of other clients.
+static bool
+is_converged(const vector<Client *> &clients, int expected)
+{
+  bool ret = true;
+
+  for (size_t i = 0; ret && i < clients.size(); i++)
+    {
+      ret = clients[i]->get_num_known_clients() == expected;
+    }
+
+  return ret;
+}
+
+
+//! Runs the main loop until every client knows all others.
+/*!
+ *  \retval -1 if the clients did not converge in time, otherwise the time
+ *  it took in milliseconds.
+ */
+static gint64
+run_until_converged(const vector<Client *> &clients)
+{
+  int expected = clients.size() - 1;
+  gint64 start = g_get_monotonic_time();
+  gint64 next_heartbeat = start + G_USEC_PER_SEC;
+  gint64 ret = -1;
+
+  guint wakeup = g_timeout_add(50, on_wakeup, NULL);
+
+  while (ret == -1)
+    {
+      gint64 now = g_get_monotonic_time();
+
+      if (is_converged(clients, expected))
+        {
+          ret = (now - start) / 1000;
+        }
+      else if (now - start > CONVERGE_TIMEOUT * G_USEC_PER_SEC)
+        {
+          break;
+        }
+      else
+        {
+          if (now >= next_heartbeat)
+            {
+              for (size_t i = 0; i < clients.size(); i++)
+                {
+                  clients[i]->heartbeat();
+                }
+              next_heartbeat += G_USEC_PER_SEC;
+            }
+
+          g_main_context_iteration(NULL, TRUE);
+        }
+    }
+
+  g_source_remove(wakeup);
+  return ret;
+}
+
+
+//! Returns the number of packets and bytes that all clients queued so far.
+static void
+get_totals(const vector<Client *> &clients, gint64 &packets, gint64 &bytes)
+{
+  packets = 0;
+  bytes = 0;
+
+  for (size_t i = 0; i < clients.size(); i++)
+    {
+      DistributionSocketLink::SendStats stats;
+      clients[i]->get_send_stats(stats);
+      packets += stats.packets;
+      bytes += stats.bytes;
+    }
+}
+
+
+//! Returns the client that the specified client connects to.
+static int
+get_parent(const string &topology, int index, GRand *rand)
+{
+  int ret = 0;
+
+  if (topology == "chain")
+    {
+      ret = index - 1;
+    }
+  else if (topology == "tree")
+    {
+      ret = g_rand_int_range(rand, 0, index);
+    }
+
+  return ret;
+}
+
+
+//! Adds a client and connects it to its parent.
+static void
+add_client(vector<Client *> &clients, const string &dir, int base_port, const string &topology, GRand *rand)
+{
+  int index = clients.size();
+
+  char name[16];
+  g_snprintf(name, sizeof(name), "%d", index);
+
+  Client *client = new Client(dir + "/" + name, base_port + index);
+  if (index > 0)
+    {
+      client->connect(clients[get_parent(topology, index, rand)]);
+    }
+
+  clients.push_back(client);
+}
+
+
+//! Reports the traffic of a phase.
+static void
+report(const char *phase, gint64 time, gint64 packets, gint64 bytes)
+{
+  printf("%-8s %8" G_GINT64_FORMAT " ms %10" G_GINT64_FORMAT " packets %12" G_GINT64_FORMAT " bytes\n",
+         phase, time, packets, bytes);
+}
+
+
+//! Connects a network of clients, and then one more client.
+/*!
+ *  Usage: bench_distribution [clients [star|chain|tree [seed [port]]]]
+ *
+ *  Prints the time until all clients know each other, and the number of
+ *  packets that all clients queued, for setting up the network and for
+ *  the last client to join.
+ */
+int
+main(int argc, char **argv)
+{
+  int num_clients = argc > 1 ? atoi(argv[1]) : DEFAULT_NUM_CLIENTS;
+  string topology = argc > 2 ? argv[2] : "star";
+  guint32 seed = argc > 3 ? (guint32) strtoul(argv[3], NULL, 0) : 1;
+  int base_port = argc > 4 ? atoi(argv[4]) : DEFAULT_BASE_PORT;
+
+  if (num_clients < 2 || (topology != "star" && topology != "chain" && topology != "tree"))
+    {
+      fprintf(stderr, "usage: %s [clients [star|chain|tree [seed [port]]]]\n", argv[0]);
+      return 2;
+    }
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+  g_type_init();
+#endif
+
+  // The environment would give all clients the same port and peers.
+  g_unsetenv("WORKRAVE_PORT");
+  g_unsetenv("WORKRAVE_URL");
+
+  gchar *tmpl = g_build_filename(g_get_tmp_dir(), "bench_distribution-XXXXXX", NULL);
+  string dir = g_mkdtemp(tmpl) != NULL ? tmpl : "";
+  g_free(tmpl);
+
+  if (dir == "")
+    {
+      fprintf(stderr, "cannot create a temporary directory\n");
+      return 1;
+    }
+
+  printf("%d clients, %s, seed %u\n", num_clients, topology.c_str(), seed);
+
+  GRand *rand = g_rand_new_with_seed(seed);
+  vector<Client *> clients;
+  int ret = 0;
+
+  for (int i = 0; i < num_clients - 1; i++)
+    {
+      add_client(clients, dir, base_port, topology, rand);
+    }
+
+  gint64 time = run_until_converged(clients);
+  gint64 packets, bytes;
+  get_totals(clients, packets, bytes);
+
+  if (time < 0)
+    {
+      fprintf(stderr, "network did not converge in %d s\n", CONVERGE_TIMEOUT);
+      ret = 1;
+    }
+  else
+    {
+      report("network", time, packets, bytes);
+
+      add_client(clients, dir, base_port, topology, rand);
+
+      time = run_until_converged(clients);
+
+      gint64 join_packets, join_bytes;
+      get_totals(clients, join_packets, join_bytes);
+
+      if (time < 0)
+        {
+          fprintf(stderr, "join did not converge in %d s\n", CONVERGE_TIMEOUT);
+          ret = 1;
+        }
+      else
+        {
+          report("join", time, join_packets - packets, join_bytes - bytes);
+        }
+    }
+
+  for (size_t i = 0; i < clients.size(); i++)
+    {
+      delete clients[i];
+    }
+
+  g_rand_free(rand);
+  g_rmdir(dir.c_str());
+
+  return ret;
+}
@@ -0,0 +1,158 @@
+import unittest
+import os
+import time
+import dbus
+
+from workrave_test_base import WorkraveTestBase
+
+class ConfigTest(WorkraveTestBase):
+
+    def get_num_autostart_workraves(self):
+        return 1
+
+    def restart(self):
+        self.kill()
+        time.sleep(4)
+        self.launch(1, False)
+
+    def get_string(self, key):
+        found, value = self.config[0].GetString(key)
+        if found:
+            return value
+        return None
+
+    def get_int(self, key):
+        value, found = self.config[0].GetInt(key)
+        if found:
+            return value
+        return None
+
+    def get_bool(self, key):
+        value, found = self.config[0].GetBool(key)
+        if found:
+            return value
+        return None
+
+    def get_double(self, key):
+        value, found = self.config[0].GetDouble(key)
+        if found:
+            return value
+        return None
+
+    def test_values(self):
+        self.assertTrue(self.config[0].SetInt("test/int", 42))
+        self.assertTrue(self.config[0].SetBool("test/bool", True))
+        self.assertTrue(self.config[0].SetDouble("test/double", 0.25))
+        self.assertTrue(self.config[0].SetString("test/string", "value"))
+
+        self.assertEqual(self.get_int("test/int"), 42)
+        self.assertEqual(self.get_int("/test/int/"), 42)
+        self.assertEqual(self.get_bool("test/bool"), True)
+        self.assertEqual(self.get_double("test/double"), 0.25)
+        self.assertEqual(self.get_string("test/string"), "value")
+        self.assertEqual(self.get_string("test/int"), None)
+
+        self.assertTrue(self.config[0].SetInt("/test/int/", 43))
+        self.assertEqual(self.get_int("test/int"), 43)
+
+    def test_unknown_keys(self):
+        self.assertTrue(self.config[0].SetInt("test/int", 42))
+
+        for i in range(1000):
+            self.assertEqual(self.get_int("test/unknown/" + str(i)), None)
+
+        self.assertEqual(self.get_int("test/int"), 42)
+        self.assertEqual(self.get_int("timers/micro_pause/limit"), 60)
+
+    def test_transaction(self):
+        self.assertTrue(self.config[0].SetInt("test/int", 1))
+
+        self.config[0].BeginTransaction()
+        self.assertTrue(self.config[0].SetInt("test/int", 2))
+        self.assertEqual(self.get_int("test/int"), 2)
+        self.config[0].AbortTransaction()
+        self.assertEqual(self.get_int("test/int"), 1)
+
+        self.config[0].BeginTransaction()
+        self.config[0].BeginTransaction()
+        self.assertTrue(self.config[0].SetInt("test/int", 3))
+        self.assertTrue(self.config[0].SetInt("test/other", 4))
+        self.assertTrue(self.config[0].CommitTransaction())
+        self.assertTrue(self.config[0].CommitTransaction())
+
+        self.restart()
+        self.assertEqual(self.get_int("test/int"), 3)
+        self.assertEqual(self.get_int("test/other"), 4)
+
+    def test_abandoned_transaction(self):
+        self.assertTrue(self.config[0].SetInt("test/int", 1))
+
+        # Start a transaction from a client that quits without committing.
+        pid = os.fork()
+        if pid == 0:
+            client_bus = dbus.SessionBus(private = True)
+            wr = client_bus.get_object("org.workrave.Workrave1", "/org/workrave/Workrave/Core")
+            config = dbus.Interface(wr, "org.workrave.ConfigInterface")
+            config.BeginTransaction()
+            config.SetInt("test/int", 2)
+            os._exit(0)
+        os.waitpid(pid, 0)
+
+        self.assertEqual(self.get_int("test/int"), 2)
+
+        # The transaction is aborted after a minute.
+        time.sleep(65)
+        self.assertEqual(self.get_int("test/int"), 1)
+
+        # Committing saves the configuration.
+        self.config[0].BeginTransaction()
+        self.assertTrue(self.config[0].SetInt("test/int", 3))
+        self.assertTrue(self.config[0].CommitTransaction())
+
+        self.restart()
+        self.assertEqual(self.get_int("test/int"), 3)
+
+    def test_persistence(self):
+        text = "<&>\"' \xc3\xa9 end"
+
+        self.config[0].BeginTransaction()
+        self.assertTrue(self.config[0].SetString("test/string", text))
+        self.assertTrue(self.config[0].SetString("test/empty", ""))
+        self.assertTrue(self.config[0].SetInt("test/int", -7))
+        self.assertTrue(self.config[0].SetBool("test/bool", False))
+        self.assertTrue(self.config[0].SetDouble("test/double", 1.5))
+        self.assertTrue(self.config[0].CommitTransaction())
+
+        # Let the snapshot of the saved configuration be written.
+        time.sleep(12)
+
+        queued, coalesced, written, written_bytes, failed = self.debug[0].GetPersistenceStats()
+        self.assertTrue(written > 0)
+        self.assertTrue(written <= queued)
+        self.assertEqual(failed, 0)
+
+        for i in range(2):
+            self.restart()
+
+            self.assertEqual(self.get_string("test/string"), text.decode("utf-8"))
+            self.assertEqual(self.get_string("test/empty"), "")
+            self.assertEqual(self.get_int("test/int"), -7)
+            self.assertEqual(self.get_bool("test/bool"), False)
+            self.assertEqual(self.get_double("test/double"), 1.5)
+            self.assertEqual(self.get_int("test/missing"), None)
+            self.assertEqual(self.get_int("timers/micro_pause/limit"), 60)
+
+        # A changed value replaces the one in the snapshot.
+        self.config[0].BeginTransaction()
+        self.assertTrue(self.config[0].SetInt("test/int", 8))
+        self.assertTrue(self.config[0].SetInt("test/missing", 9))
+        self.assertTrue(self.config[0].CommitTransaction())
+
+        self.restart()
+
+        self.assertEqual(self.get_int("test/int"), 8)
+        self.assertEqual(self.get_int("test/missing"), 9)
+        self.assertEqual(self.get_string("test/string"), text.decode("utf-8"))
+
+if __name__ == '__main__':
+    unittest.main()
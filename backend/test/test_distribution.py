@@ -0,0 +1,100 @@
+import unittest
+import time
+
+from workrave_test_base import WorkraveTestBase
+
+# Must match MASTER_LEASE_TIME in DistributionSocketLink.hh.
+MASTER_LEASE_TIME = 5
+
+class DistributionTest(WorkraveTestBase):
+
+    def get_num_autostart_workraves(self):
+        return 3
+
+    def wait_for_master(self, i, timeout = 10):
+        for t in range(timeout):
+            if self.debug[i].IsMaster():
+                return True
+            time.sleep(1)
+        return False
+
+    def measure_takeover(self, i, timeout = 15):
+        start = time.time()
+        while time.time() - start < timeout:
+            if self.debug[i].IsMaster():
+                return time.time() - start
+            time.sleep(0.1)
+        return None
+
+    def assert_elapsed_equal(self, elapsed, i):
+        other = self.core[i].GetTimerElapsed("microbreak")
+        self.assertTrue(abs(other - elapsed) <= 2,
+                        "instance " + str(i) + ": " + str(other) + " != " + str(elapsed))
+
+    def test_signon_state(self):
+        self.connect(1, 0)
+        time.sleep(3)
+
+        self.debug[0].SetActivity(True)
+        self.assertTrue(self.wait_for_master(0))
+        time.sleep(10)
+
+        # A client that signs on later gets the state of the master.
+        self.connect(2, 0)
+        time.sleep(3)
+
+        elapsed = self.core[0].GetTimerElapsed("microbreak")
+        self.assertTrue(elapsed >= 10)
+
+        for i in range(1, 3):
+            self.assertFalse(self.debug[i].IsMaster())
+            self.assertTrue(self.core[i].IsActive())
+            self.assert_elapsed_equal(elapsed, i)
+
+    def test_master_lease(self):
+        self.connect(1, 0)
+        self.connect(2, 0)
+        time.sleep(3)
+
+        self.debug[0].SetActivity(True)
+        self.assertTrue(self.wait_for_master(0))
+
+        # An active master keeps the master status.
+        self.debug[1].SetActivity(True)
+        for t in range(10):
+            time.sleep(1)
+            self.assertTrue(self.debug[0].IsMaster())
+            self.assertFalse(self.debug[1].IsMaster())
+
+        # An idle master does not.
+        self.debug[0].SetActivity(False)
+        self.assertTrue(self.wait_for_master(1))
+        self.assertFalse(self.debug[0].IsMaster())
+        self.assertFalse(self.debug[2].IsMaster())
+
+        time.sleep(2)
+        elapsed = self.core[1].GetTimerElapsed("microbreak")
+        self.assert_elapsed_equal(elapsed, 0)
+        self.assert_elapsed_equal(elapsed, 2)
+
+    def test_takeover_latency(self):
+        self.connect(1, 0)
+        self.connect(2, 0)
+        time.sleep(3)
+
+        self.debug[0].SetActivity(True)
+        self.assertTrue(self.wait_for_master(0))
+
+        # An active client takes over within a lease of the master going
+        # idle, plus a second for the claim to arrive.
+        self.debug[1].SetActivity(True)
+        self.debug[0].SetActivity(False)
+        latency = self.measure_takeover(1)
+        self.assertTrue(latency is not None, "no takeover")
+        self.assertTrue(latency <= MASTER_LEASE_TIME + 2, "takeover took " + str(latency) + "s")
+
+        self.assertFalse(self.debug[0].IsMaster())
+        self.assertFalse(self.debug[2].IsMaster())
+
+if __name__ == '__main__':
+    unittest.main()
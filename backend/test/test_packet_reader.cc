@@ -0,0 +1,360 @@
+// test_packet_reader.cc --- Randomized tests of splitting a stream into packets
+//
+// Copyright (C) 2013 Rob Caelers <robc@krandor.nl>
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "PacketReader.hh"
+#include "PacketBuffer.hh"
+#include "SocketDriver.hh"
+
+using namespace std;
+
+//! Number of random streams per test.
+static const int NUM_ROUNDS = 100;
+
+//! Size of the packet header: length, version, flags and command.
+static const int HEADER_SIZE = 6;
+
+//! Largest packet that fits in a short frame.
+static const int MAX_SHORT_PACKET_SIZE = 0xffff;
+
+//! Largest long packet that is accepted.
+static const int MAX_PACKET_SIZE = 1024 * 1024;
+
+static int failures = 0;
+
+#define CHECK(cond, round)                                              \
+  if (!(cond))                                                          \
+    {                                                                   \
+      fprintf(stderr, "%s:%d: round %d: %s\n", __FILE__, __LINE__, round, #cond); \
+      failures++;                                                       \
+      return;                                                           \
+    }
+
+
+//! Socket that returns a prepared stream in random pieces.
+class StreamSocket : public ISocket
+{
+public:
+  StreamSocket(const string &data, GRand *rand, int max_read)
+    : data(data), pos(0), rand(rand), max_read(max_read)
+  {
+  }
+
+  void connect(const std::string &hostname, int port)
+  {
+    (void) hostname;
+    (void) port;
+  }
+
+  void read(void *buf, int count, int &bytes_read)
+  {
+    int size = g_rand_int_range(rand, 1, max_read + 1);
+    size = MIN(size, count);
+    size = MIN(size, (int) data.size() - pos);
+
+    memcpy(buf, data.data() + pos, size);
+    pos += size;
+    bytes_read = size;
+  }
+
+  void write(void *buf, int count, int &bytes_written)
+  {
+    (void) buf;
+    (void) count;
+    bytes_written = 0;
+  }
+
+  void set_write_notify(bool enabled)
+  {
+    (void) enabled;
+  }
+
+  void close()
+  {
+  }
+
+  bool at_end() const
+  {
+    return pos == (int) data.size();
+  }
+
+private:
+  string data;
+  int pos;
+  GRand *rand;
+  int max_read;
+};
+
+
+//! Returns a random packet of the specified size, as the link creates it.
+static string
+create_packet(GRand *rand, int size)
+{
+  string packet(size, '\0');
+
+  for (int i = HEADER_SIZE; i < size; i++)
+    {
+      packet[i] = (char) g_rand_int_range(rand, 0, 256);
+    }
+
+  // A long packet has a zero length, its length is in the extended header.
+  int length = size <= MAX_SHORT_PACKET_SIZE ? size : 0;
+  packet[0] = (char) (length >> 8);
+  packet[1] = (char) (length & 0xff);
+  packet[2] = 4;
+  packet[3] = 0;
+  packet[4] = (char) g_rand_int_range(rand, 0, 256);
+  packet[5] = (char) g_rand_int_range(rand, 0, 256);
+
+  return packet;
+}
+
+
+//! Returns the packet as it is sent, with an extended header if it is long.
+static string
+create_frame(const string &packet)
+{
+  string frame;
+
+  if (packet.size() > (size_t) MAX_SHORT_PACKET_SIZE)
+    {
+      guint32 length = packet.size();
+      frame += '\0';
+      frame += '\0';
+      frame += (char) (length >> 24);
+      frame += (char) ((length >> 16) & 0xff);
+      frame += (char) ((length >> 8) & 0xff);
+      frame += (char) (length & 0xff);
+    }
+
+  return frame + packet;
+}
+
+
+//! Returns the extended header of a long packet of the specified length.
+static string
+create_extended_header(guint32 length)
+{
+  string header(6, '\0');
+
+  header[2] = (char) (length >> 24);
+  header[3] = (char) ((length >> 16) & 0xff);
+  header[4] = (char) ((length >> 8) & 0xff);
+  header[5] = (char) (length & 0xff);
+
+  return header;
+}
+
+
+//! Reads the complete stream and returns all packets.
+static bool
+read_stream(StreamSocket &socket, PacketReader &reader, vector<string> &packets)
+{
+  while (!socket.at_end())
+    {
+      if (reader.read(&socket) == 0)
+        {
+          return false;
+        }
+
+      PacketBuffer packet;
+      while (reader.next(packet))
+        {
+          packets.push_back(string(packet.get_buffer(), packet.bytes_written()));
+        }
+
+      if (!reader.is_valid())
+        {
+          return false;
+        }
+    }
+
+  return true;
+}
+
+
+//! Splits and merges a stream of short and long packets in random places.
+static void
+test_fragmentation(GRand *rand, int round)
+{
+  vector<string> sent;
+  string stream;
+
+  int count = g_rand_int_range(rand, 1, 50);
+  for (int i = 0; i < count; i++)
+    {
+      int size;
+      switch (g_rand_int_range(rand, 0, 8))
+        {
+        case 0:
+          // Long packet.
+          size = g_rand_int_range(rand, MAX_SHORT_PACKET_SIZE + 1, MAX_PACKET_SIZE + 1);
+          break;
+
+        case 1:
+          // Around the boundary between short and long packets.
+          size = g_rand_int_range(rand, MAX_SHORT_PACKET_SIZE - 2, MAX_SHORT_PACKET_SIZE + 3);
+          break;
+
+        case 2:
+          // Header only.
+          size = HEADER_SIZE;
+          break;
+
+        default:
+          size = g_rand_int_range(rand, HEADER_SIZE, 2000);
+          break;
+        }
+
+      sent.push_back(create_packet(rand, size));
+      stream += create_frame(sent.back());
+    }
+
+  // Reads of a few bytes split every header, large reads merge packets.
+  int max_read = g_rand_boolean(rand) ? g_rand_int_range(rand, 1, 8) : g_rand_int_range(rand, 1, 200000);
+
+  StreamSocket socket(stream, rand, max_read);
+  PacketReader reader;
+  vector<string> received;
+
+  reader.set_long_packets_enabled(true);
+
+  bool ok = read_stream(socket, reader, received);
+  CHECK(ok, round);
+  CHECK(received.size() == sent.size(), round);
+
+  for (size_t i = 0; i < sent.size(); i++)
+    {
+      CHECK(received[i] == sent[i], round);
+    }
+}
+
+
+//! Rejects frames with invalid lengths, wherever the stream is split.
+static void
+test_invalid_length(GRand *rand, int round)
+{
+  string stream;
+
+  int count = g_rand_int_range(rand, 0, 5);
+  for (int i = 0; i < count; i++)
+    {
+      stream += create_frame(create_packet(rand, g_rand_int_range(rand, HEADER_SIZE, 2000)));
+    }
+
+  bool long_packets_enabled = true;
+
+  string invalid;
+  switch (g_rand_int_range(rand, 0, 5))
+    {
+    case 0:
+      {
+        // Short packet smaller than its header.
+        int size = g_rand_int_range(rand, 1, HEADER_SIZE);
+        invalid = string(HEADER_SIZE, '\0');
+        invalid[1] = (char) size;
+      }
+      break;
+
+    case 1:
+      // Long packet smaller than its header.
+      invalid = create_extended_header(g_rand_int_range(rand, 0, HEADER_SIZE)) + string(HEADER_SIZE, '\0');
+      break;
+
+    case 2:
+      // Long packet larger than the maximum.
+      invalid = create_extended_header(0xffffffff - g_rand_int_range(rand, 0, 0x1000000));
+      break;
+
+    case 3:
+      // Long packet just over the maximum.
+      invalid = create_extended_header(MAX_PACKET_SIZE + g_rand_int_range(rand, 1, 100));
+      break;
+
+    case 4:
+      // Long packet before long packets are enabled.
+      invalid = create_frame(create_packet(rand, g_rand_int_range(rand, MAX_SHORT_PACKET_SIZE + 1, 100000)));
+      long_packets_enabled = false;
+      break;
+    }
+
+  stream += invalid;
+
+  // Data after the invalid frame must not be taken as packets.
+  stream += create_frame(create_packet(rand, HEADER_SIZE));
+
+  StreamSocket socket(stream, rand, g_rand_int_range(rand, 1, 100));
+  PacketReader reader;
+  vector<string> received;
+
+  reader.set_long_packets_enabled(long_packets_enabled);
+
+  bool ok = read_stream(socket, reader, received);
+  CHECK(!ok, round);
+  CHECK(!reader.is_valid(), round);
+  CHECK(received.size() == (size_t) count, round);
+
+  reader.clear();
+  CHECK(reader.is_valid(), round);
+
+  // Clearing the reader disables long packets.
+  StreamSocket long_socket(create_frame(create_packet(rand, MAX_SHORT_PACKET_SIZE + 1)), rand, 100000);
+  received.clear();
+
+  ok = read_stream(long_socket, reader, received);
+  CHECK(!ok && received.empty(), round);
+}
+
+
+int
+main(int argc, char **argv)
+{
+  guint32 seed = argc > 1 ? (guint32) strtoul(argv[1], NULL, 0) : (guint32) time(NULL);
+  printf("seed %u\n", seed);
+
+  GRand *rand = g_rand_new_with_seed(seed);
+
+  for (int round = 0; round < NUM_ROUNDS; round++)
+    {
+      test_fragmentation(rand, round);
+      test_invalid_length(rand, round);
+    }
+
+  g_rand_free(rand);
+
+  if (failures > 0)
+    {
+      fprintf(stderr, "%d failures, seed %u\n", failures, seed);
+    }
+
+  return failures > 0 ? 1 : 0;
+}
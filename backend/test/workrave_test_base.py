@@ -18,6 +18,9 @@ class WorkraveTestBase(unittest.TestCase):
         
     def get_num_autostart_workraves(self):
         return 3
+
+    def get_port(self, instance):
+        return 2700 + instance
     
     def start_workrave(self, instance, clean = True):
 
@@ -32,6 +35,7 @@ class WorkraveTestBase(unittest.TestCase):
         env["WORKRAVE_DBUS_NAME"] = "org.workrave.Workrave" + str(instance)
         env["WORKRAVE_HOME"] = tmpdir
         env["WORKRAVE_GCONF_ROOT"] = "/apps/" + name + "/";
+        env["WORKRAVE_PORT"] = str(self.get_port(instance))
 
         if clean:
             try:
@@ -106,8 +110,11 @@ class WorkraveTestBase(unittest.TestCase):
 
         time.sleep(1)
         for i in range(num):
+            self.config[i].BeginTransaction()
+
             # Start listening for incoming connections.
-            self.network[i].Listen(2701 + i)
+            self.config[i].SetBool("distribution/enabled", True)
+            self.config[i].SetBool("distribution/listening", True)
 
             self.config[i].SetBool("timers/micro_pause/enabled", True)
             self.config[i].SetInt("timers/micro_pause/auto_reset", 20)
@@ -115,9 +122,14 @@ class WorkraveTestBase(unittest.TestCase):
             self.config[i].SetInt("timers/micro_pause/snooze", 180)
             self.config[i].SetBool("timers/rest_break/enabled", False)
             self.config[i].SetBool("timers/daily_limit/enabled", False)
+            self.config[i].CommitTransaction()
 
         self.num_running = num;
 
+    def connect(self, i, j):
+        # Connects instance i to instance j, counting from 0.
+        self.config[i].SetString("distribution/peers", "tcp://localhost:" + str(self.get_port(j + 1)))
+
     def kill(self):
         time.sleep(2)
         if run_debugger:
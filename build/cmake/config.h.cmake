@@ -27,6 +27,8 @@
 
 #cmakedefine HAVE_TESTS
 
+#cmakedefine HAVE_XI2
+
 #define HAVE_EXTERN_TIMEZONE 1
 #define HAVE_EXTERN_TIMEZONE_DEFINED 1
 
@@ -138,8 +140,8 @@
 /* Define if GConf is available */
 /* #undef HAVE_GCONF */
 
-/* Define if GDome is available */
-/* #undef HAVE_GDOME */
+/* Define if XML configuration is enabled */
+/* #undef HAVE_XML */
 
 /* Define to 1 if you have the `getcwd' function. */
 #define HAVE_GETCWD 1
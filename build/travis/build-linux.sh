@@ -39,7 +39,6 @@ apt-get -y -q -V --no-install-recommends install \
         libtool \
         autopoint \
         intltool \
-        libgdome2-dev \
         libgconf2-dev \
         python-cheetah \
         `[[ $CONF_GTK_VER = 2 ]] && echo libgtk2.0-dev libgtkmm-2.4-dev`
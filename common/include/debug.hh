@@ -33,49 +33,142 @@
 
 #else
 
-#include <iostream>
-#include <iomanip>
-#include <fstream>
-#include <ctime>
+#include <sstream>
 #include <string>
+#include <string.h>
+
+//! A location in the source that produces trace events.
+/*!
+ *  Each TRACE_ENTER declares a static TraceSite, so the event is
+ *  identified by the address of its site and the name is never copied.
+ */
+struct TraceSite
+{
+  const char *name;
+  const char *file;
+  int line;
+};
 
-#include "Mutex.hh"
-
-extern Mutex g_log_mutex;
-extern std::ofstream g_log_stream;
+//! Arguments of a trace message.
+/*!
+ *  The arguments are stored in binary form and formatted by the thread that
+ *  writes the trace file. Values of types without an overload are formatted
+ *  immediately and stored as a string.
+ */
+class TraceArgs
+{
+public:
+  enum ArgType
+    {
+      ARG_BOOL,
+      ARG_CHAR,
+      ARG_INT,
+      ARG_UINT,
+      ARG_LONG,
+      ARG_ULONG,
+      ARG_DOUBLE,
+      ARG_STRING,
+    };
+
+  TraceArgs() : length(0), overflow(NULL) {}
+  ~TraceArgs() { delete overflow; }
+
+  TraceArgs &operator<<(bool value) { return put(ARG_BOOL, &value, sizeof(value)); }
+  TraceArgs &operator<<(char value) { return put(ARG_CHAR, &value, sizeof(value)); }
+  TraceArgs &operator<<(int value) { return put(ARG_INT, &value, sizeof(value)); }
+  TraceArgs &operator<<(unsigned int value) { return put(ARG_UINT, &value, sizeof(value)); }
+  TraceArgs &operator<<(long value) { return put(ARG_LONG, &value, sizeof(value)); }
+  TraceArgs &operator<<(unsigned long value) { return put(ARG_ULONG, &value, sizeof(value)); }
+  TraceArgs &operator<<(double value) { return put(ARG_DOUBLE, &value, sizeof(value)); }
+  TraceArgs &operator<<(const char *value) { return put_string(value != NULL ? value : "(null)"); }
+  TraceArgs &operator<<(char *value) { return put_string(value != NULL ? value : "(null)"); }
+  TraceArgs &operator<<(const std::string &value) { return put_string(value.data(), value.size()); }
+
+  template<class T>
+  TraceArgs &operator<<(const T &value)
+  {
+    std::ostringstream ss;
+    ss << value;
+    return *this << ss.str();
+  }
+
+  const char *data() const { return overflow != NULL ? overflow->data() : buffer; }
+  size_t size() const { return overflow != NULL ? overflow->size() : length; }
+
+  static void format(const char *data, size_t size, std::string &out);
+
+private:
+  enum
+    {
+      //! Size of the arguments that are stored without allocating.
+      INLINE_SIZE = 256
+    };
+
+  TraceArgs(const TraceArgs &);
+  TraceArgs &operator=(const TraceArgs &);
+
+  TraceArgs &put_string(const char *value) { return put_string(value, strlen(value)); }
+  TraceArgs &put_string(const char *value, size_t size);
+  TraceArgs &put(ArgType type, const void *value, size_t size);
+  void append(const void *data, size_t size);
+
+private:
+  //! Arguments, each a type byte followed by the value.
+  char buffer[INLINE_SIZE];
+
+  //! Number of bytes used in buffer.
+  size_t length;
+
+  //! All arguments once they do not fit in buffer, or NULL.
+  std::string *overflow;
+};
 
+//! Collects trace events in per-thread buffers.
+/*!
+ *  Recording an event writes a variable size record into a lock-free
+ *  buffer of the calling thread. A background thread formats the records
+ *  and writes them to a Chrome trace (JSON) file. When a buffer is full,
+ *  events are dropped rather than blocking the thread.
+ */
 class Debug
 {
 public:
+  enum TraceEventType
+    {
+      TRACE_EVENT_BEGIN,
+      TRACE_EVENT_END,
+      TRACE_EVENT_INSTANT,
+    };
+
   static void init();
-  static std::string trace_get_time();
+  static void terminate();
+
+  static void trace(const TraceSite *site, TraceEventType type);
+  static void trace(const TraceSite *site, TraceEventType type, const TraceArgs &args);
+
+private:
+  static void trace(const TraceSite *site, TraceEventType type, const char *data, size_t size);
 };
 
-#define TRACE_ENTER(x   ) g_log_mutex.lock(); \
-                          const char *_trace_method_name = x;   \
-                          std::cerr << Debug::trace_get_time() << ">>> " << x << std::endl; \
-                          g_log_mutex.unlock();
+#define TRACE_ENTER(x   ) static const TraceSite _trace_site = { x, __FILE__, __LINE__ }; \
+                          const TraceSite *_trace_method_site = &_trace_site; \
+                          Debug::trace(_trace_method_site, Debug::TRACE_EVENT_BEGIN);
 
-#define TRACE_ENTER_MSG(x, y) g_log_mutex.lock(); \
-                          const char *_trace_method_name = x; \
-                          std::cerr  << Debug::trace_get_time() << ">>> " << x << " " << y << std::endl; \
-                          g_log_mutex.unlock();
+#define TRACE_ENTER_MSG(x, y) static const TraceSite _trace_site = { x, __FILE__, __LINE__ }; \
+                          const TraceSite *_trace_method_site = &_trace_site; \
+                          { TraceArgs _trace_args; _trace_args << y; \
+                            Debug::trace(_trace_method_site, Debug::TRACE_EVENT_BEGIN, _trace_args); }
 
-#define TRACE_RETURN(y)   g_log_mutex.lock(); \
-                          std::cerr << Debug::trace_get_time() << "<<< " << _trace_method_name << y << std::endl; \
-                          g_log_mutex.unlock();
+#define TRACE_RETURN(y)   { TraceArgs _trace_args; _trace_args << y; \
+                            Debug::trace(_trace_method_site, Debug::TRACE_EVENT_END, _trace_args); }
 
-#define TRACE_EXIT()      g_log_mutex.lock(); \
-                          std::cerr << Debug::trace_get_time() << "<<< " << _trace_method_name << std::endl; \
-                          g_log_mutex.unlock();
+#define TRACE_EXIT()      Debug::trace(_trace_method_site, Debug::TRACE_EVENT_END);
 
-#define TRACE_MSG(msg)    g_log_mutex.lock(); \
-                          std::cerr << Debug::trace_get_time() << "    " << _trace_method_name << " " << msg  << std::endl; \
-                          g_log_mutex.unlock();
+#define TRACE_MSG(msg)    { TraceArgs _trace_args; _trace_args << msg; \
+                            Debug::trace(_trace_method_site, Debug::TRACE_EVENT_INSTANT, _trace_args); }
 
-#define TRACE_MSG2(x,y)   g_log_mutex.lock(); \
-                          std::cerr << Debug::trace_get_time() << "    " << _trace_method_name << " " << x << " " << y << std::endl; \
-                          g_log_mutex.unlock();
+#define TRACE_MSG2(x,y)   { TraceArgs _trace_args; _trace_args << x << " " << y; \
+                            Debug::trace(_trace_method_site, Debug::TRACE_EVENT_INSTANT, _trace_args); }
 
 #endif // TRACING
 
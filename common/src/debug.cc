@@ -23,6 +23,12 @@
 
 #ifdef TRACING
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
 #include <glib.h>
 #include <glib/gstdio.h>
 
@@ -32,28 +38,283 @@
 #endif
 
 #include "Mutex.hh"
+#include "Runnable.hh"
+#include "Thread.hh"
 #include "debug.hh"
 
 using namespace std;
 
-Mutex g_log_mutex;
-std::ofstream g_log_stream;
+//! Size in bytes of the buffer of each thread. Must be a power of two.
+static const guint TRACE_BUFFER_SIZE = 256 * 1024;
+
+//! Events that need more space are dropped.
+static const guint TRACE_MAX_RECORD_SIZE = TRACE_BUFFER_SIZE / 4;
+
+//! Interval at which the buffers are written to the trace file.
+static const int TRACE_FLUSH_INTERVAL = 100000;
 
-std::string
-Debug::trace_get_time()
+//! Header of a trace event, followed by its arguments.
+/*!
+ *  A header without a site marks the rest of the buffer as unused.
+ */
+struct TraceRecord
 {
-  char logtime[128];
-  time_t ltime;
+  const TraceSite *site;
+  gint64 time;
+  guint32 size;
+  guint8 type;
+};
 
-  time(&ltime);
-  struct tm *tmlt = localtime(&ltime);
-  strftime(logtime, 128, "%d%b%Y %H:%M:%S ", tmlt);
-  return logtime;
+//! Trace events of a single thread.
+/*!
+ *  The owning thread is the only writer of head and the flush thread is
+ *  the only writer of tail, so neither needs a lock. Both count bytes.
+ */
+struct TraceBuffer
+{
+  gint64 data[TRACE_BUFFER_SIZE / sizeof(gint64)];
+  volatile gint head;
+  volatile gint tail;
+  volatile gint dropped;
+  int tid;
+};
+
+//! Writes the trace buffers to the trace file.
+class TraceFlusher : public Runnable
+{
+public:
+  void run();
+};
+
+static Mutex trace_mutex;
+static vector<TraceBuffer *> trace_buffers;
+static FILE *trace_file = NULL;
+static bool trace_first_event = true;
+static Thread *trace_thread = NULL;
+static TraceFlusher trace_flusher;
+static volatile gint trace_stop = 0;
+static bool trace_started = false;
+
+#if GLIB_CHECK_VERSION(2, 31, 18)
+static GPrivate trace_buffer_key = G_PRIVATE_INIT(NULL);
+#else
+static GStaticPrivate trace_buffer_key = G_STATIC_PRIVATE_INIT;
+#endif
+
+
+static bool start_trace();
+
+
+//! Rounds the size of a record up, so that the next record is aligned.
+static inline guint
+align_record_size(size_t size)
+{
+  return (guint) ((size + sizeof(gint64) - 1) & ~(sizeof(gint64) - 1));
+}
+
+
+//! Writes the pending events when the program exits.
+static void
+terminate_trace()
+{
+  Debug::terminate();
+}
+
+
+//! Returns the trace buffer of the calling thread.
+static TraceBuffer *
+get_trace_buffer()
+{
+#if GLIB_CHECK_VERSION(2, 31, 18)
+  TraceBuffer *buffer = (TraceBuffer *) g_private_get(&trace_buffer_key);
+#else
+  TraceBuffer *buffer = (TraceBuffer *) g_static_private_get(&trace_buffer_key);
+#endif
+
+  if (buffer == NULL)
+    {
+      buffer = new TraceBuffer;
+      buffer->head = 0;
+      buffer->tail = 0;
+      buffer->dropped = 0;
+
+#if GLIB_CHECK_VERSION(2, 31, 18)
+      g_private_set(&trace_buffer_key, buffer);
+#else
+      g_static_private_set(&trace_buffer_key, buffer, NULL);
+#endif
+
+      // Buffers are never freed, so that the events of threads that
+      // have exited are still written.
+      trace_mutex.lock();
+      buffer->tid = (int) trace_buffers.size() + 1;
+      trace_buffers.push_back(buffer);
+      trace_mutex.unlock();
+
+      // Programs that do not call Debug::init() start tracing with
+      // their first event.
+      if (!trace_started && start_trace())
+        {
+          atexit(terminate_trace);
+        }
+    }
+
+  return buffer;
+}
+
+
+//! Writes a string to the trace file as a JSON string.
+static void
+write_json_string(const char *str, int length)
+{
+  fputc('"', trace_file);
+  for (int i = 0; i < length && str[i] != '\0'; i++)
+    {
+      unsigned char c = str[i];
+      if (c == '"' || c == '\\')
+        {
+          fputc('\\', trace_file);
+          fputc(c, trace_file);
+        }
+      else if (c < 0x20)
+        {
+          fprintf(trace_file, "\\u%04x", c);
+        }
+      else
+        {
+          fputc(c, trace_file);
+        }
+    }
+  fputc('"', trace_file);
 }
 
+
+//! Writes a single event to the trace file.
+static void
+write_event(const char *name, char phase, gint64 time, int tid, const char *text, int length)
+{
+  fputs(trace_first_event ? "\n" : ",\n", trace_file);
+  trace_first_event = false;
+
+  fputs("{\"name\":", trace_file);
+  write_json_string(name, (int) strlen(name));
+  fprintf(trace_file, ",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%d", phase, time, tid);
+  if (phase == 'i')
+    {
+      fputs(",\"s\":\"t\"", trace_file);
+    }
+  if (length > 0)
+    {
+      fputs(",\"args\":{\"msg\":", trace_file);
+      write_json_string(text, length);
+      fputc('}', trace_file);
+    }
+  fputc('}', trace_file);
+}
+
+
+//! Writes all pending events to the trace file.
+static void
+flush_trace_buffers()
+{
+  trace_mutex.lock();
+  vector<TraceBuffer *> buffers = trace_buffers;
+  trace_mutex.unlock();
+
+  for (vector<TraceBuffer *>::iterator i = buffers.begin(); i != buffers.end(); i++)
+    {
+      TraceBuffer *buffer = *i;
+
+      guint head = (guint) g_atomic_int_get(&buffer->head);
+      guint tail = (guint) buffer->tail;
+
+      const char *base = (const char *) buffer->data;
+      string text;
+
+      while (tail != head)
+        {
+          guint pos = tail & (TRACE_BUFFER_SIZE - 1);
+          guint remaining = TRACE_BUFFER_SIZE - pos;
+
+          TraceRecord record;
+          record.site = NULL;
+          if (remaining >= sizeof(TraceRecord))
+            {
+              memcpy(&record, base + pos, sizeof(TraceRecord));
+            }
+
+          if (record.site == NULL)
+            {
+              // The writer continued at the start of the buffer.
+              tail += remaining;
+              continue;
+            }
+
+          static const char phases[] = { 'B', 'E', 'i' };
+
+          if (trace_file != NULL)
+            {
+              TraceArgs::format(base + pos + sizeof(TraceRecord), record.size, text);
+              write_event(record.site->name, phases[record.type], record.time, buffer->tid,
+                          text.data(), (int) text.size());
+            }
+          tail += align_record_size(sizeof(TraceRecord) + record.size);
+        }
+      g_atomic_int_set(&buffer->tail, (gint) tail);
+
+      gint dropped = g_atomic_int_get(&buffer->dropped);
+      if (dropped > 0)
+        {
+          g_atomic_int_add(&buffer->dropped, -dropped);
+
+          if (trace_file != NULL)
+            {
+              char text[32];
+              int length = g_snprintf(text, sizeof(text), "%d", dropped);
+
+              GTimeVal now;
+              g_get_current_time(&now);
+              write_event("trace buffer overflow", 'i', (gint64) now.tv_sec * G_USEC_PER_SEC + now.tv_usec,
+                          buffer->tid, text, length);
+            }
+        }
+    }
+
+  if (trace_file != NULL)
+    {
+      fflush(trace_file);
+    }
+}
+
+
 void
-Debug::init()
+TraceFlusher::run()
 {
+  while (!g_atomic_int_get(&trace_stop))
+    {
+      flush_trace_buffers();
+      g_usleep(TRACE_FLUSH_INTERVAL);
+    }
+}
+
+
+//! Opens the trace file and starts the flush thread, once.
+/*!
+ *  \retval true if tracing was started by this call.
+ */
+static bool
+start_trace()
+{
+  trace_mutex.lock();
+  bool start = !trace_started;
+  trace_started = true;
+  trace_mutex.unlock();
+
+  if (!start)
+    {
+      return false;
+    }
+
   std::string debug_filename;
 
 #if defined(WIN32) || defined(PLATFORM_OS_WIN32)
@@ -83,15 +344,214 @@ Debug::init()
 
   time(&ltime);
   struct tm *tmlt = localtime(&ltime);
-  strftime(logfile, 128, "workrave-%d%b%Y-%H%M%S", tmlt);
+  strftime(logfile, 128, "workrave-%d%b%Y-%H%M%S.json", tmlt);
 
   debug_filename += logfile;
 
-  g_log_stream.open(debug_filename.c_str(), std::ios::app);
-  if (g_log_stream.is_open())
+  trace_file = g_fopen(debug_filename.c_str(), "w");
+  if (trace_file != NULL)
+    {
+      fputc('[', trace_file);
+    }
+
+  trace_thread = new Thread(&trace_flusher);
+  trace_thread->start();
+
+  return true;
+}
+
+
+void
+Debug::init()
+{
+  start_trace();
+}
+
+
+//! Writes all pending events and closes the trace file.
+void
+Debug::terminate()
+{
+  if (trace_thread != NULL)
     {
-      std::cerr.rdbuf(g_log_stream.rdbuf());
+      g_atomic_int_set(&trace_stop, 1);
+      trace_thread->wait();
+      delete trace_thread;
+      trace_thread = NULL;
     }
+
+  flush_trace_buffers();
+
+  if (trace_file != NULL)
+    {
+      fputs("\n]\n", trace_file);
+      fclose(trace_file);
+      trace_file = NULL;
+    }
+}
+
+
+void
+Debug::trace(const TraceSite *site, TraceEventType type)
+{
+  trace(site, type, NULL, 0);
+}
+
+
+void
+Debug::trace(const TraceSite *site, TraceEventType type, const TraceArgs &args)
+{
+  trace(site, type, args.data(), args.size());
+}
+
+
+//! Writes an event with the specified arguments into the buffer of the calling thread.
+void
+Debug::trace(const TraceSite *site, TraceEventType type, const char *data, size_t size)
+{
+  TraceBuffer *buffer = get_trace_buffer();
+
+  guint record_size = align_record_size(sizeof(TraceRecord) + size);
+  guint head = (guint) buffer->head;
+  guint tail = (guint) g_atomic_int_get(&buffer->tail);
+  guint pos = head & (TRACE_BUFFER_SIZE - 1);
+
+  // A record is never split; if it does not fit at the end of the buffer,
+  // it is written at the start.
+  guint skip = 0;
+  if (pos + record_size > TRACE_BUFFER_SIZE)
+    {
+      skip = TRACE_BUFFER_SIZE - pos;
+    }
+
+  if (record_size > TRACE_MAX_RECORD_SIZE ||
+      head + skip + record_size - tail > TRACE_BUFFER_SIZE)
+    {
+      g_atomic_int_inc(&buffer->dropped);
+      return;
+    }
+
+  char *base = (char *) buffer->data;
+  TraceRecord record;
+  memset(&record, 0, sizeof(record));
+
+  if (skip >= sizeof(TraceRecord))
+    {
+      memcpy(base + pos, &record, sizeof(record));
+    }
+  pos = (head + skip) & (TRACE_BUFFER_SIZE - 1);
+
+  GTimeVal now;
+  g_get_current_time(&now);
+
+  record.site = site;
+  record.time = (gint64) now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+  record.size = (guint32) size;
+  record.type = (guint8) type;
+
+  memcpy(base + pos, &record, sizeof(record));
+  if (size > 0)
+    {
+      memcpy(base + pos + sizeof(record), data, size);
+    }
+
+  // Publish the record to the flush thread.
+  g_atomic_int_set(&buffer->head, (gint) (head + skip + record_size));
+}
+
+
+//! Stores an argument.
+TraceArgs &
+TraceArgs::put(ArgType type, const void *value, size_t size)
+{
+  char tag = (char) type;
+  append(&tag, 1);
+  append(value, size);
+  return *this;
+}
+
+
+//! Stores a string argument.
+TraceArgs &
+TraceArgs::put_string(const char *value, size_t size)
+{
+  put(ARG_STRING, &size, sizeof(size));
+  append(value, size);
+  return *this;
+}
+
+
+//! Appends raw bytes to the arguments.
+void
+TraceArgs::append(const void *data, size_t size)
+{
+  if (overflow == NULL && length + size > INLINE_SIZE)
+    {
+      overflow = new std::string(buffer, length);
+    }
+
+  if (overflow != NULL)
+    {
+      overflow->append((const char *) data, size);
+    }
+  else
+    {
+      memcpy(buffer + length, data, size);
+      length += size;
+    }
+}
+
+
+//! Formats arguments stored by a TraceArgs.
+void
+TraceArgs::format(const char *data, size_t size, string &out)
+{
+  ostringstream ss;
+  size_t pos = 0;
+
+  while (pos < size)
+    {
+      ArgType type = (ArgType) data[pos++];
+      const char *value = data + pos;
+
+      switch (type)
+        {
+#define TRACE_FORMAT_ARG(arg_type, value_type)                    \
+        case arg_type:                                            \
+          {                                                       \
+            value_type v;                                         \
+            memcpy(&v, value, sizeof(v));                         \
+            ss << v;                                              \
+            pos += sizeof(v);                                     \
+          }                                                       \
+          break;
+
+          TRACE_FORMAT_ARG(ARG_BOOL, bool)
+          TRACE_FORMAT_ARG(ARG_CHAR, char)
+          TRACE_FORMAT_ARG(ARG_INT, int)
+          TRACE_FORMAT_ARG(ARG_UINT, unsigned int)
+          TRACE_FORMAT_ARG(ARG_LONG, long)
+          TRACE_FORMAT_ARG(ARG_ULONG, unsigned long)
+          TRACE_FORMAT_ARG(ARG_DOUBLE, double)
+
+#undef TRACE_FORMAT_ARG
+
+        case ARG_STRING:
+          {
+            size_t length;
+            memcpy(&length, value, sizeof(length));
+            ss.write(value + sizeof(length), length);
+            pos += sizeof(length) + length;
+          }
+          break;
+
+        default:
+          pos = size;
+          break;
+        }
+    }
+
+  out = ss.str();
 }
 
 #endif
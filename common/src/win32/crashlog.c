@@ -259,8 +259,8 @@ exception_handler(struct _EXCEPTION_RECORD *exception_record,
 #ifdef HAVE_GCONF
           "GCONF?? "
 #endif
-#ifdef HAVE_GDOME
-          "GDOME "
+#ifdef HAVE_XML
+          "XML "
 #endif
 #ifdef HAVE_GNET
           "GNET "
@@ -21,6 +21,7 @@
 #define TIMERBOXCONTROL_HH
 
 #include <string>
+#include <list>
 
 #include "ICore.hh"
 #include "IConfiguratorListener.hh"
@@ -74,6 +75,7 @@ public:
 private:
   // IConfiguratorListener
   void config_changed_notify(const std::string &key);
+  void config_batch_changed_notify(const std::list<std::string> &keys);
   void update_widgets();
   void init_table();
   void init_icon();
@@ -481,6 +481,17 @@ TimerBoxControl::config_changed_notify(const string &key)
 }
 
 
+//! Reads the configuration once for all keys that changed together.
+void
+TimerBoxControl::config_batch_changed_notify(const list<string> &keys)
+{
+  if (!keys.empty())
+    {
+      config_changed_notify(keys.front());
+    }
+}
+
+
 int
 TimerBoxControl::get_cycle_time(string name)
 {
@@ -141,7 +141,8 @@ GUI::GUI(int argc, char **argv) :
   status_icon(NULL),
   applet_control(NULL),
   muted(false),
-  closewarn_shown(false)
+  closewarn_shown(false),
+  heartbeat_interval(0)
 {
   TRACE_ENTER("GUI:GUI");
 
@@ -357,9 +358,25 @@ GUI::on_timer()
         }
     }
 
+  int interval = core->get_heartbeat_interval();
+  if (interval != heartbeat_interval)
+    {
+      schedule_timer(interval);
+    }
+
   return true;
 }
 
+
+//! (Re)starts the heartbeat timer.
+void
+GUI::schedule_timer(int interval)
+{
+  heartbeat_connection.disconnect();
+  heartbeat_interval = interval;
+  heartbeat_connection = Glib::signal_timeout().connect(sigc::mem_fun(*this, &GUI::on_timer), interval * 1000);
+}
+
 #if defined(NDEBUG)
 static void my_log_handler(const gchar *log_domain, GLogLevelFlags log_level,
                            const gchar *message, gpointer user_data)
@@ -738,7 +755,7 @@ GUI::init_gui()
 #endif
 
   // Periodic timer.
-  Glib::signal_timeout().connect(sigc::mem_fun(*this, &GUI::on_timer), 1000);
+  schedule_timer(1);
 }
 
 
@@ -893,6 +910,16 @@ GUI::core_event_notify(const CoreEvent event)
 }
 
 
+void
+GUI::core_event_heartbeat_wakeup()
+{
+  if (heartbeat_interval > 1)
+    {
+      schedule_timer(0);
+    }
+}
+
+
 void
 GUI::core_event_operation_mode_changed(const OperationMode m)
 {
@@ -117,6 +117,7 @@ public:
   void core_event_notify(const CoreEvent event);
   void core_event_operation_mode_changed(const OperationMode m);
   void core_event_usage_mode_changed(const UsageMode m);
+  void core_event_heartbeat_wakeup();
 
   virtual void bus_name_presence(const std::string &name, bool present);
   
@@ -139,6 +140,7 @@ public:
 private:
   std::string get_timers_tooltip();
   bool on_timer();
+  void schedule_timer(int interval);
   void init_platform();
   void init_debug();
   void init_nls();
@@ -272,6 +274,12 @@ private:
 
   // UI Event connections
   std::list<sigc::connection> event_connections;
+
+  //! Connection to the heartbeat timer.
+  sigc::connection heartbeat_connection;
+
+  //! Interval of the heartbeat timer in seconds.
+  int heartbeat_interval;
   
 };
 
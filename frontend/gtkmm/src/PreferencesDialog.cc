@@ -943,7 +943,12 @@ PreferencesDialog::on_sound_theme_changed()
 
       IGUI *gui = GUI::get_instance();
       SoundPlayer *snd = gui->get_sound_player();
+
+      // Apply all sounds of the theme at once.
+      IConfigurator *config = CoreFactory::get_configurator();
+      config->begin_transaction();
       snd->activate_theme(theme);
+      config->commit_transaction();
 
       Glib::RefPtr<Gtk::TreeSelection> selection = sound_treeview.get_selection();
       Gtk::TreeModel::iterator iter = selection->get_selected();
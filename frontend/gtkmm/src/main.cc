@@ -69,6 +69,10 @@ run(int argc, char **argv)
 
   delete gui;
 
+#ifdef TRACING
+  Debug::terminate();
+#endif
+
 #if defined(THIS_SEEMS_TO_CAUSE_PROBLEMS_ON_WINDOWS_SERVER)
 #if defined(PLATFORM_OS_WIN32) && !defined(PLATFORM_OS_WIN32_NATIVE)
   // Disable Windows structural exception handling.
@@ -76,7 +76,9 @@ GUI::GUI(int argc, char **argv)  :
   response(NULL),
   break_window_destroy(false),
   prelude_window_destroy(false),
-  active_break_id(BREAK_ID_NONE)
+  active_break_id(BREAK_ID_NONE),
+  heartbeat_source(0),
+  heartbeat_interval(0)
 {
   TRACE_ENTER("GUI:GUI");
 
@@ -116,8 +118,7 @@ gboolean
 GUI::static_on_timer(gpointer data)
 {
   GUI *gui = (GUI*) data;
-  gui->on_timer();
-  return true;
+  return gui->on_timer();
 }
 
 
@@ -153,7 +154,7 @@ GUI::main()
   const char *env = getenv("WORKRAVE_TEST");
   if (env == NULL)
     {
-      g_timeout_add(1000, static_on_timer, this);
+      schedule_timer(1);
     }
 
   g_main_loop_run(main_loop);
@@ -204,9 +205,32 @@ GUI::on_timer()
 
   collect_garbage();
 
+  if (core != NULL && heartbeat_source != 0)
+    {
+      int interval = core->get_heartbeat_interval();
+      if (interval != heartbeat_interval)
+        {
+          schedule_timer(interval);
+        }
+    }
+
   return true;
 }
 
+
+//! (Re)starts the heartbeat timer.
+void
+GUI::schedule_timer(int interval)
+{
+  if (heartbeat_source != 0)
+    {
+      g_source_remove(heartbeat_source);
+    }
+
+  heartbeat_interval = interval;
+  heartbeat_source = g_timeout_add(interval * 1000, static_on_timer, this);
+}
+
 #ifdef NDEBUG
 static void my_log_handler(const gchar *log_domain, GLogLevelFlags log_level,
                            const gchar *message, gpointer user_data)
@@ -300,6 +324,16 @@ GUI::core_event_operation_mode_changed(const OperationMode m)
   (void) m;
 }
 
+
+void
+GUI::core_event_heartbeat_wakeup()
+{
+  if (heartbeat_interval > 1)
+    {
+      schedule_timer(0);
+    }
+}
+
 //! Returns a break window for the specified break.
 IBreakWindow *
 GUI::new_break_window(BreakId break_id, bool user_initiated)
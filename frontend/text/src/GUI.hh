@@ -69,6 +69,7 @@ public:
   //
   void core_event_notify(CoreEvent event);
   void core_event_operation_mode_changed(const OperationMode m);
+  void core_event_heartbeat_wakeup();
 
   SoundPlayer *get_sound_player() const;
 
@@ -78,6 +79,7 @@ public:
 
 private:
   bool on_timer();
+  void schedule_timer(int interval);
   void init_gui();
   void init_debug();
   void init_nls();
@@ -140,6 +142,12 @@ private:
   //! Progress values
   int progress_value;
   int progress_max_value;
+
+  //! Source ID of the heartbeat timer.
+  guint heartbeat_source;
+
+  //! Interval of the heartbeat timer in seconds.
+  int heartbeat_interval;
 };
 
 